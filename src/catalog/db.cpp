@@ -6,6 +6,7 @@
 #include <unordered_map>
 
 #include "common/logging.hpp"
+#include "common/memory_budget.hpp"
 #include "storage/bplus-tree-storage.hpp"
 #include "storage/memory_storage.hpp"
 #include "transaction/lock_manager.hpp"
@@ -21,12 +22,15 @@ class DB::Impl {
 
  public:
   static auto Open(std::filesystem::path path, bool create_if_missing,
-      size_t max_buf_pages) -> Result<std::unique_ptr<DB::Impl>, io::Error> {
-    auto table_storage = EXTRACT_RESULT(StorageBackend::Open(
-        std::move(path), create_if_missing, max_buf_pages));
-    return std::unique_ptr<DB::Impl>(new DB::Impl(std::move(table_storage)));
+      size_t buffer_pool_size) -> Result<std::unique_ptr<DB::Impl>, io::Error> {
+    auto table_storage = EXTRACT_RESULT(StorageBackend::Open(std::move(path),
+        create_if_missing, buffer_pool_size / Page::SIZE));
+    return std::unique_ptr<DB::Impl>(
+        new DB::Impl(std::move(table_storage), buffer_pool_size));
   }
 
+  ~Impl() { MemoryBudget::Global().RemoveBufferPool(budget_id_); }
+
   void CreateTable(txn_id_t txn_id, const TableSchema& schema) {
     // It is safe to directly acquire X lock since it is the highest level.
     txn_manager_.GetLockManager().AcquireTableLock(
@@ -65,21 +69,18 @@ class DB::Impl {
   // For simplicity, range iterator holds the S lock on the whole table.
   std::unique_ptr<Iterator<const uint8_t*>> GetRangeIterator(txn_id_t txn_id,
       std::string_view table_name, std::tuple<std::string_view, bool, bool> L,
-      std::tuple<std::string_view, bool, bool> R) {
+      std::tuple<std::string_view, bool, bool> R, bool reverse) {
     // P4 TODO
-    std::string table_name_=std::basic_string(table_name.data(),table_name.size());
-    auto txn=txn_manager_.GetTxn(txn_id).value();
-    bool flag=false;
-    LockMode mode;
-    txn->rw_latch_.lock();
-    if (!txn->table_lock_set_[LockMode::X].count(table_name_)&&!txn->table_lock_set_[LockMode::SIX].count(table_name_))
-    {
-      flag=true;
-      mode=(txn->table_lock_set_[LockMode::IX].count(table_name_))?LockMode::SIX:LockMode::S;
-    }
-    txn->rw_latch_.unlock();
-    if (flag) txn_manager_.GetLockManager().AcquireTableLock(table_name,mode,txn);
-    return table_storage_.GetRangeIterator(table_name,L,R);
+    AcquireScanLock(txn_id,table_name);
+    return table_storage_.GetRangeIterator(table_name,L,R,reverse);
+  }
+
+  std::vector<std::unique_ptr<Iterator<const uint8_t*>>> GetRangeIterators(
+      txn_id_t txn_id, std::string_view table_name,
+      std::tuple<std::string_view, bool, bool> L,
+      std::tuple<std::string_view, bool, bool> R, size_t n) {
+    AcquireScanLock(txn_id,table_name);
+    return table_storage_.GetRangeIterators(table_name,L,R,n);
   }
 
   std::unique_ptr<ModifyHandle> GetModifyHandle(
@@ -123,6 +124,25 @@ class DB::Impl {
 
   const DBSchema& GetDBSchema() const { return table_storage_.GetDBSchema(); }
 
+  BufferPoolReport GetBufferPoolReport() const {
+    return table_storage_.GetBufferPoolReport();
+  }
+
+  void SetBufferPoolSize(size_t buffer_pool_size) {
+    MemoryBudget::Global().SetBufferPoolWanted(budget_id_, buffer_pool_size);
+  }
+
+  void Vacuum(txn_id_t txn_id) {
+    // Pages of all tables are moved, so wait for all transactions that are
+    // accessing them.
+    auto txn = TxnManager::GetTxn(txn_id).value();
+    for (auto& a : table_storage_.GetDBSchema().GetTables()) {
+      txn_manager_.GetLockManager().AcquireTableLock(
+          a.GetName(), LockMode::X, txn);
+    }
+    table_storage_.Compact();
+  }
+
   size_t GetPrimaryKey(std::string_view table_name) {
     auto ret = table_storage_.GetMaxKey(table_name);
     if (!ret.has_value()) {
@@ -151,13 +171,33 @@ class DB::Impl {
   }
 
  private:
-  Impl(StorageBackend&& table_storage)
+  Impl(StorageBackend&& table_storage, size_t buffer_pool_size)
     : table_storage_(std::move(table_storage)), txn_manager_(table_storage_) {
     for (auto& a : table_storage_.GetDBSchema().GetTables()) {
       std::string name(a.GetName());
       size_t tick = table_storage_.GetTicks(a.GetName());
       tick_table_[name].store(tick, std::memory_order_relaxed);
     }
+    budget_id_ = MemoryBudget::Global().AddBufferPool(
+        buffer_pool_size, [this](size_t size) {
+          table_storage_.SetMaxBufPages(size / Page::SIZE);
+        });
+  }
+  // Range scans hold the S lock on the whole table, or SIX if the transaction
+  // already holds IX.
+  void AcquireScanLock(txn_id_t txn_id, std::string_view table_name) {
+    std::string table_name_=std::basic_string(table_name.data(),table_name.size());
+    auto txn=txn_manager_.GetTxn(txn_id).value();
+    bool flag=false;
+    LockMode mode;
+    txn->rw_latch_.lock();
+    if (!txn->table_lock_set_[LockMode::X].count(table_name_)&&!txn->table_lock_set_[LockMode::SIX].count(table_name_))
+    {
+      flag=true;
+      mode=(txn->table_lock_set_[LockMode::IX].count(table_name_))?LockMode::SIX:LockMode::S;
+    }
+    txn->rw_latch_.unlock();
+    if (flag) txn_manager_.GetLockManager().AcquireTableLock(table_name,mode,txn);
   }
   StorageBackend table_storage_;
   std::map<std::string, std::unique_ptr<TableStatistics>, std::less<>>
@@ -167,12 +207,14 @@ class DB::Impl {
 
   // global txn manager and lock manager (inside txn_manager_).
   TxnManager txn_manager_;
+
+  // The ID of the buffer pool in the memory budget.
+  size_t budget_id_;
 };
 
-DB::DB(std::string_view file_name) {
+DB::DB(std::string_view file_name, size_t buffer_pool_size) {
   std::filesystem::path path(file_name);
-  // 128MB of buffer
-  auto ret = DB::Impl::Open(path, true, 32 * 1024);
+  auto ret = DB::Impl::Open(path, true, buffer_pool_size);
   if (ret.index() == 1)
     throw std::get<1>(ret).to_string();
   ptr_ = std::move(std::get<0>(ret));
@@ -195,8 +237,15 @@ std::unique_ptr<Iterator<const uint8_t*>> DB::GetIterator(
 
 std::unique_ptr<Iterator<const uint8_t*>> DB::GetRangeIterator(txn_id_t txn_id,
     std::string_view table_name, std::tuple<std::string_view, bool, bool> L,
-    std::tuple<std::string_view, bool, bool> R) {
-  return ptr_->GetRangeIterator(txn_id, table_name, L, R);
+    std::tuple<std::string_view, bool, bool> R, bool reverse) {
+  return ptr_->GetRangeIterator(txn_id, table_name, L, R, reverse);
+}
+
+std::vector<std::unique_ptr<Iterator<const uint8_t*>>> DB::GetRangeIterators(
+    txn_id_t txn_id, std::string_view table_name,
+    std::tuple<std::string_view, bool, bool> L,
+    std::tuple<std::string_view, bool, bool> R, size_t n) {
+  return ptr_->GetRangeIterators(txn_id, table_name, L, R, n);
 }
 
 std::unique_ptr<ModifyHandle> DB::GetModifyHandle(
@@ -210,6 +259,16 @@ GenPKHandle DB::GetGenPKHandle(txn_id_t txn_id, std::string_view table_name) {
 
 const DBSchema& DB::GetDBSchema() const { return ptr_->GetDBSchema(); }
 
+BufferPoolReport DB::GetBufferPoolReport() const {
+  return ptr_->GetBufferPoolReport();
+}
+
+void DB::SetBufferPoolSize(size_t buffer_pool_size) {
+  ptr_->SetBufferPoolSize(buffer_pool_size);
+}
+
+void DB::Vacuum(txn_id_t txn_id) { ptr_->Vacuum(txn_id); }
+
 std::unique_ptr<SearchHandle> DB::GetSearchHandle(
     txn_id_t txn_id, std::string_view table_name) {
   return ptr_->GetSearchHandle(txn_id, table_name);
@@ -6,6 +6,7 @@
 #include "catalog/gen_pk.hpp"
 #include "catalog/schema.hpp"
 #include "catalog/stat.hpp"
+#include "storage/buffer-pool-stats.hpp"
 #include "storage/storage.hpp"
 #include "transaction/txn.hpp"
 #include "transaction/txn_manager.hpp"
@@ -14,7 +15,13 @@ namespace wing {
 
 class DB {
  public:
-  DB(std::string_view file_name);
+  // 128MB of buffer
+  static constexpr size_t DEFAULT_BUFFER_POOL_SIZE = 128 << 20;
+
+  /* The buffer pool gets at most "buffer_pool_size" bytes. It gets less if
+   * the process-wide MemoryBudget is not enough. */
+  DB(std::string_view file_name,
+      size_t buffer_pool_size = DEFAULT_BUFFER_POOL_SIZE);
 
   ~DB();
 
@@ -39,10 +46,23 @@ class DB {
    * Parameter L, R: the tuple of (key, is_empty, is_eq).
    * If is_empty is true, then it doesn't have limit in one direction. If is_eq
    * is true. then the endpoint of the interval is closed.
+   *
+   * If reverse is true, the iterator starts from the rightmost element instead
+   * and returns the elements in descending order.
    */
   std::unique_ptr<Iterator<const uint8_t*>> GetRangeIterator(txn_id_t txn_id,
       std::string_view table_name, std::tuple<std::string_view, bool, bool> L,
-      std::tuple<std::string_view, bool, bool> R);
+      std::tuple<std::string_view, bool, bool> R, bool reverse = false);
+
+  /** Split the interval [L, R] (see GetRangeIterator) into at most n smaller
+   * intervals of roughly equal size, and return a range iterator for each of
+   * them in ascending order. The iterators can be used in different threads.
+   * Small tables may be split into fewer intervals.
+   */
+  std::vector<std::unique_ptr<Iterator<const uint8_t*>>> GetRangeIterators(
+      txn_id_t txn_id, std::string_view table_name,
+      std::tuple<std::string_view, bool, bool> L,
+      std::tuple<std::string_view, bool, bool> R, size_t n);
 
   /* Get a handle for modifying table. See storage.hpp for definition of
    * ModifyHandle. */
@@ -65,6 +85,17 @@ class DB {
 
   const DBSchema& GetDBSchema() const;
 
+  // The buffer pool counters of the whole database and of each table.
+  BufferPoolReport GetBufferPoolReport() const;
+
+  // Grow or shrink the buffer pool online.
+  void SetBufferPoolSize(size_t buffer_pool_size);
+
+  // Compact the database file online, so that the pages of each table are
+  // contiguous and in key order. It acquires X locks on all tables. Tables
+  // should not be created or dropped meanwhile.
+  void Vacuum(txn_id_t txn_id);
+
   TxnManager& GetTxnManager();
 
   // Used for generating referred table name. These tables are used for storing
@@ -2,20 +2,39 @@
 #define SAKURA_ALLOCATOR_H__
 
 #include <memory>
+#include <utility>
 #include <vector>
 
+#include "common/memory_budget.hpp"
+
 namespace wing {
 
 // An allocator providing invariant memory address.
 // Used in TupleVector. You can modify it to store on the disk.
+// The blocks are charged to MemoryBudget::Global().
 template <const size_t BlockSize>
 class BlockAllocator {
  public:
+  BlockAllocator() = default;
+  BlockAllocator(BlockAllocator&& allocator) noexcept
+    : ptrs_(std::move(allocator.ptrs_)),
+      offset_(std::exchange(allocator.offset_, BlockSize + 1)),
+      charged_(std::exchange(allocator.charged_, 0)) {}
+  BlockAllocator& operator=(BlockAllocator&& allocator) noexcept {
+    Clear();
+    ptrs_ = std::move(allocator.ptrs_);
+    offset_ = std::exchange(allocator.offset_, BlockSize + 1);
+    charged_ = std::exchange(allocator.charged_, 0);
+    return *this;
+  }
+  ~BlockAllocator() { Clear(); }
   uint8_t* Allocate(size_t size) {
     if (offset_ + size > BlockSize) {
-      ptrs_.push_back(
-          std::unique_ptr<uint8_t[]>(new uint8_t[std::max(size, BlockSize)]));
+      size_t block_size = std::max(size, BlockSize);
+      ptrs_.push_back(std::unique_ptr<uint8_t[]>(new uint8_t[block_size]));
       offset_ = 0;
+      charged_ += block_size;
+      MemoryBudget::Global().Charge(block_size);
     }
     auto ret = ptrs_.back().get() + offset_;
     offset_ += size;
@@ -24,11 +43,14 @@ class BlockAllocator {
   void Clear() {
     ptrs_.clear();
     offset_ = BlockSize + 1;
+    MemoryBudget::Global().Uncharge(charged_);
+    charged_ = 0;
   }
 
  private:
   std::vector<std::unique_ptr<uint8_t[]>> ptrs_;
   size_t offset_{BlockSize + 1};
+  size_t charged_{0};
 };
 
 }  // namespace wing
@@ -0,0 +1,65 @@
+#include "common/memory_budget.hpp"
+
+#include <algorithm>
+#include <cstdint>
+
+namespace wing {
+
+MemoryBudget& MemoryBudget::Global() {
+  static MemoryBudget budget;
+  return budget;
+}
+
+void MemoryBudget::SetLimit(size_t limit) {
+  std::lock_guard l(latch_);
+  limit_.store(limit, std::memory_order_relaxed);
+  __Rebalance();
+}
+
+size_t MemoryBudget::AddBufferPool(size_t wanted, ResizeFunc&& resize) {
+  std::lock_guard l(latch_);
+  size_t id = next_id_++;
+  pools_.emplace(id, BufferPool{wanted, 0, std::move(resize)});
+  __Rebalance();
+  return id;
+}
+
+void MemoryBudget::SetBufferPoolWanted(size_t id, size_t wanted) {
+  std::lock_guard l(latch_);
+  pools_.at(id).wanted = wanted;
+  __Rebalance();
+}
+
+void MemoryBudget::RemoveBufferPool(size_t id) {
+  std::lock_guard l(latch_);
+  pools_.erase(id);
+  // Give the memory to the others.
+  __Rebalance();
+}
+
+void MemoryBudget::Rebalance() {
+  std::lock_guard l(latch_);
+  // Others may have rebalanced while we are waiting for the latch.
+  if (NeedRebalance(GetCharged()))
+    __Rebalance();
+}
+
+void MemoryBudget::__Rebalance() {
+  size_t charged = GetCharged();
+  charged_at_rebalance_.store(charged, std::memory_order_relaxed);
+  if (pools_.empty())
+    return;
+  size_t limit = GetLimit();
+  size_t share = SIZE_MAX;
+  if (limit != 0)
+    share = (limit > charged ? limit - charged : 0) / pools_.size();
+  for (auto& [id, pool] : pools_) {
+    size_t size = std::min(pool.wanted, std::max(share, MIN_BUFFER_POOL_SIZE));
+    if (size != pool.size) {
+      pool.size = size;
+      pool.resize(size);
+    }
+  }
+}
+
+}  // namespace wing
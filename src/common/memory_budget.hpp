@@ -0,0 +1,86 @@
+#ifndef SAKURA_MEMORY_BUDGET_H__
+#define SAKURA_MEMORY_BUDGET_H__
+
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <map>
+#include <mutex>
+
+namespace wing {
+
+// A memory budget shared by the whole process.
+// Executors charge the memory of their intermediate results (see
+// BlockAllocator), and the buffer pools get what is left, but no more than
+// what they want. The buffer pools are resized when the charged memory
+// changes by more than 1/64 of the limit, so charging is cheap.
+// Usage:
+// MemoryBudget::Global().SetLimit(4ul << 30);
+// auto id = MemoryBudget::Global().AddBufferPool(1ul << 30,
+//     [&](size_t size) { /* resize the buffer pool to size bytes */ });
+// ...
+// MemoryBudget::Global().RemoveBufferPool(id);
+class MemoryBudget {
+ public:
+  using ResizeFunc = std::function<void(size_t)>;
+  // A buffer pool is not shrunk below this size, or below what it wants if it
+  // wants less.
+  static constexpr size_t MIN_BUFFER_POOL_SIZE = 16 << 20;
+
+  static MemoryBudget& Global();
+
+  // 0 means unlimited, which is the default.
+  void SetLimit(size_t limit);
+  size_t GetLimit() const { return limit_.load(std::memory_order_relaxed); }
+
+  void Charge(size_t size) {
+    size_t charged = charged_.fetch_add(size, std::memory_order_relaxed) + size;
+    if (NeedRebalance(charged))
+      Rebalance();
+  }
+  void Uncharge(size_t size) {
+    size_t charged = charged_.fetch_sub(size, std::memory_order_relaxed) - size;
+    if (NeedRebalance(charged))
+      Rebalance();
+  }
+  size_t GetCharged() const {
+    return charged_.load(std::memory_order_relaxed);
+  }
+
+  // "resize" is called with the new size of the buffer pool in bytes, and it
+  // is called at once with the initial size.
+  size_t AddBufferPool(size_t wanted, ResizeFunc&& resize);
+  void SetBufferPoolWanted(size_t id, size_t wanted);
+  // After it returns, "resize" of the buffer pool is not called anymore.
+  void RemoveBufferPool(size_t id);
+
+ private:
+  struct BufferPool {
+    size_t wanted;
+    // The size given to it last time.
+    size_t size;
+    ResizeFunc resize;
+  };
+  bool NeedRebalance(size_t charged) const {
+    size_t limit = GetLimit();
+    if (limit == 0)
+      return false;
+    size_t last = charged_at_rebalance_.load(std::memory_order_relaxed);
+    size_t diff = charged > last ? charged - last : last - charged;
+    return diff > limit / 64;
+  }
+  void Rebalance();
+  // The caller should hold latch_.
+  void __Rebalance();
+
+  std::atomic<size_t> limit_{0};
+  std::atomic<size_t> charged_{0};
+  std::atomic<size_t> charged_at_rebalance_{0};
+  std::mutex latch_;
+  std::map<size_t, BufferPool> pools_;
+  size_t next_id_{0};
+};
+
+}  // namespace wing
+
+#endif
@@ -33,11 +33,29 @@ class AggregateExecutor : public Executor {
             output_functions_.clear();
             for (auto &hh:output_exprs_) output_functions_.push_back(AggregateExprFunction(hh.get(),input_schema));
             n=output_functions_.size();
+            count_only_=IsCountOnly(expr!=nullptr,group_by_exprs_,output_exprs_);
 		}
+  // Only COUNTs of all tuples, so the tuples are skipped instead of read.
+  static bool IsCountOnly(bool has_predicate,
+    const std::vector<std::unique_ptr<Expr> > &group_by_exprs_,
+    const std::vector<std::unique_ptr<Expr> > &output_exprs_) {
+    if (has_predicate||!group_by_exprs_.empty()||output_exprs_.empty()) return false;
+    for (auto &hh:output_exprs_)
+        if (hh->type_!=ExprType::AGGR||static_cast<const AggregateFunctionExpr*>(hh.get())->func_name_!="count") return false;
+    return true;
+  }
   void Init() override { 
   	ch_->Init();
     v1.clear();v2.clear();v3.clear();
     mp.clear();tot=0;
+    if (count_only_)
+    {
+        // No tuple is returned for no input, as below.
+        count_=ch_->Skip(SIZE_MAX);tot=count_>0;
+        mergeTuple.resize(output_schema_.Size());
+        it=0;
+        return;
+    }
 	for (auto ch_ret=ch_->Next();ch_ret;ch_ret=ch_->Next())
     {
         size_t res=233;
@@ -81,6 +99,13 @@ class AggregateExecutor : public Executor {
 	it=0;
   }
   InputTuplePtr Next() override {
+    if (count_only_)
+    {
+        if (it>=tot) return {};
+        it++;
+        for (int i=0;i<n;i++) mergeTuple[i]=StaticFieldRef::CreateInt(count_);
+        return InputTuplePtr((const uint8_t *)mergeTuple.data());
+    }
     int id;
     while (true)
     {
@@ -106,6 +131,8 @@ class AggregateExecutor : public Executor {
   std::vector<std::vector<std::vector<AggregateIntermediateData> > > v2;
   std::vector<TupleStore> v3;
   int n,m,it,tot;
+  bool count_only_;
+  size_t count_;
 };
 
 }  // namespace wing
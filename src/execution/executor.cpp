@@ -7,6 +7,7 @@
 #include "execution/print_executor.hpp"
 #include "execution/project_executor.hpp"
 #include "execution/seqscan_executor.hpp"
+#include "execution/parallel_seqscan_executor.hpp"
 #include "execution/join_executor.hpp"
 #include "execution/hashjoin_executor.hpp"
 #include "execution/aggregate_executor.hpp"
@@ -18,7 +19,7 @@
 namespace wing {
 
 std::unique_ptr<Executor> ExecutorGenerator::Generate(
-    const PlanNode* plan, DB& db, txn_id_t txn_id) {
+    const PlanNode* plan, DB& db, txn_id_t txn_id, size_t scan_threads) {
   if (plan == nullptr) {
     throw DBException("Invalid PlanNode.");
   }
@@ -27,14 +28,14 @@ std::unique_ptr<Executor> ExecutorGenerator::Generate(
     auto project_plan = static_cast<const ProjectPlanNode*>(plan);
     return std::make_unique<ProjectExecutor>(project_plan->output_exprs_,
         project_plan->ch_->output_schema_,
-        Generate(project_plan->ch_.get(), db, txn_id));
+        Generate(project_plan->ch_.get(), db, txn_id, scan_threads));
   }
 
   else if (plan->type_ == PlanType::Filter) {
     auto filter_plan = static_cast<const FilterPlanNode*>(plan);
     return std::make_unique<FilterExecutor>(filter_plan->predicate_.GenExpr(),
         filter_plan->ch_->output_schema_,
-        Generate(filter_plan->ch_.get(), db, txn_id));
+        Generate(filter_plan->ch_.get(), db, txn_id, scan_threads));
   }
 
   else if (plan->type_ == PlanType::Print) {
@@ -55,7 +56,7 @@ std::unique_ptr<Executor> ExecutorGenerator::Generate(
                       : nullptr;
     return std::make_unique<InsertExecutor>(
         db.GetModifyHandle(txn_id, tab.GetName()),
-        Generate(insert_plan->ch_.get(), db, txn_id),
+        Generate(insert_plan->ch_.get(), db, txn_id, 1),
         FKChecker(tab.GetFK(), tab, txn_id, db), gen_pk, tab);
   }
 
@@ -66,6 +67,12 @@ std::unique_ptr<Executor> ExecutorGenerator::Generate(
       throw DBException("Cannot find table \'{}\'", seqscan_plan->table_name_);
     }
     auto& tab = db.GetDBSchema()[table_schema_index.value()];
+    if (scan_threads > 1) {
+      return GenerateParallelScan(
+          db.GetRangeIterators(txn_id, tab.GetName(), {"", true, false},
+              {"", true, false}, scan_threads),
+          seqscan_plan->predicate_.GenExpr(), seqscan_plan->output_schema_);
+    }
     return std::make_unique<SeqScanExecutor>(
         db.GetIterator(txn_id, tab.GetName()),
         seqscan_plan->predicate_.GenExpr(), seqscan_plan->output_schema_);
@@ -80,7 +87,7 @@ std::unique_ptr<Executor> ExecutorGenerator::Generate(
     auto& tab = db.GetDBSchema()[table_schema_index.value()];
     return std::make_unique<DeleteExecutor>(
         db.GetModifyHandle(txn_id, tab.GetName()),
-        Generate(delete_plan->ch_.get(), db, txn_id),
+        Generate(delete_plan->ch_.get(), db, txn_id, 1),
         FKChecker(tab.GetFK(), tab, txn_id, db),
         PKChecker(tab.GetName(), tab.GetHidePKFlag(), txn_id, db), tab);
   }
@@ -92,8 +99,8 @@ std::unique_ptr<Executor> ExecutorGenerator::Generate(
       join_plan->ch_->output_schema_,
       join_plan->ch2_->output_schema_,
       join_plan->output_schema_,
-      Generate(join_plan->ch_.get(), db, txn_id),
-      Generate(join_plan->ch2_.get(), db, txn_id)
+      Generate(join_plan->ch_.get(), db, txn_id, scan_threads),
+      Generate(join_plan->ch2_.get(), db, txn_id, scan_threads)
     );
   }
 
@@ -106,20 +113,27 @@ std::unique_ptr<Executor> ExecutorGenerator::Generate(
       hashjoin_plan->output_schema_,
       hashjoin_plan->left_hash_exprs_,
       hashjoin_plan->right_hash_exprs_,
-      Generate(hashjoin_plan->ch_.get(), db, txn_id),
-      Generate(hashjoin_plan->ch2_.get(), db, txn_id)
+      Generate(hashjoin_plan->ch_.get(), db, txn_id, scan_threads),
+      Generate(hashjoin_plan->ch2_.get(), db, txn_id, scan_threads)
     );
   }
 
   else if (plan->type_ == PlanType::Aggregate) {
     auto aggregate_plan = static_cast<const AggregatePlanNode*>(plan);
+    // Counting the tuples of a plain scan does not read them, which beats
+    // scanning in parallel. See AggregateExecutor.
+    if (AggregateExecutor::IsCountOnly(
+            !aggregate_plan->group_predicate_.GetVec().empty(),
+            aggregate_plan->group_by_exprs_, aggregate_plan->output_exprs_) &&
+        IsPlainScan(aggregate_plan->ch_.get(), db))
+      scan_threads = 1;
     return std::make_unique<AggregateExecutor>(
       aggregate_plan->group_predicate_.GenExpr(),
       aggregate_plan->ch_->output_schema_,
       aggregate_plan->output_schema_,
       aggregate_plan->group_by_exprs_,
       aggregate_plan->output_exprs_,
-      Generate(aggregate_plan->ch_.get(), db, txn_id)
+      Generate(aggregate_plan->ch_.get(), db, txn_id, scan_threads)
     );
   }
 
@@ -130,16 +144,19 @@ std::unique_ptr<Executor> ExecutorGenerator::Generate(
       order_plan->output_schema_,
       order_plan->order_by_exprs_,
       order_plan->order_by_offset_,
-      Generate(order_plan->ch_.get(), db, txn_id)
+      Generate(order_plan->ch_.get(), db, txn_id, scan_threads)
     );
   }
 
   else if (plan->type_ == PlanType::Limit) {
     auto limit_plan = static_cast<const LimitPlanNode*>(plan);
+    // The offset of a plain scan is skipped without reading the tuples.
+    if (limit_plan->offset_ > 0 && IsPlainScan(limit_plan->ch_.get(), db))
+      scan_threads = 1;
     return std::make_unique<LimitExecutor>(
       limit_plan->limit_size_,
       limit_plan->offset_,
-      Generate(limit_plan->ch_.get(), db, txn_id)
+      Generate(limit_plan->ch_.get(), db, txn_id, scan_threads)
     );
   }
 
@@ -147,15 +164,31 @@ std::unique_ptr<Executor> ExecutorGenerator::Generate(
     auto distinct_plan = static_cast<const DistinctPlanNode*>(plan);
     return std::make_unique<DistinctExecutor>(
       distinct_plan->output_schema_,
-      Generate(distinct_plan->ch_.get(), db, txn_id)
+      Generate(distinct_plan->ch_.get(), db, txn_id, scan_threads)
     );
   }
 
   else if (plan->type_ == PlanType::RangeScan) {
     auto rangescan_plan = static_cast<const RangeScanPlanNode*>(plan);
+    std::tuple<std::string_view, bool, bool> L(
+        rangescan_plan->range_l_.first.GetView(),
+        rangescan_plan->range_l_.first.type_ == FieldType::EMPTY,
+        rangescan_plan->range_l_.second);
+    std::tuple<std::string_view, bool, bool> R(
+        rangescan_plan->range_r_.first.GetView(),
+        rangescan_plan->range_r_.first.type_ == FieldType::EMPTY,
+        rangescan_plan->range_r_.second);
+    // The keys in the range need not be checked again.
+    auto predicate = ResidualPredicate(rangescan_plan, db);
+    if (scan_threads > 1 && !rangescan_plan->reverse_) {
+      return GenerateParallelScan(
+          db.GetRangeIterators(
+              txn_id, rangescan_plan->table_name_, L, R, scan_threads),
+          predicate.GenExpr(), rangescan_plan->output_schema_);
+    }
     return std::make_unique<SeqScanExecutor>(
-      db.GetRangeIterator(txn_id,rangescan_plan->table_name_,std::tuple<std::string_view,bool,bool>(rangescan_plan->range_l_.first.GetView(),rangescan_plan->range_l_.first.type_==FieldType::EMPTY,rangescan_plan->range_l_.second),std::tuple<std::string_view,bool,bool>(rangescan_plan->range_r_.first.GetView(),rangescan_plan->range_r_.first.type_==FieldType::EMPTY,rangescan_plan->range_r_.second)),
-      rangescan_plan->predicate_.GenExpr(),
+      db.GetRangeIterator(txn_id,rangescan_plan->table_name_,L,R,rangescan_plan->reverse_),
+      predicate.GenExpr(),
       rangescan_plan->output_schema_
     );
   }
@@ -163,4 +196,105 @@ std::unique_ptr<Executor> ExecutorGenerator::Generate(
   throw DBException("Unsupported plan node.");
 }
 
+std::unique_ptr<Executor> ExecutorGenerator::GenerateParallelScan(
+    std::vector<std::unique_ptr<Iterator<const uint8_t*>>> iters,
+    const std::unique_ptr<Expr>& predicate, const OutputSchema& input_schema) {
+  // The table is too small to be split.
+  if (iters.size() == 1) {
+    return std::make_unique<SeqScanExecutor>(
+        std::move(iters[0]), predicate, input_schema);
+  }
+  return std::make_unique<ParallelSeqScanExecutor>(
+      std::move(iters), predicate, input_schema);
+}
+
+bool ExecutorGenerator::IsPlainScan(const PlanNode* plan, DB& db) {
+  while (plan->type_ == PlanType::Project)
+    plan = static_cast<const ProjectPlanNode*>(plan)->ch_.get();
+  if (plan->type_ == PlanType::SeqScan)
+    return static_cast<const SeqScanPlanNode*>(plan)
+        ->predicate_.GetVec()
+        .empty();
+  if (plan->type_ == PlanType::RangeScan)
+    return ResidualPredicate(static_cast<const RangeScanPlanNode*>(plan), db)
+        .GetVec()
+        .empty();
+  return false;
+}
+
+/**
+ * Whether every key in the range ["L", "R"] satisfies "element", which
+ * compares the primary key "pk_name" with a literal, e.g., A.a < 10 with the
+ * range [1, 5]. The literal should have the same type as the ends of the range.
+ * See ConvertToRangeScanRule.
+ */
+static bool ImpliedByRange(const PredicateElement& element,
+    std::string_view pk_name, const std::pair<Field, bool>& L,
+    const std::pair<Field, bool>& R) {
+  const Expr* column = element.expr_->ch0_.get();
+  const Expr* literal = element.expr_->ch1_.get();
+  OpType op = element.expr_->op_;
+  if (literal->type_ == ExprType::COLUMN) {
+    // Literal op A.a, i.e., A.a op' Literal.
+    std::swap(column, literal);
+    op = op == OpType::LT    ? OpType::GT
+         : op == OpType::GT  ? OpType::LT
+         : op == OpType::LEQ ? OpType::GEQ
+         : op == OpType::GEQ ? OpType::LEQ
+                             : op;
+  }
+  if (column->type_ != ExprType::COLUMN ||
+      static_cast<const ColumnExpr*>(column)->column_name_ != pk_name)
+    return false;
+  Field value;
+  if (literal->type_ == ExprType::LITERAL_INTEGER) {
+    value = Field::CreateInt(FieldType::INT64, 8,
+        static_cast<const LiteralIntegerExpr*>(literal)->literal_value_);
+  } else if (literal->type_ == ExprType::LITERAL_FLOAT) {
+    value = Field::CreateFloat(FieldType::FLOAT64, 8,
+        static_cast<const LiteralFloatExpr*>(literal)->literal_value_);
+  } else if (literal->type_ == ExprType::LITERAL_STRING) {
+    value = Field::CreateString(FieldType::VARCHAR,
+        static_cast<const LiteralStringExpr*>(literal)->literal_value_);
+  } else {
+    return false;
+  }
+  // The keys are all > (or >= if "closed") "end".
+  auto above = [&](const std::pair<Field, bool>& end, bool closed) {
+    if (end.first.type_ != value.type_)
+      return false;
+    auto cmp = end.first <=> value;
+    return cmp > 0 || (cmp == 0 && (closed || !end.second));
+  };
+  // The keys are all < (or <= if "closed") "end".
+  auto below = [&](const std::pair<Field, bool>& end, bool closed) {
+    if (end.first.type_ != value.type_)
+      return false;
+    auto cmp = end.first <=> value;
+    return cmp < 0 || (cmp == 0 && (closed || !end.second));
+  };
+  switch (op) {
+    case OpType::GT: return above(L, false);
+    case OpType::GEQ: return above(L, true);
+    case OpType::LT: return below(R, false);
+    case OpType::LEQ: return below(R, true);
+    case OpType::EQ: return above(L, true) && below(R, true);
+    default: return false;
+  }
+}
+
+PredicateVec ExecutorGenerator::ResidualPredicate(
+    const RangeScanPlanNode* plan, DB& db) {
+  auto ret = plan->predicate_.clone();
+  auto index = db.GetDBSchema().Find(plan->table_name_);
+  if (!index)
+    return ret;
+  std::string pk_name =
+      db.GetDBSchema()[index.value()].GetPrimaryKeySchema().name_;
+  std::erase_if(ret.GetVec(), [&](const PredicateElement& element) {
+    return ImpliedByRange(element, pk_name, plan->range_l_, plan->range_r_);
+  });
+  return ret;
+}
+
 }  // namespace wing
\ No newline at end of file
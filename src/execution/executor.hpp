@@ -29,14 +29,36 @@ class Executor {
   virtual ~Executor() = default;
   virtual void Init() = 0;
   virtual InputTuplePtr Next() = 0;
+  // Skip the next n tuples, as if Next() were invoked n times. Return the
+  // number of tuples skipped, which is less than n only if it has completed.
+  // See Iterator::Skip.
+  virtual size_t Skip(size_t n) {
+    size_t i = 0;
+    while (i < n && Next())
+      i++;
+    return i;
+  }
 };
 
 class ExecutorGenerator {
  public:
-  static std::unique_ptr<Executor> Generate(
-      const PlanNode* plan, DB& db, txn_id_t txn_id);
+  // Large scans are split into up to "scan_threads" key ranges, each scanned
+  // by its own thread. The scans under INSERT and DELETE are not split, since
+  // the table may be written while being scanned.
+  static std::unique_ptr<Executor> Generate(const PlanNode* plan, DB& db,
+      txn_id_t txn_id, size_t scan_threads = 1);
 
  private:
+  // Scan "iters" in parallel, or sequentially if there is only one.
+  static std::unique_ptr<Executor> GenerateParallelScan(
+      std::vector<std::unique_ptr<Iterator<const uint8_t*>>> iters,
+      const std::unique_ptr<Expr>& predicate, const OutputSchema& input_schema);
+  // Whether "plan" returns all tuples in a key range of a table, possibly
+  // projected, so that they can be counted and skipped without reading them.
+  static bool IsPlainScan(const PlanNode* plan, DB& db);
+  // The predicates of a RangeScan which are not implied by its key range.
+  static PredicateVec ResidualPredicate(
+      const RangeScanPlanNode* plan, DB& db);
 };
 
 }  // namespace wing
@@ -67,13 +67,18 @@ class InsertExecutor : public Executor {
     }
     // Release the iterator
     ch_ = nullptr;
-    // Insert the tuples
+    // Insert the tuples in a batch. Many tuples into an empty table, e.g., the
+    // initial load or CREATE TABLE AS SELECT, are bulk loaded.
+    std::vector<std::pair<std::string_view, std::string_view>> kvs;
+    kvs.reserve(insert_rows_.size());
     for (auto& row : insert_rows_) {
-      auto key_view =
-          Tuple::GetFieldView(row.data(), pk_offset_, pk_type_, pk_size_);
-      if (!handle_->Insert(key_view, row)) {
-        throw DBException("Insert error: duplicate key!");
-      }
+      kvs.emplace_back(
+          Tuple::GetFieldView(row.data(), pk_offset_, pk_type_, pk_size_), row);
+    }
+    bool loaded =
+        kvs.size() >= BULK_LOAD_MIN_ROWS && handle_->BulkLoad(kvs);
+    if (!loaded && !handle_->InsertBatch(kvs)) {
+      throw DBException("Insert error: duplicate key!");
     }
     insert_row_counts_.data_.int_data = insert_rows_.size();
     return reinterpret_cast<const uint8_t*>(&insert_row_counts_);
@@ -100,6 +105,10 @@ class InsertExecutor : public Executor {
     }
     return {reinterpret_cast<char*>(data_ptr), size};
   }
+  // Bulk loading locks the whole table, which is not worth it for a few
+  // tuples.
+  static constexpr size_t BULK_LOAD_MIN_ROWS = 64;
+
   std::unique_ptr<ModifyHandle> handle_;
   std::unique_ptr<Executor> ch_;
   GenPKHandle gen_pk_;
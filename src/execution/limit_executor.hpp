@@ -18,7 +18,12 @@ class LimitExecutor : public Executor {
     limit_size_(limit_size),offset_(offset),ch_(std::move(ch)) {}
   void Init() override { ch_->Init();it=0; }
   InputTuplePtr Next() override {
-    while (it<offset_) ch_->Next(),it++;
+    if (it<offset_)
+    {
+      // The child has fewer than offset_ tuples.
+      if (ch_->Skip(offset_-it)<offset_-it) { it=offset_+limit_size_;return {}; }
+      it=offset_;
+    }
     if (it>=offset_+limit_size_) return {};
     it++;
     return ch_->Next();
@@ -0,0 +1,169 @@
+#ifndef SAKURA_PARALLEL_SEQSCAN_EXECUTOR_H__
+#define SAKURA_PARALLEL_SEQSCAN_EXECUTOR_H__
+
+#include <atomic>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+#include "execution/executor.hpp"
+#include "storage/buffer-pool-stats.hpp"
+#include "type/tuple.hpp"
+
+namespace wing {
+
+/**
+ * Scan a table split into key ranges (see DB::GetRangeIterators). Each range
+ * is scanned and filtered by its own thread, and the tuples are returned in
+ * the order of the ranges, so the output is the same as SeqScanExecutor.
+ *
+ * A thread copies the tuples passing the predicate into chunks, and at most
+ * MAX_CHUNKS chunks of each range are buffered, so threads scanning the later
+ * ranges wait if the consumer is slow.
+ */
+class ParallelSeqScanExecutor : public Executor {
+ public:
+  ParallelSeqScanExecutor(std::vector<std::unique_ptr<Iterator<const uint8_t*>>> iters,
+      const std::unique_ptr<Expr>& predicate, const OutputSchema& input_schema)
+    : iters_(std::move(iters)), parts_(iters_.size()) {
+    // The predicate is not shared between threads.
+    for (size_t i = 0; i < iters_.size(); i++)
+      predicates_.emplace_back(predicate.get(), input_schema);
+    for (auto& a : input_schema.GetCols()) {
+      if (a.type_ != FieldType::CHAR && a.type_ != FieldType::VARCHAR) {
+        static_field_size_ += a.size_;
+      } else {
+        has_str_field_ = true;
+      }
+    }
+  }
+  ~ParallelSeqScanExecutor() { Stop(); }
+  void Init() override {
+    Stop();
+    for (auto& part : parts_) {
+      part.chunks.clear();
+      part.done = false;
+    }
+    cur_part_ = 0;
+    cur_.data.clear();
+    cur_.offsets.clear();
+    pos_ = 0;
+    query_stats_ = BufferPoolStatsScope::Query();
+    for (size_t i = 0; i < iters_.size(); i++) {
+      iters_[i]->Init();
+      threads_.emplace_back([this, i]() { Scan(i); });
+    }
+  }
+  InputTuplePtr Next() override {
+    while (pos_ == cur_.offsets.size()) {
+      if (!Fetch())
+        return {};
+    }
+    return cur_.data.data() + cur_.offsets[pos_++];
+  }
+
+ private:
+  static constexpr size_t CHUNK_SIZE = 1 << 16;
+  static constexpr size_t MAX_CHUNKS = 4;
+  struct Chunk {
+    std::vector<uint8_t> data;
+    std::vector<uint32_t> offsets;
+  };
+  struct Part {
+    std::deque<Chunk> chunks;
+    bool done{false};
+  };
+  // The size of a raw tuple. See Tuple.
+  uint32_t TupleSize(const uint8_t* tuple) const {
+    return has_str_field_ ? Tuple::GetTupleSize(tuple, static_field_size_)
+                          : static_field_size_;
+  }
+  void Scan(size_t i) {
+    // Counted in the query, as if scanned by the thread calling Init.
+    BufferPoolStatsScope scope(BufferPoolStatsScope::QUERY, query_stats_);
+    Chunk chunk;
+    for (auto tuple = iters_[i]->Next(); tuple; tuple = iters_[i]->Next()) {
+      if (stop_.load(std::memory_order_relaxed))
+        return;
+      if (predicates_[i] && predicates_[i].Evaluate(tuple).ReadInt() == 0)
+        continue;
+      // Keep the tuples aligned as in the pages.
+      size_t offset = (chunk.data.size() + 7) & ~size_t(7);
+      chunk.data.resize(offset + TupleSize(tuple));
+      std::memcpy(chunk.data.data() + offset, tuple, chunk.data.size() - offset);
+      chunk.offsets.push_back(offset);
+      if (chunk.data.size() >= CHUNK_SIZE) {
+        if (!Push(i, std::move(chunk)))
+          return;
+        chunk = Chunk();
+      }
+    }
+    if (!chunk.offsets.empty() && !Push(i, std::move(chunk)))
+      return;
+    std::lock_guard lock(mu_);
+    parts_[i].done = true;
+    cv_.notify_all();
+  }
+  // Return false if the executor is stopping.
+  bool Push(size_t i, Chunk&& chunk) {
+    std::unique_lock lock(mu_);
+    cv_.wait(lock, [&]() { return stop_ || parts_[i].chunks.size() < MAX_CHUNKS; });
+    if (stop_)
+      return false;
+    parts_[i].chunks.push_back(std::move(chunk));
+    cv_.notify_all();
+    return true;
+  }
+  // Move to the next chunk. Return false if there is none.
+  bool Fetch() {
+    std::unique_lock lock(mu_);
+    while (cur_part_ < parts_.size()) {
+      auto& part = parts_[cur_part_];
+      cv_.wait(lock, [&]() { return part.done || !part.chunks.empty(); });
+      if (!part.chunks.empty()) {
+        cur_ = std::move(part.chunks.front());
+        part.chunks.pop_front();
+        pos_ = 0;
+        cv_.notify_all();
+        return true;
+      }
+      cur_part_ += 1;
+    }
+    return false;
+  }
+  void Stop() {
+    {
+      std::lock_guard lock(mu_);
+      stop_ = true;
+      cv_.notify_all();
+    }
+    for (auto& thread : threads_)
+      thread.join();
+    threads_.clear();
+    stop_ = false;
+  }
+
+  std::vector<std::unique_ptr<Iterator<const uint8_t*>>> iters_;
+  std::vector<ExprFunction> predicates_;
+  uint32_t static_field_size_{0};
+  bool has_str_field_{false};
+  BufferPoolStats *query_stats_{nullptr};
+
+  std::mutex mu_;
+  std::condition_variable cv_;
+  std::atomic<bool> stop_{false};
+  std::vector<Part> parts_;
+  std::vector<std::thread> threads_;
+
+  // The range being returned, its chunk being returned, and the position in
+  // the chunk.
+  size_t cur_part_{0};
+  Chunk cur_;
+  size_t pos_{0};
+};
+
+}  // namespace wing
+
+#endif
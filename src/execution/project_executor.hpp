@@ -34,6 +34,8 @@ class ProjectExecutor : public Executor {
       return {};
     }
   }
+  // Projecting does not change the number of tuples.
+  size_t Skip(size_t n) override { return ch_->Skip(n); }
 
  private:
   std::vector<ExprFunction> data_;
@@ -23,6 +23,11 @@ class SeqScanExecutor : public Executor {
       return {};
     }
   }
+  size_t Skip(size_t n) override {
+    if (predicate_)
+      return Executor::Skip(n);
+    return iter_->Skip(n);
+  }
 
  private:
   std::unique_ptr<Iterator<const uint8_t*>> iter_;
@@ -3,6 +3,7 @@
 #include <cctype>
 #include <iostream>
 #include <memory>
+#include <thread>
 
 #include "catalog/db.hpp"
 #include "common/cmdline.hpp"
@@ -21,14 +22,16 @@ namespace wing {
 
 class Instance::Impl {
  public:
-  Impl(std::string_view db_file, bool use_jit_flag)
-    : use_jit_flag_(use_jit_flag), db_(db_file) {}
+  Impl(std::string_view db_file, bool use_jit_flag, size_t buffer_pool_size)
+    : use_jit_flag_(use_jit_flag), db_(db_file, buffer_pool_size) {}
   void ExecuteShell() {
     auto& out = std::cout;
     auto& err = std::cerr;
     SQLCmdLine cmd;
     cmd.SetCommand("exit", [](std::string_view) -> bool { return false; });
     cmd.SetCommand("quit", [](std::string_view) -> bool { return false; });
+    // Buffer pool accesses of the last SQL statement.
+    BufferPoolCounters last_stats;
     cmd.SetCommand("explain", [&](std::string_view statement) -> bool {
       StopWatch watch;
       auto ret = parser_.Parse(statement, db_.GetDBSchema());
@@ -54,11 +57,22 @@ class Instance::Impl {
 
     // show table: show all tables.
     // show index: show all indexes. (But we don't have indexes now, haha.)
+    // show bufferpool: show the buffer pool counters of the database, of each
+    // table and of the last SQL statement.
     cmd.SetCommand("show", [&](std::string_view command) -> bool {
       uint32_t c = 0;
       while (c < command.size() && isspace(command[c]))
         c++;
-      if (command.substr(c, 5) == "table") {
+      if (command.substr(c, 10) == "bufferpool") {
+        auto report = db_.GetBufferPoolReport();
+        out << fmt::format("Capacity: {} pages\n", report.capacity_pages);
+        out << fmt::format("Total: {}\n", report.total.ToString());
+        for (auto& [name, stats] : report.tables) {
+          out << fmt::format("Table {}: {}\n", name, stats.ToString());
+        }
+        out << fmt::format("Last statement: {}", last_stats.ToString())
+            << std::endl;
+      } else if (command.substr(c, 5) == "table") {
         for (auto& tab : db_.GetDBSchema().GetTables()) {
           out << tab.ToString() << std::endl;
         }
@@ -108,6 +122,25 @@ class Instance::Impl {
       return true;
     });
 
+    // vacuum: Compact the database file.
+    cmd.SetCommand("vacuum", [&](std::string_view) -> bool {
+      StopWatch watch;
+      Txn* txn = GetTxnManager().Begin();
+      try {
+        Vacuum(txn->txn_id_);
+        GetTxnManager().Commit(txn);
+      } catch (const DBException& e) {
+        err << fmt::format("DBException occurs. what(): {}\n", e.what())
+            << "\n";
+        GetTxnManager().Abort(txn);
+        return true;
+      }
+      out << fmt::format(
+          "Vacuum completed in {} seconds.", watch.GetTimeInSeconds())
+          << std::endl;
+      return true;
+    });
+
     // stats <table> Print the statistics of the table.
     cmd.SetCommand("stats", [&](std::string_view command) -> bool {
       uint32_t c = 0, cend = 0;
@@ -160,9 +193,11 @@ class Instance::Impl {
       if (!ret.Valid()) {
         err << ret.GetErrorMsg() << std::endl;
       } else {
+        BufferPoolStats stats;
+        BufferPoolStatsScope scope(BufferPoolStatsScope::QUERY, &stats);
         Txn* txn = GetTxnManager().Begin();
         try {
-          if (ret.GetPlan() == nullptr) {
+          if (IsMetadataOperation(ret)) {
             ExecuteMetadataOperation(ret, txn->txn_id_);
             if (ret.GetAST()->type_ == StatementType::CREATE_TABLE) {
               out << "Create table successfully.\n";
@@ -182,6 +217,7 @@ class Instance::Impl {
             auto result = GetResultFromExecutor(exe, use_jit, output_schema);
             err << fmt::format(
                 "Execute in {} seconds.\n", watch.GetTimeInSeconds());
+            err << fmt::format("Buffer pool: {}\n", stats.Load().ToString());
             out << FormatOutputTable(result, output_schema) << std::endl;
           }
           GetTxnManager().Commit(txn);
@@ -190,6 +226,7 @@ class Instance::Impl {
               << "\n";
           GetTxnManager().Abort(txn);
         }
+        last_stats = stats.Load();
         // CAUTION: TxnDLAbortException and MultiUpgradeException are not
         // catched. In future, we should provide "Connection" abstraction to
         // each instance, so CLI can also run concurrently.
@@ -203,13 +240,21 @@ class Instance::Impl {
   }
 
   ResultSet Execute(std::string_view statement, txn_id_t txn_id) {
+    BufferPoolStats stats;
+    BufferPoolStatsScope scope(BufferPoolStatsScope::QUERY, &stats);
+    auto ret = ExecuteStatement(statement, txn_id);
+    ret.SetBufferPoolStats(stats.Load());
+    return ret;
+  }
+
+  ResultSet ExecuteStatement(std::string_view statement, txn_id_t txn_id) {
     auto ret = parser_.Parse(statement, db_.GetDBSchema());
     if (!ret.Valid()) {
       DB_INFO("{}", ret.GetErrorMsg());
       return ResultSet(ret.GetErrorMsg(), "");
     } else {
       try {
-        if (ret.GetPlan() == nullptr) {
+        if (IsMetadataOperation(ret)) {
           ExecuteMetadataOperation(ret, txn_id);
           return ResultSet("", "");
         } else {
@@ -253,6 +298,17 @@ class Instance::Impl {
 
   TxnManager& GetTxnManager() { return db_.GetTxnManager(); }
 
+  BufferPoolReport GetBufferPoolReport() { return db_.GetBufferPoolReport(); }
+
+  void SetBufferPoolSize(size_t buffer_pool_size) {
+    db_.SetBufferPoolSize(buffer_pool_size);
+  }
+  void SetScanThreads(size_t scan_threads) {
+    scan_threads_ = std::max<size_t>(scan_threads, 1);
+  }
+
+  void Vacuum(txn_id_t txn_id) { db_.Vacuum(txn_id); }
+
  private:
   void CreateTable(const ParserResult& result, txn_id_t txn_id) {
     auto a = static_cast<const CreateTableStatement*>(result.GetAST().get());
@@ -266,6 +322,23 @@ class Instance::Impl {
     uint32_t primary_key_index = ~0u;
     bool auto_gen_flag = false;
     bool hide_flag = false;
+    if (a->select_ != nullptr) {
+      // CREATE TABLE AS SELECT. The plan inserts the result of the subquery.
+      for (auto& col : result.GetPlan()->ch_->output_schema_.GetCols()) {
+        uint32_t size = col.size_;
+        // The size of a computed field is 0.
+        if (size == 0) {
+          if (col.type_ == FieldType::INT32)
+            size = 4;
+          else if (col.type_ == FieldType::INT64 ||
+                   col.type_ == FieldType::FLOAT64)
+            size = 8;
+          else
+            size = 256;
+        }
+        columns.push_back(ColumnSchema{col.column_name_, col.type_, size});
+      }
+    }
     for (uint32_t i = 0; auto& col : a->columns_) {
       columns.push_back(ColumnSchema{col.column_name_, col.types_, col.size_});
       if (col.is_primary_key_) {
@@ -390,6 +463,11 @@ class Instance::Impl {
     db_.DropTable(txn_id, stmt->table_name_);
   }
 
+  bool IsMetadataOperation(const ParserResult& result) {
+    return result.GetPlan() == nullptr ||
+           result.GetAST()->type_ == StatementType::CREATE_TABLE;
+  }
+
   /**
    * Execute metadata operation.
    * Metadata operation includes: create/drop table/index.
@@ -397,6 +475,13 @@ class Instance::Impl {
   void ExecuteMetadataOperation(const ParserResult& result, txn_id_t txn_id) {
     if (result.GetAST()->type_ == StatementType::CREATE_TABLE) {
       CreateTable(result, txn_id);
+      if (result.GetPlan() != nullptr) {
+        // CREATE TABLE AS SELECT. The new table is empty, so the result is
+        // bulk loaded.
+        auto exe = GenerateExecutor(result.GetPlan()->clone(), txn_id, false);
+        GetResultFromExecutor(
+            exe.first, exe.second, result.GetPlan()->output_schema_);
+      }
     } else if (result.GetAST()->type_ == StatementType::DROP_TABLE) {
       DropTable(result, txn_id);
     }
@@ -431,7 +516,7 @@ class Instance::Impl {
     if (use_jit) {
       exe = JitExecutorGenerator::Generate(plan.get(), db_, txn_id);
     } else {
-      exe = ExecutorGenerator::Generate(plan.get(), db_, txn_id);
+      exe = ExecutorGenerator::Generate(plan.get(), db_, txn_id, scan_threads_);
     }
     return {std::move(exe), use_jit};
   }
@@ -529,12 +614,14 @@ class Instance::Impl {
     return ret;
   }
   bool use_jit_flag_{false};
+  size_t scan_threads_{std::max(std::thread::hardware_concurrency(), 1u)};
   DB db_;
   Parser parser_;
 };
 
-Instance::Instance(std::string_view db_file, bool use_jit_flag) {
-  ptr_ = std::make_unique<Impl>(db_file, use_jit_flag);
+Instance::Instance(
+    std::string_view db_file, bool use_jit_flag, size_t buffer_pool_size) {
+  ptr_ = std::make_unique<Impl>(db_file, use_jit_flag, buffer_pool_size);
 }
 Instance::~Instance() {}
 ResultSet Instance::Execute(std::string_view statement) {
@@ -558,4 +645,29 @@ std::unique_ptr<PlanNode> Instance::GetPlan(std::string_view statement) {
 
 TxnManager& Instance::GetTxnManager() { return ptr_->GetTxnManager(); }
 
+BufferPoolReport Instance::GetBufferPoolReport() {
+  return ptr_->GetBufferPoolReport();
+}
+
+void Instance::SetBufferPoolSize(size_t buffer_pool_size) {
+  ptr_->SetBufferPoolSize(buffer_pool_size);
+}
+
+void Instance::SetScanThreads(size_t scan_threads) {
+  ptr_->SetScanThreads(scan_threads);
+}
+
+bool Instance::Vacuum() {
+  Txn* txn = ptr_->GetTxnManager().Begin();
+  try {
+    ptr_->Vacuum(txn->txn_id_);
+  } catch (const DBException& e) {
+    DB_INFO("DBException occurs. what(): {}", e.what());
+    ptr_->GetTxnManager().Abort(txn);
+    return false;
+  }
+  ptr_->GetTxnManager().Commit(txn);
+  return true;
+}
+
 }  // namespace wing
\ No newline at end of file
@@ -5,6 +5,7 @@
 #include <memory>
 #include <string>
 
+#include "catalog/db.hpp"
 #include "instance/resultset.hpp"
 #include "plan/plan.hpp"
 #include "transaction/txn.hpp"
@@ -14,13 +15,25 @@ namespace wing {
 
 class Instance {
  public:
-  Instance(std::string_view db_file, bool use_jit_flag);
+  Instance(std::string_view db_file, bool use_jit_flag,
+      size_t buffer_pool_size = DB::DEFAULT_BUFFER_POOL_SIZE);
   ~Instance();
   ResultSet Execute(std::string_view statement);
   ResultSet Execute(std::string_view statement, txn_id_t txn_id);
   void ExecuteShell();
   void Analyze(std::string_view table_name);
   TxnManager &GetTxnManager();
+  // The buffer pool counters of the whole database and of each table. The
+  // counters of a statement are in its ResultSet.
+  BufferPoolReport GetBufferPoolReport();
+  // Grow or shrink the buffer pool online. See DB::SetBufferPoolSize.
+  void SetBufferPoolSize(size_t buffer_pool_size);
+  // Split large scans between at most "scan_threads" threads. The default is
+  // the number of cores.
+  void SetScanThreads(size_t scan_threads);
+  // Compact the database file online. See DB::Vacuum. Return false if it
+  // fails, in which case the transaction is aborted.
+  bool Vacuum();
 
   // Give a SQL statement, return the optimized plan.
   // Used for testing optimizer.
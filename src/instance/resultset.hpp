@@ -4,6 +4,7 @@
 #include <memory>
 #include <string>
 
+#include "storage/buffer-pool-stats.hpp"
 #include "type/field.hpp"
 #include "type/vector.hpp"
 
@@ -51,11 +52,20 @@ class ResultSet {
     return parse_error_msg_ == "" ? execute_error_msg_ : parse_error_msg_;
   }
 
+  // Buffer pool accesses of the statement.
+  const BufferPoolCounters& GetBufferPoolStats() const {
+    return buffer_pool_stats_;
+  }
+  void SetBufferPoolStats(const BufferPoolCounters& stats) {
+    buffer_pool_stats_ = stats;
+  }
+
  private:
   std::string parse_error_msg_;
   std::string execute_error_msg_;
   TupleStore tuple_store_;
   size_t offset_{0};
+  BufferPoolCounters buffer_pool_stats_;
 };
 
 }  // namespace wing
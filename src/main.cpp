@@ -1,13 +1,32 @@
+#include <cctype>
+#include <cstdlib>
 #include <filesystem>
 #include <iostream>
 #include <memory>
 #include <string>
 
 #include "common/logging.hpp"
+#include "common/memory_budget.hpp"
 #include "instance/instance.hpp"
 
+// Parse sizes like 4096, 512K, 128M or 4G. Return 0 if it is invalid.
+static size_t ParseSize(const char* str) {
+  char* end;
+  size_t size = strtoull(str, &end, 10);
+  if (end == str)
+    return 0;
+  switch (toupper(*end)) {
+    case 'G': size <<= 10; [[fallthrough]];
+    case 'M': size <<= 10; [[fallthrough]];
+    case 'K': size <<= 10; end++; break;
+    default: break;
+  }
+  return *end == '\0' ? size : 0;
+}
+
 int main(int argc, char** argv) {
   bool use_jit_flag_ = false;
+  size_t buffer_pool_size = wing::DB::DEFAULT_BUFFER_POOL_SIZE;
   for (int i = 2; i < argc; i++) {
     // Use JIT.
     if (strcmp(argv[i], "--jit") == 0) {
@@ -16,6 +35,23 @@ int main(int argc, char** argv) {
     // Create a new empty DB.
     else if (strcmp(argv[i], "--new") == 0) {
       std::filesystem::remove(argv[1]);
+    }
+    // The size of the buffer pool.
+    else if (strcmp(argv[i], "--buffer-pool") == 0 && i + 1 < argc) {
+      buffer_pool_size = ParseSize(argv[++i]);
+      if (buffer_pool_size == 0) {
+        std::cerr << "Invalid buffer pool size: " << argv[i] << std::endl;
+        return -1;
+      }
+    }
+    // The memory shared by the buffer pool and the executors.
+    else if (strcmp(argv[i], "--memory-budget") == 0 && i + 1 < argc) {
+      size_t limit = ParseSize(argv[++i]);
+      if (limit == 0) {
+        std::cerr << "Invalid memory budget: " << argv[i] << std::endl;
+        return -1;
+      }
+      wing::MemoryBudget::Global().SetLimit(limit);
     } else {
       std::cerr << "Unrecognized cmdline option: " << argv[i] << std::endl;
       return -1;
@@ -29,6 +65,7 @@ int main(int argc, char** argv) {
     std::cerr << "Warning: please check your file name." << std::endl;
     std::cerr << fmt::format("Your file name is {}", argv[1]) << std::endl;
   }
-  auto db = std::make_unique<wing::Instance>(argv[1], use_jit_flag_);
+  auto db = std::make_unique<wing::Instance>(
+      argv[1], use_jit_flag_, buffer_pool_size);
   db->ExecuteShell();
 }
\ No newline at end of file
@@ -150,6 +150,7 @@ struct SubqueryTableRef : public TableRef {
  * Insert: insert into <table-name> <TableRef>;
  * Update: update <table-name> set <ColumnUpdate-list> where <Expr>;
  * Create Table: create table <table-name> (<ColumnDescription-list>);
+ *               create table <table-name> as <SelectStatement>;
  * Drop Table: drop table <table-name>;
  * Create Index: create index <index-name> on <table-name>(<column-names>);
  * Drop Index: drop index <index-name>;
@@ -203,6 +204,9 @@ struct ColumnDescription {
 struct CreateTableStatement : public Statement {
   std::string table_name_;
   std::vector<ColumnDescription> columns_;
+  // Not null if it is CREATE TABLE AS SELECT. The columns are those of the
+  // result, and columns_ is empty.
+  std::unique_ptr<SelectStatement> select_;
   CreateTableStatement() : Statement(StatementType::CREATE_TABLE) {}
   std::string ToString() const override;
 };
@@ -558,7 +558,12 @@ class Parser::Impl {
     auto ret = std::make_unique<CreateTableStatement>();
     _match_token("table", TokenType::TABLE);
     ret->table_name_ = table_name_clause();
-    ret->columns_ = column_description_clause();
+    if (reader_.ReadType() == TokenType::AS) {
+      reader_.Next();
+      ret->select_ = select_or_subquery_clause();
+    } else {
+      ret->columns_ = column_description_clause();
+    }
     if (reader_.ReadType() != TokenType::_SEMICOLON)
       throw ParserException("Expect \';\'");
     reader_.Next();
@@ -1508,8 +1513,11 @@ ParserResult Parser::Parse(std::string_view str, const DBSchema& schema) {
   if (errmsg != "")
     return {std::move(errmsg)};
 
+  // CREATE TABLE AS SELECT is planned as an insert into the new table.
   if (statement->type_ == StatementType::CREATE_INDEX ||
-      statement->type_ == StatementType::CREATE_TABLE ||
+      (statement->type_ == StatementType::CREATE_TABLE &&
+          static_cast<CreateTableStatement*>(statement.get())->select_ ==
+              nullptr) ||
       statement->type_ == StatementType::DROP_INDEX ||
       statement->type_ == StatementType::DROP_TABLE) {
     return {std::move(statement), nullptr, ""};
@@ -1746,7 +1754,8 @@ std::string ColumnDescription::ToString() const {
 
 std::string CreateTableStatement::ToString() const {
   return "create table: " + SetToString("table name", table_name_,
-                                "column descriptions", columns_);
+                                "column descriptions", columns_, "select",
+                                select_);
 }
 
 std::string ColumnUpdate::ToString() const {
@@ -5,6 +5,7 @@
 #include "plan/rules/push_down_filter.hpp"
 #include "plan/rules/push_down_join_predicate.hpp"
 #include "plan/rules/convert_to_range_scan_rule.hpp"
+#include "plan/rules/order_by_primary_key.hpp"
 #include <iostream>
 
 namespace wing {
@@ -40,6 +41,10 @@ std::unique_ptr<PlanNode> LogicalOptimizer::Optimize(
   //R.push_back(std::make_unique<ConvertToHashJoinRule>());
   R.push_back(std::make_unique<ConvertToRangeScanRule>(db));
   plan = Apply(std::move(plan), R);
+  // The scans are final now.
+  R.clear();
+  R.push_back(std::make_unique<OrderByPrimaryKeyRule>(db));
+  plan = Apply(std::move(plan), R);
   return plan;
 }
 
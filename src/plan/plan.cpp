@@ -35,6 +35,10 @@ class BasicPlanGenerator::Impl {
         return {plan_update(static_cast<UpdateStatement*>(statement)), ""};
       } else if (statement->type_ == StatementType::DELETE) {
         return {plan_delete(static_cast<DeleteStatement*>(statement)), ""};
+      } else if (statement->type_ == StatementType::CREATE_TABLE) {
+        return {plan_create_table_as(
+                    static_cast<CreateTableStatement*>(statement)),
+            ""};
       } else {
         throw PlannerException("Unrecognized statement type");
       }
@@ -316,6 +320,28 @@ class BasicPlanGenerator::Impl {
     return ret;
   }
 
+  // create table A as select ...
+  // It is planned as inserting the result of the subquery into A, which is
+  // created with the columns of the result before executing the plan.
+  std::unique_ptr<PlanNode> plan_create_table_as(
+      CreateTableStatement* statement) {
+    if (statement->select_ == nullptr) {
+      throw PlannerException("Unrecognized statement type");
+    }
+    if (schema_.Find(statement->table_name_).has_value()) {
+      throw PlannerException(
+          fmt::format("Table \'{}\' exists.", statement->table_name_));
+    }
+    auto ret = std::make_unique<InsertPlanNode>();
+    ret->ch_ = plan_select(statement->select_.get());
+    ret->table_bitset_ = ret->ch_->table_bitset_;
+    ret->table_name_ = statement->table_name_;
+    table_id_table_.push_back(total_table_num_++);
+    ret->output_schema_.Append(OutputColumnData{
+        column_id_++, "", "inserted rows", FieldType::INT64, 0});
+    return ret;
+  }
+
   // Plan update statement.
   std::unique_ptr<PlanNode> plan_update(UpdateStatement* statement) {
     auto ret = std::make_unique<UpdatePlanNode>();
@@ -1018,10 +1044,10 @@ std::string DistinctPlanNode::ToString() const {
 
 std::string RangeScanPlanNode::ToString() const {
   return fmt::format(
-      "Range Scan [Table: {}] [Range: {}{}, {}{} ] [Predicate: {}]",
+      "Range Scan [Table: {}] [Range: {}{}, {}{} ] [Predicate: {}]{}",
       table_name_, range_l_.second ? "[" : "(", range_l_.first.ToString(),
       range_r_.first.ToString(), range_r_.second ? "]" : ")",
-      predicate_.ToString());
+      predicate_.ToString(), reverse_ ? " [Reverse]" : "");
 }
 
 std::unique_ptr<PlanNode> ProjectPlanNode::clone() const {
@@ -1172,6 +1198,7 @@ std::unique_ptr<PlanNode> RangeScanPlanNode::clone() const {
   ret->predicate_ = predicate_.clone();
   ret->range_l_ = range_l_;
   ret->range_r_ = range_r_;
+  ret->reverse_ = reverse_;
   return ret;
 }
 
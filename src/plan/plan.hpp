@@ -230,6 +230,8 @@ class RangeScanPlanNode : public PlanNode {
   std::pair<Field, bool> range_l_;
   std::pair<Field, bool> range_r_;
   PredicateVec predicate_;
+  /* Return the rows in descending order of the key. */
+  bool reverse_{false};
 };
 
 // This is used to generate a base plan after generating AST.
@@ -0,0 +1,94 @@
+#ifndef SAKURA_ORDER_BY_PRIMARY_KEY_H__
+#define SAKURA_ORDER_BY_PRIMARY_KEY_H__
+
+#include "catalog/db.hpp"
+#include "plan/plan.hpp"
+#include "plan/rules/rule.hpp"
+
+namespace wing {
+
+/**
+ * Tables are stored in B+trees ordered by the primary key, so sorting a single
+ * table by its primary key is not needed. For example,
+ * select * from A order by A.id desc limit 10;
+ *                   Limit
+ *                     |
+ *         Order [_#1 desc]                       Limit
+ *                     |                            |
+ *        Project [_#1 = A.id, *]     =>      Project [*]
+ *                     |                            |
+ *              SeqScan [Table: A]       Range Scan [Table: A] [Reverse]
+ * The order by columns are removed from the project, and the scan returns the
+ * rows in the wanted order, so that the limit only reads a few leaves instead
+ * of the whole table. The primary key is unique, so the other order by
+ * expressions never matter.
+ *
+ * This rule should be applied after the filters are pushed down into the
+ * scans.
+ */
+class OrderByPrimaryKeyRule : public OptRule {
+ public:
+  OrderByPrimaryKeyRule(DB& db) : db_(db) {}
+  bool Match(const PlanNode* node) override {
+    if (node->type_ != PlanType::Order)
+      return false;
+    auto proj = node->ch_.get();
+    if (proj->type_ != PlanType::Project)
+      return false;
+    auto scan = proj->ch_.get();
+    std::string_view table_name;
+    if (scan->type_ == PlanType::SeqScan) {
+      table_name = static_cast<const SeqScanPlanNode*>(scan)->table_name_;
+    } else if (scan->type_ == PlanType::RangeScan) {
+      table_name = static_cast<const RangeScanPlanNode*>(scan)->table_name_;
+    } else {
+      return false;
+    }
+    auto& expr = static_cast<const ProjectPlanNode*>(proj)->output_exprs_[0];
+    if (expr->type_ != ExprType::COLUMN)
+      return false;
+    auto col = static_cast<const ColumnExpr*>(expr.get());
+    auto index = scan->output_schema_.FindById(col->id_in_column_name_table_);
+    if (!index.has_value())
+      return false;
+    auto table_id = db_.GetDBSchema().Find(table_name);
+    if (!table_id.has_value())
+      return false;
+    const auto& tab = db_.GetDBSchema()[table_id.value()];
+    return !tab.GetHidePKFlag() &&
+           scan->output_schema_[index.value()].column_name_ ==
+               tab.GetPrimaryKeySchema().name_;
+  }
+  std::unique_ptr<PlanNode> Transform(std::unique_ptr<PlanNode> node) override {
+    auto t_node = static_cast<OrderByPlanNode*>(node.get());
+    bool asc = t_node->order_by_exprs_[0].second;
+    auto proj = std::move(t_node->ch_);
+    auto t_proj = static_cast<ProjectPlanNode*>(proj.get());
+    t_proj->output_exprs_.erase(t_proj->output_exprs_.begin(),
+        t_proj->output_exprs_.begin() + t_node->order_by_offset_);
+    t_proj->output_schema_ = std::move(t_node->output_schema_);
+    if (t_proj->ch_->type_ == PlanType::RangeScan) {
+      static_cast<RangeScanPlanNode*>(t_proj->ch_.get())->reverse_ = !asc;
+    } else if (!asc) {
+      // Sequential scans go forwards only.
+      auto scan = static_cast<SeqScanPlanNode*>(t_proj->ch_.get());
+      auto range_scan = std::make_unique<RangeScanPlanNode>();
+      range_scan->output_schema_ = scan->output_schema_;
+      range_scan->table_bitset_ = scan->table_bitset_;
+      range_scan->table_name_ = scan->table_name_;
+      range_scan->predicate_ = std::move(scan->predicate_);
+      range_scan->range_l_ = {Field(), false};
+      range_scan->range_r_ = {Field(), false};
+      range_scan->reverse_ = true;
+      t_proj->ch_ = std::move(range_scan);
+    }
+    return proj;
+  }
+
+ private:
+  DB& db_;
+};
+
+}  // namespace wing
+
+#endif
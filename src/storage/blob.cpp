@@ -69,6 +69,24 @@ std::string Blob::Read() {
   }
   return ret;
 }
+void Blob::CollectPages(std::vector<pgid_t>& pages) {
+  pgid_t cur = head_;
+  while (cur) {
+    pages.push_back(cur);
+    cur = NextPageID(pgm_.GetPlainPage(cur));
+  }
+}
+void Blob::RemapPages(const std::function<pgid_t(pgid_t)>& remap) {
+  pgid_t cur = head_;
+  while (cur) {
+    PlainPage page = pgm_.GetPlainPage(cur);
+    pgid_t next = NextPageID(page);
+    if (next != 0)
+      UpdateNext(page, remap(next));
+    cur = next;
+  }
+  head_ = remap(head_);
+}
 void Blob::Free(pgid_t cur) {
   while (cur) {
     pgid_t next = NextPageID(pgm_.GetPlainPage(cur));
@@ -1,6 +1,9 @@
 #ifndef BLOB_H_
 #define BLOB_H_
 
+#include <functional>
+#include <vector>
+
 #include "storage/page-manager.hpp"
 
 namespace wing {
@@ -21,6 +24,11 @@ class Blob {
   inline pgid_t MetaPageID() const { return head_; }
   void Rewrite(std::string_view value);
   std::string Read();
+  // Append the pages of the blob to "pages" in order.
+  void CollectPages(std::vector<pgid_t>& pages);
+  // Update the page IDs stored in the pages before they are moved by
+  // PageManager::Relocate. See BPlusTree::RemapPages.
+  void RemapPages(const std::function<pgid_t(pgid_t)>& remap);
 
  private:
   Blob(PageManager& pgm, pgid_t meta_pgid) : pgm_(pgm), head_(meta_pgid) {}
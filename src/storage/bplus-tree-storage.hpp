@@ -1,12 +1,17 @@
 #ifndef BPLUS_TREE_STORAGE_H_
 #define BPLUS_TREE_STORAGE_H_
 
+#include <algorithm>
+#include <bit>
 #include <compare>
+#include <cstdint>
+#include <cstring>
 #include <memory>
 #include <optional>
 
 #include "blob.hpp"
 #include "bplus-tree.hpp"
+#include "buffer-pool-stats.hpp"
 #include "catalog/schema.hpp"
 #include "common/logging.hpp"
 #include "storage.hpp"
@@ -19,6 +24,11 @@ namespace wing {
 class AbstractBPlusTreeTable {
  public:
   virtual ~AbstractBPlusTreeTable() = default;
+  const BufferPoolStats& GetBufferPoolStats() const { return stats_; }
+
+ protected:
+  // Buffer pool accesses on behalf of this table.
+  BufferPoolStats stats_;
 };
 
 using StringKeyCompare = std::compare_three_way;
@@ -33,6 +43,34 @@ struct IntegerKeyCompare {
                               : *reinterpret_cast<const int64_t*>(R.data());
     return l <=> r;
   }
+  // The normalized prefix for BPlusTree. Integers out of the range of int32
+  // share the smallest or the largest head.
+  static slothead_t Head(std::string_view key) {
+    int64_t v = key.size() == 4 ? *reinterpret_cast<const int32_t*>(key.data())
+                                : *reinterpret_cast<const int64_t*>(key.data());
+    v = std::clamp<int64_t>(v, INT32_MIN, INT32_MAX);
+    return (slothead_t)(v - INT32_MIN);
+  }
+};
+
+// INT64 primary keys, which are all 8 bytes. So BPlusTree stores them without
+// their lengths, and they are compared without checking their sizes.
+struct Int64KeyCompare {
+  static constexpr size_t KEY_SIZE = sizeof(int64_t);
+  std::weak_ordering operator()(std::string_view L, std::string_view R) const {
+    int64_t l, r;
+    memcpy(&l, L.data(), sizeof(l));
+    memcpy(&r, R.data(), sizeof(r));
+    return l <=> r;
+  }
+  // The same as IntegerKeyCompare::Head, so auto-generated keys below
+  // INT32_MAX are told apart by their heads alone.
+  static slothead_t Head(std::string_view key) {
+    int64_t v;
+    memcpy(&v, key.data(), sizeof(v));
+    v = std::clamp<int64_t>(v, INT32_MIN, INT32_MAX);
+    return (slothead_t)(v - INT32_MIN);
+  }
 };
 
 struct FloatKeyCompare {
@@ -48,6 +86,18 @@ struct FloatKeyCompare {
     else
       return std::weak_ordering::equivalent;
   }
+  // The normalized prefix for BPlusTree: the high 32 bits of the double, with
+  // the sign bit flipped for non-negative numbers and all bits flipped for
+  // negative ones.
+  static slothead_t Head(std::string_view key) {
+    double v = *reinterpret_cast<const double*>(key.data());
+    // -0.0 == 0.0
+    if (v == 0)
+      v = 0;
+    uint64_t bits = std::bit_cast<uint64_t>(v);
+    bits = (bits >> 63) ? ~bits : bits | (1ull << 63);
+    return (slothead_t)(bits >> 32);
+  }
 };
 
 template <typename KeyCompare>
@@ -61,16 +111,24 @@ class BPlusTreeTable : public AbstractBPlusTreeTable {
     Iterator(const Iterator&) = delete;
     Iterator& operator=(const Iterator&) = delete;
     Iterator(Iterator&& iter)
-      : first_flag_(iter.first_flag_), iter_(std::move(iter.iter_)) {}
+      : first_flag_(iter.first_flag_),
+        iter_(std::move(iter.iter_)),
+        stats_(iter.stats_),
+        tree_(iter.tree_) {}
     Iterator& operator=(Iterator&& iter) {
       first_flag_ = std::move(iter.first_flag_);
       iter_ = std::move(iter.iter_);
+      stats_ = iter.stats_;
+      tree_ = iter.tree_;
       return *this;
     }
-    Iterator(typename tree_t::Iter&& iter)
-      : first_flag_(true), iter_(std::move(iter)) {}
+    // "tree" is used to skip keys without reading them.
+    Iterator(typename tree_t::Iter&& iter, BufferPoolStats* stats = nullptr,
+        tree_t* tree = nullptr)
+      : first_flag_(true), iter_(std::move(iter)), stats_(stats), tree_(tree) {}
     void Init() override { first_flag_ = true; }
     const uint8_t* Next() override {
+      BufferPoolStatsScope scope(BufferPoolStatsScope::TABLE, stats_);
       if (!first_flag_) {
         iter_.Next();
       } else {
@@ -82,20 +140,37 @@ class BPlusTreeTable : public AbstractBPlusTreeTable {
       std::string_view tuple = ret.value().second;
       return reinterpret_cast<const uint8_t*>(tuple.data());
     }
+    size_t Skip(size_t n) override {
+      if (tree_ == nullptr)
+        return wing::Iterator<const uint8_t*>::Skip(n);
+      BufferPoolStatsScope scope(BufferPoolStatsScope::TABLE, stats_);
+      return SkipKeys(*tree_, iter_, first_flag_, tree_->TupleNum(), n);
+    }
 
    private:
     bool first_flag_;
     typename tree_t::Iter iter_;
+    BufferPoolStats* stats_;
+    tree_t* tree_;
     friend class BPlusTreeTable<KeyCompare>;
   };
   template <bool RIGHT_CLOSED, bool RIGHT_NOLIMIT>
   class RangeIterator : public wing::Iterator<const uint8_t*> {
    public:
-    RangeIterator(typename tree_t::Iter&& iter, std::string&& end)
-      : first_flag_(true), iter_(std::move(iter)), end_(std::move(end)) {}
+    RangeIterator(typename tree_t::Iter&& iter, std::string&& end,
+        BufferPoolStats* stats = nullptr, tree_t* tree = nullptr)
+      : first_flag_(true),
+        iter_(std::move(iter)),
+        end_(std::move(end)),
+        stats_(stats),
+        tree_(tree) {
+      if (!RIGHT_NOLIMIT)
+        iter_.SetReadAheadEnd(end_, RIGHT_CLOSED);
+    }
     /* TODO: implement the real Init(). */
     void Init() override { first_flag_ = true; }
     const uint8_t* Next() override {
+      BufferPoolStatsScope scope(BufferPoolStatsScope::TABLE, stats_);
       if (!first_flag_) {
         iter_.Next();
       } else {
@@ -116,11 +191,64 @@ class BPlusTreeTable : public AbstractBPlusTreeTable {
       }
       return reinterpret_cast<const uint8_t*>(tuple.data());
     }
+    size_t Skip(size_t n) override {
+      if (tree_ == nullptr)
+        return wing::Iterator<const uint8_t*>::Skip(n);
+      BufferPoolStatsScope scope(BufferPoolStatsScope::TABLE, stats_);
+      size_t end = RIGHT_NOLIMIT ? tree_->TupleNum()
+                                 : tree_->Rank(end_, RIGHT_CLOSED);
+      size_t ret = SkipKeys(*tree_, iter_, first_flag_, end, n);
+      if (!RIGHT_NOLIMIT)
+        iter_.SetReadAheadEnd(end_, RIGHT_CLOSED);
+      return ret;
+    }
+
+   private:
+    bool first_flag_;
+    typename tree_t::Iter iter_;
+    std::string end_;
+    BufferPoolStats* stats_;
+    tree_t* tree_;
+  };
+  // Goes from the right end of the range to the left end.
+  template <bool LEFT_CLOSED, bool LEFT_NOLIMIT>
+  class ReverseRangeIterator : public wing::Iterator<const uint8_t*> {
+   public:
+    ReverseRangeIterator(typename tree_t::Iter&& iter, std::string&& end,
+        BufferPoolStats* stats = nullptr)
+      : first_flag_(true),
+        iter_(std::move(iter)),
+        end_(std::move(end)),
+        stats_(stats) {}
+    void Init() override { first_flag_ = true; }
+    const uint8_t* Next() override {
+      BufferPoolStatsScope scope(BufferPoolStatsScope::TABLE, stats_);
+      if (!first_flag_) {
+        iter_.Prev();
+      } else {
+        first_flag_ = false;
+      }
+      auto ret = iter_.Cur();
+      if (!ret.has_value())
+        return nullptr;
+      auto [key, tuple] = ret.value();
+      if (!LEFT_NOLIMIT) {
+        if (LEFT_CLOSED) {
+          if (KeyCompare()(key, end_) < 0)
+            return nullptr;
+        } else {
+          if (KeyCompare()(key, end_) <= 0)
+            return nullptr;
+        }
+      }
+      return reinterpret_cast<const uint8_t*>(tuple.data());
+    }
 
    private:
     bool first_flag_;
     typename tree_t::Iter iter_;
     std::string end_;
+    BufferPoolStats* stats_;
   };
   class ModifyHandle : public wing::ModifyHandle {
    public:
@@ -129,6 +257,7 @@ class BPlusTreeTable : public AbstractBPlusTreeTable {
     void Init() override {}
     bool Delete(std::string_view key) override {
       // P4 TODO
+      BufferPoolStatsScope scope(BufferPoolStatsScope::TABLE, &table_.stats_);
       std::string key_=std::basic_string(key.data(),key.size());
       ctx_->lock_manager_->AcquireTupleLock(ctx_->table_name_,key,LockMode::X,ctx_->txn_);
       std::optional<std::string> lst=table_.tree_.Get(key);
@@ -141,6 +270,7 @@ class BPlusTreeTable : public AbstractBPlusTreeTable {
     }
     bool Insert(std::string_view key, std::string_view value) override {
       // P4 TODO
+      BufferPoolStatsScope scope(BufferPoolStatsScope::TABLE, &table_.stats_);
       std::string key_=std::basic_string(key.data(),key.size());
       ctx_->lock_manager_->AcquireTupleLock(ctx_->table_name_,key,LockMode::X,ctx_->txn_);
       if (table_.Insert(key,value))
@@ -152,6 +282,7 @@ class BPlusTreeTable : public AbstractBPlusTreeTable {
     }
     bool Update(std::string_view key, std::string_view value) override {
       // P4 TODO
+      BufferPoolStatsScope scope(BufferPoolStatsScope::TABLE, &table_.stats_);
       std::string key_=std::basic_string(key.data(),key.size());
       ctx_->lock_manager_->AcquireTupleLock(ctx_->table_name_,key,LockMode::X,ctx_->txn_);
       std::optional<std::string> lst=table_.tree_.Get(key);
@@ -162,6 +293,57 @@ class BPlusTreeTable : public AbstractBPlusTreeTable {
       }
       return false;
     }
+    bool BulkLoad(std::vector<std::pair<std::string_view, std::string_view>>&
+            kvs) override {
+      BufferPoolStatsScope scope(BufferPoolStatsScope::TABLE, &table_.stats_);
+      if (table_.TupleNum() != 0)
+        return false;
+      // Lock the whole table instead of each tuple, so that it stays empty.
+      Txn* txn = ctx_->txn_;
+      txn->rw_latch_.lock();
+      bool locked = txn->table_lock_set_[LockMode::X].count(ctx_->table_name_);
+      txn->rw_latch_.unlock();
+      if (!locked)
+        ctx_->lock_manager_->AcquireTableLock(
+            ctx_->table_name_, LockMode::X, txn);
+      if (table_.TupleNum() != 0)
+        return false;
+      KeyCompare comp;
+      std::sort(kvs.begin(), kvs.end(), [&comp](const auto& a, const auto& b) {
+        return comp(a.first, b.first) < 0;
+      });
+      for (size_t i = 1; i < kvs.size(); ++i) {
+        if (comp(kvs[i - 1].first, kvs[i].first) == 0)
+          return false;
+      }
+      for (const auto& kv : kvs) {
+        txn->modify_records_.push(ModifyRecord(
+            ModifyType::INSERT, ctx_->table_name_, kv.first, ""));
+      }
+      table_.BulkLoad(kvs);
+      return true;
+    }
+    bool InsertBatch(std::vector<std::pair<std::string_view,
+            std::string_view>>& kvs) override {
+      if (kvs.size() == 1)
+        return Insert(kvs[0].first, kvs[0].second);
+      BufferPoolStatsScope scope(BufferPoolStatsScope::TABLE, &table_.stats_);
+      KeyCompare comp;
+      std::sort(kvs.begin(), kvs.end(), [&comp](const auto& a, const auto& b) {
+        return comp(a.first, b.first) < 0;
+      });
+      // Lock in key order, so that two batches do not wait for each other.
+      for (const auto& kv : kvs) {
+        ctx_->lock_manager_->AcquireTupleLock(
+            ctx_->table_name_, kv.first, LockMode::X, ctx_->txn_);
+      }
+      size_t num = table_.InsertSorted(kvs);
+      for (size_t i = 0; i < num; ++i) {
+        ctx_->txn_->modify_records_.push(ModifyRecord(
+            ModifyType::INSERT, ctx_->table_name_, kvs[i].first, ""));
+      }
+      return num == kvs.size();
+    }
 
    private:
     BPlusTreeTable& table_;
@@ -170,25 +352,29 @@ class BPlusTreeTable : public AbstractBPlusTreeTable {
   };
   class SearchHandle : public wing::SearchHandle {
    public:
-    SearchHandle(tree_t& tree, std::unique_ptr<TxnExecCtx> ctx)
-      : tree_(tree), ctx_(std::move(ctx)) {}
+    SearchHandle(tree_t& tree, BufferPoolStats& stats,
+        std::unique_ptr<TxnExecCtx> ctx)
+      : tree_(tree), stats_(stats), ctx_(std::move(ctx)) {}
     void Init() override {}
     const uint8_t* Search(std::string_view key) override {
       // P4 TODO
-      std::string key_=std::basic_string(key.data(),key.size());
+      key_.assign(key.data(),key.size());
       bool flag=false;
       ctx_->txn_->rw_latch_.lock();
       if (ctx_->txn_->tuple_lock_set_[LockMode::X][ctx_->table_name_].count(key_)) flag=true;
       ctx_->txn_->rw_latch_.unlock();
       if (!flag) ctx_->lock_manager_->AcquireTupleLock(ctx_->table_name_,key,LockMode::S,ctx_->txn_);
-      auto res=tree_.Get(key);
-      if (!res.has_value()) return nullptr;
-      return reinterpret_cast<const uint8_t*>(res.value().data());
+      BufferPoolStatsScope scope(BufferPoolStatsScope::TABLE, &stats_);
+      // The value is valid until the next Search, as last_ is reused.
+      if (!tree_.Get(key,last_)) return nullptr;
+      return reinterpret_cast<const uint8_t*>(last_.data());
     }
 
    private:
     tree_t& tree_;
+    BufferPoolStats& stats_;
     std::unique_ptr<TxnExecCtx> ctx_;
+    std::string key_;
     std::string last_;
     friend class BPlusTreeTable<KeyCompare>;
   };
@@ -203,52 +389,137 @@ class BPlusTreeTable : public AbstractBPlusTreeTable {
     return *this;
   }
   void Drop() { tree_.Destroy(); }
-  Iterator Begin() { return Iterator(tree_.Begin()); }
+  Iterator Begin() {
+    BufferPoolStatsScope scope(BufferPoolStatsScope::TABLE, &stats_);
+    return Iterator(tree_.Begin(), &stats_, &tree_);
+  }
   std::unique_ptr<wing::Iterator<const uint8_t*>> GetIterator() {
-    return std::make_unique<Iterator>(tree_.Begin());
+    BufferPoolStatsScope scope(BufferPoolStatsScope::TABLE, &stats_);
+    // Used by full table scans.
+    auto iter = tree_.Begin();
+    iter.UseScanRing();
+    return std::make_unique<Iterator>(std::move(iter), &stats_, &tree_);
   }
   auto GetRangeIterator(std::tuple<std::string_view, bool, bool> L,
+      std::tuple<std::string_view, bool, bool> R, bool reverse = false)
+      -> std::unique_ptr<wing::Iterator<const uint8_t*>> {
+    BufferPoolStatsScope scope(BufferPoolStatsScope::TABLE, &stats_);
+    if (reverse)
+      return GetReverseRangeIterator(L, R);
+    return MakeRangeIterator(LeftEnd(L), R);
+  }
+  /* Split the range into at most n key ranges of roughly equal size, and
+   * return an iterator for each of them in key order. The iterators can be
+   * used by different threads. A table is not split into ranges of less than
+   * PARALLEL_SCAN_MIN_TUPLES tuples on average. The leaves are read through
+   * ScanRings, since the ranges are meant to be scanned as a whole.
+   */
+  auto GetRangeIterators(std::tuple<std::string_view, bool, bool> L,
+      std::tuple<std::string_view, bool, bool> R, size_t n)
+      -> std::vector<std::unique_ptr<wing::Iterator<const uint8_t*>>> {
+    std::vector<std::string> keys;
+    {
+      BufferPoolStatsScope scope(BufferPoolStatsScope::TABLE, &stats_);
+      n = std::min(n, tree_.TupleNum() / PARALLEL_SCAN_MIN_TUPLES);
+      std::optional<std::string_view> lo, hi;
+      if (!std::get<1>(L))
+        lo = std::get<0>(L);
+      if (!std::get<1>(R))
+        hi = std::get<0>(R);
+      keys = tree_.SplitKeys(n, lo, hi);
+      // Keys on or out of the ends would make empty ranges.
+      std::erase_if(keys, [&](const std::string& key) {
+        return (lo.has_value() && KeyCompare()(key, *lo) <= 0) ||
+               (hi.has_value() && KeyCompare()(key, *hi) >= 0);
+      });
+    }
+    std::vector<std::unique_ptr<wing::Iterator<const uint8_t*>>> ret;
+    auto add = [&](std::tuple<std::string_view, bool, bool> l,
+                   std::tuple<std::string_view, bool, bool> r) {
+      BufferPoolStatsScope scope(BufferPoolStatsScope::TABLE, &stats_);
+      auto iter = LeftEnd(l);
+      iter.UseScanRing();
+      ret.push_back(MakeRangeIterator(std::move(iter), r));
+    };
+    if (keys.empty()) {
+      add(L, R);
+      return ret;
+    }
+    // [L, keys[0]), [keys[0], keys[1]), ..., [keys.back(), R]
+    add(L, {keys[0], false, false});
+    for (size_t i = 1; i < keys.size(); i++)
+      add({keys[i - 1], false, true}, {keys[i], false, false});
+    add({keys.back(), false, true}, R);
+    return ret;
+  }
+
+  // Returns the keys in the range from the largest to the smallest.
+  auto GetReverseRangeIterator(std::tuple<std::string_view, bool, bool> L,
       std::tuple<std::string_view, bool, bool> R)
       -> std::unique_ptr<wing::Iterator<const uint8_t*>> {
-    auto iter = std::get<1>(L)   ? tree_.Begin()
-                : std::get<2>(L) ? tree_.LowerBound(std::get<0>(L))
-                                 : tree_.UpperBound(std::get<0>(L));
-    if (std::get<1>(R)) {
-      // right is empty. i.e. not limited.
-      return std::make_unique<RangeIterator<false, true>>(
-          std::move(iter), std::string(std::get<0>(R)));
-    } else if (std::get<2>(R)) {
-      // right closed.
-      return std::make_unique<RangeIterator<true, false>>(
-          std::move(iter), std::string(std::get<0>(R)));
+    auto iter = std::get<1>(R)   ? tree_.RBegin()
+                : std::get<2>(R) ? tree_.ReverseLowerBound(std::get<0>(R))
+                                 : tree_.ReverseUpperBound(std::get<0>(R));
+    if (std::get<1>(L)) {
+      // left is empty. i.e. not limited.
+      return std::make_unique<ReverseRangeIterator<false, true>>(
+          std::move(iter), std::string(std::get<0>(L)), &stats_);
+    } else if (std::get<2>(L)) {
+      // left closed.
+      return std::make_unique<ReverseRangeIterator<true, false>>(
+          std::move(iter), std::string(std::get<0>(L)), &stats_);
     } else {
-      // right open.
-      return std::make_unique<RangeIterator<false, false>>(
-          std::move(iter), std::string(std::get<0>(R)));
+      // left open.
+      return std::make_unique<ReverseRangeIterator<false, false>>(
+          std::move(iter), std::string(std::get<0>(L)), &stats_);
     }
   }
 
-  bool Delete(std::string_view key) { return tree_.Delete(key); }
+  bool Delete(std::string_view key) {
+    BufferPoolStatsScope scope(BufferPoolStatsScope::TABLE, &stats_);
+    return tree_.Delete(key);
+  }
   std::optional<std::string> Get(std::string_view key) {
+    BufferPoolStatsScope scope(BufferPoolStatsScope::TABLE, &stats_);
     return tree_.Get(key);
   }
   bool Insert(std::string_view key, std::string_view value) {
+    BufferPoolStatsScope scope(BufferPoolStatsScope::TABLE, &stats_);
     bool succeed = tree_.Insert(key, value);
     if (succeed)
       ticks_ += 1;
     return succeed;
   }
   bool Update(std::string_view key, std::string_view value) {
+    BufferPoolStatsScope scope(BufferPoolStatsScope::TABLE, &stats_);
     auto exists = tree_.Update(key, value);
     return exists;
   }
+  // "kvs" should be sorted by key. Return the number of inserted pairs. See
+  // BPlusTree::InsertSorted.
+  size_t InsertSorted(
+      const std::vector<std::pair<std::string_view, std::string_view>>& kvs) {
+    BufferPoolStatsScope scope(BufferPoolStatsScope::TABLE, &stats_);
+    size_t num = tree_.InsertSorted(kvs.begin(), kvs.end());
+    ticks_ += num;
+    return num;
+  }
+  // "kvs" should be sorted by key without duplicates, and the table should be
+  // empty.
+  void BulkLoad(
+      const std::vector<std::pair<std::string_view, std::string_view>>& kvs) {
+    BufferPoolStatsScope scope(BufferPoolStatsScope::TABLE, &stats_);
+    // Leave some space in the leaves for later inserts.
+    tree_.BulkLoad(kvs.begin(), kvs.end(), BULK_LOAD_FILL_FACTOR);
+    ticks_ += kvs.size();
+  }
   std::unique_ptr<wing::ModifyHandle> GetModifyHandle(
       std::unique_ptr<TxnExecCtx> ctx) {
     return std::make_unique<ModifyHandle>(*this, std::move(ctx));
   }
   std::unique_ptr<wing::SearchHandle> GetSearchHandle(
       std::unique_ptr<TxnExecCtx> ctx) {
-    return std::make_unique<SearchHandle>(tree_, std::move(ctx));
+    return std::make_unique<SearchHandle>(tree_, stats_, std::move(ctx));
   }
   size_t TupleNum() { return tree_.TupleNum(); }
   std::optional<std::string_view> GetMaxKey() { return tree_.MaxKey(); }
@@ -258,6 +529,50 @@ class BPlusTreeTable : public AbstractBPlusTreeTable {
     : schema_(std::move(schema)), tree_(std::move(tree)) {}
 
  private:
+  static constexpr double BULK_LOAD_FILL_FACTOR = 0.9;
+  static constexpr size_t PARALLEL_SCAN_MIN_TUPLES = 1 << 14;
+
+  /* Move "iter" forward by "n" keys, but not beyond the "end"-th key in the
+   * tree, with BPlusTree::Rank and BPlusTree::Nth instead of reading the keys
+   * in between. "first" is whether the key "iter" points to is not returned
+   * yet. Return the number of keys skipped.
+   */
+  static size_t SkipKeys(tree_t& tree, typename tree_t::Iter& iter,
+      bool& first, size_t end, size_t n) {
+    auto cur = iter.Cur();
+    if (!cur.has_value())
+      return 0;
+    size_t pos = tree.Rank(cur.value().first) + (first ? 0 : 1);
+    n = pos < end ? std::min(n, end - pos) : 0;
+    iter = tree.Nth(pos + n);
+    first = true;
+    return n;
+  }
+  // The iterator pointing to the left end "L" of a range.
+  typename tree_t::Iter LeftEnd(std::tuple<std::string_view, bool, bool> L) {
+    return std::get<1>(L)   ? tree_.Begin()
+           : std::get<2>(L) ? tree_.LowerBound(std::get<0>(L))
+                            : tree_.UpperBound(std::get<0>(L));
+  }
+  // Goes from "iter" to the right end "R" of a range.
+  auto MakeRangeIterator(typename tree_t::Iter&& iter,
+      std::tuple<std::string_view, bool, bool> R)
+      -> std::unique_ptr<wing::Iterator<const uint8_t*>> {
+    if (std::get<1>(R)) {
+      // right is empty. i.e. not limited.
+      return std::make_unique<RangeIterator<false, true>>(
+          std::move(iter), std::string(std::get<0>(R)), &stats_, &tree_);
+    } else if (std::get<2>(R)) {
+      // right closed.
+      return std::make_unique<RangeIterator<true, false>>(
+          std::move(iter), std::string(std::get<0>(R)), &stats_, &tree_);
+    } else {
+      // right open.
+      return std::make_unique<RangeIterator<false, false>>(
+          std::move(iter), std::string(std::get<0>(R)), &stats_, &tree_);
+    }
+  }
+
   TableSchema schema_;
   tree_t tree_;
   std::atomic<size_t> ticks_;
@@ -277,13 +592,25 @@ struct TableMetaPages {
 
 class BPlusTreeStorage {
  public:
+  // The read-ahead of scans needs an asynchronous I/O engine.
+  static PageManagerOptions DefaultOptions() {
+    return PageManagerOptions{
+      .io_engine = IOEngineKind::IO_URING,
+      .background_writer = true,
+      .checkpoint_interval = std::chrono::seconds(30),
+      // 16MiB/s
+      .checkpoint_pages_per_sec = 4096,
+    };
+  }
   static auto Open(std::filesystem::path&& path, bool create_if_missing,
-      size_t max_buf_pages) -> Result<BPlusTreeStorage, io::Error> {
+      size_t max_buf_pages,
+      const PageManagerOptions& options = DefaultOptions())
+      -> Result<BPlusTreeStorage, io::Error> {
     if (!std::filesystem::exists(path)) {
       if (create_if_missing)
-        return Create(std::move(path), max_buf_pages);
+        return Create(std::move(path), max_buf_pages, options);
     }
-    auto pgm = EXTRACT_RESULT(PageManager::Open(path, max_buf_pages));
+    auto pgm = EXTRACT_RESULT(PageManager::Open(path, max_buf_pages, options));
     pgid_t meta;
     pgm->GetPlainPage(pgm->SuperPageID()).Read(&meta, 0, sizeof(meta));
     // Table B+Tree use StringKeyCompare by default.
@@ -316,11 +643,20 @@ class BPlusTreeStorage {
 
   auto GetRangeIterator(std::string_view table_name,
       std::tuple<std::string_view, bool, bool> L,
-      std::tuple<std::string_view, bool, bool> R)
+      std::tuple<std::string_view, bool, bool> R, bool reverse = false)
       -> std::unique_ptr<Iterator<const uint8_t*>> {
     return ApplyFuncOnTable<std::unique_ptr<Iterator<const uint8_t*>>>(
         GetPKType(table_name), GetTable(table_name),
-        [&L, &R](auto a) { return a->GetRangeIterator(L, R); });
+        [&L, &R, reverse](auto a) { return a->GetRangeIterator(L, R, reverse); });
+  }
+
+  auto GetRangeIterators(std::string_view table_name,
+      std::tuple<std::string_view, bool, bool> L,
+      std::tuple<std::string_view, bool, bool> R, size_t n)
+      -> std::vector<std::unique_ptr<Iterator<const uint8_t*>>> {
+    return ApplyFuncOnTable<std::vector<std::unique_ptr<Iterator<const uint8_t*>>>>(
+        GetPKType(table_name), GetTable(table_name),
+        [&L, &R, n](auto a) { return a->GetRangeIterators(L, R, n); });
   }
 
   std::unique_ptr<wing::ModifyHandle> GetModifyHandle(
@@ -361,9 +697,12 @@ class BPlusTreeStorage {
     };
     // Primary key type
     auto pk_type = schema.GetPrimaryKeySchema().type_;
-    if (pk_type == FieldType::INT32 || pk_type == FieldType::INT64) {
+    if (pk_type == FieldType::INT32) {
       auto tree = BPlusTree<IntegerKeyCompare>::Create(*pgm_);
       return create_func(std::move(tree));
+    } else if (pk_type == FieldType::INT64) {
+      auto tree = BPlusTree<Int64KeyCompare>::Create(*pgm_);
+      return create_func(std::move(tree));
     } else if (pk_type == FieldType::CHAR || pk_type == FieldType::VARCHAR) {
       auto tree = BPlusTree<StringKeyCompare>::Create(*pgm_);
       return create_func(std::move(tree));
@@ -409,6 +748,74 @@ class BPlusTreeStorage {
         [](auto a) { return a->GetTicks(); });
   }
   const DBSchema& GetDBSchema() const { return schema_; }
+  BufferPoolReport GetBufferPoolReport() const {
+    BufferPoolReport report;
+    report.capacity_pages = pgm_->MaxBufPages();
+    report.total = pgm_->GetStats();
+    for (const auto& [name, table] : cached_tables_)
+      report.tables.emplace_back(name, table->GetBufferPoolStats().Load());
+    std::sort(report.tables.begin(), report.tables.end(),
+        [](const auto& a, const auto& b) { return a.first < b.first; });
+    return report;
+  }
+  void SetMaxBufPages(size_t max_buf_pages) {
+    pgm_->SetMaxBufPages(max_buf_pages);
+  }
+  /* Compact the file online. The pages are moved to the front of the file in
+   * this order: the catalog, and then each table in name order, i.e., the
+   * B+tree of the table (see BPlusTree::CollectPages) and its schema. So the
+   * leaves of a table are contiguous and in key order, and range scans read
+   * the file sequentially again. The file is truncated afterwards.
+   *
+   * The caller should make sure that no one else accesses the storage
+   * meanwhile, and no iterator or handle is alive.
+   */
+  void Compact() {
+    std::vector<std::pair<std::string, TableMetaPages>> tables;
+    for (const auto& schema : schema_.GetTables()) {
+      std::string name(schema.GetName());
+      auto ret = map_table_name_to_meta_pages_.Get(name);
+      if (!ret)
+        DB_ERR("no such table");
+      // Open the table, so that the cached B+tree is updated too.
+      GetTable(name);
+      tables.emplace_back(std::move(name), TableMetaPages::from_bytes(*ret));
+    }
+    std::sort(tables.begin(), tables.end(),
+        [](const auto& a, const auto& b) { return a.first < b.first; });
+
+    std::vector<pgid_t> pages;
+    map_table_name_to_meta_pages_.CollectPages(pages);
+    for (auto& [name, meta] : tables) {
+      ApplyFuncOnTable<void>(GetPKType(name), GetTable(name),
+          [&pages](auto a) { a->tree_.CollectPages(pages); });
+      Blob::Open(*pgm_, meta.schema).CollectPages(pages);
+    }
+    std::vector<pgid_t> new_id(pgm_->PageNum(), 0);
+    for (size_t i = 0; i < pages.size(); ++i)
+      new_id[pages[i]] = i + 2;
+    auto remap = [&new_id](pgid_t pgid) { return new_id[pgid]; };
+
+    // The catalog is searched with the old page IDs, so it is remapped last.
+    for (auto& [name, meta] : tables) {
+      ApplyFuncOnTable<void>(GetPKType(name), GetTable(name),
+          [&remap](auto a) { a->tree_.RemapPages(remap); });
+      Blob::Open(*pgm_, meta.schema).RemapPages(remap);
+      TableMetaPages new_meta{
+          .data = remap(meta.data),
+          .schema = remap(meta.schema),
+      };
+      map_table_name_to_meta_pages_.Update(name,
+          std::string_view(
+              reinterpret_cast<const char*>(&new_meta), sizeof(new_meta)));
+    }
+    map_table_name_to_meta_pages_.RemapPages(remap);
+    pgid_t meta = map_table_name_to_meta_pages_.MetaPageID();
+    pgm_->GetPlainPage(pgm_->SuperPageID())
+        .Write(0, std::string_view(
+                      reinterpret_cast<const char*>(&meta), sizeof(meta)));
+    pgm_->Relocate(pages);
+  }
 
  private:
   BPlusTreeStorage(std::unique_ptr<PageManager> pgm,
@@ -416,9 +823,9 @@ class BPlusTreeStorage {
     : pgm_(std::move(pgm)),
       map_table_name_to_meta_pages_(std::move(map)),
       schema_(std::move(db_schema)) {}
-  static auto Create(std::filesystem::path path, size_t max_buf_pages)
-      -> BPlusTreeStorage {
-    auto pgm = PageManager::Create(path, max_buf_pages);
+  static auto Create(std::filesystem::path path, size_t max_buf_pages,
+      const PageManagerOptions& options) -> BPlusTreeStorage {
+    auto pgm = PageManager::Create(path, max_buf_pages, options);
     auto map = BPlusTree<StringKeyCompare>::Create(*pgm);
     pgid_t meta = map.MetaPageID();
     pgm->GetPlainPage(pgm->SuperPageID())
@@ -444,13 +851,20 @@ class BPlusTreeStorage {
     // Primary key type
     auto pk_type = schema.GetPrimaryKeySchema().type_;
     // For each primary key type, use the corresponding Open() function.
-    if (pk_type == FieldType::INT32 || pk_type == FieldType::INT64) {
+    if (pk_type == FieldType::INT32) {
       auto [it, succeed] = cached_tables_.emplace(std::string(table_name),
           std::make_unique<BPlusTreeTable<IntegerKeyCompare>>(std::move(schema),
               BPlusTree<IntegerKeyCompare>::Open(*pgm_, meta.data)));
       if (!succeed)
         DB_ERR("Concurrency issue?");
       return it->second.get();
+    } else if (pk_type == FieldType::INT64) {
+      auto [it, succeed] = cached_tables_.emplace(std::string(table_name),
+          std::make_unique<BPlusTreeTable<Int64KeyCompare>>(std::move(schema),
+              BPlusTree<Int64KeyCompare>::Open(*pgm_, meta.data)));
+      if (!succeed)
+        DB_ERR("Concurrency issue?");
+      return it->second.get();
     } else if (pk_type == FieldType::CHAR || pk_type == FieldType::VARCHAR) {
       auto [it, succeed] = cached_tables_.emplace(std::string(table_name),
           std::make_unique<BPlusTreeTable<StringKeyCompare>>(std::move(schema),
@@ -478,9 +892,12 @@ class BPlusTreeStorage {
   template <typename RetType, typename F>
   RetType ApplyFuncOnTable(
       FieldType type, AbstractBPlusTreeTable* tree, F&& func) {
-    if (type == FieldType::INT32 || type == FieldType::INT64) {
+    if (type == FieldType::INT32) {
       auto t_tree = static_cast<BPlusTreeTable<IntegerKeyCompare>*>(tree);
       return func(t_tree);
+    } else if (type == FieldType::INT64) {
+      auto t_tree = static_cast<BPlusTreeTable<Int64KeyCompare>*>(tree);
+      return func(t_tree);
     } else if (type == FieldType::CHAR || type == FieldType::VARCHAR) {
       auto t_tree = static_cast<BPlusTreeTable<StringKeyCompare>*>(tree);
       return func(t_tree);
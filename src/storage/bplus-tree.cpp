@@ -4,14 +4,21 @@ namespace wing {
 
 InnerSlot InnerSlotParse(std::string_view data) {
 	InnerSlot res;
-	pgoff_t keylen=data.size()-sizeof(pgid_t);
+	constexpr size_t head=sizeof(pgid_t)+sizeof(uint64_t)+sizeof(pgoff_t);
+	pgoff_t keylen=*(pgoff_t*)(data.data()+sizeof(pgid_t)+sizeof(uint64_t));
 	res.next=*(pgid_t*)data.data();
-	res.strict_upper_bound=std::string_view(data.data()+sizeof(pgid_t),keylen);
+	res.count=*(uint64_t*)(data.data()+sizeof(pgid_t));
+	res.strict_upper_bound=std::string_view(data.data()+head,keylen);
 	return res;
 }
 void InnerSlotSerialize(char *s, InnerSlot slot) {
+	pgoff_t keylen=slot.strict_upper_bound.size();
+	constexpr size_t head=sizeof(pgid_t)+sizeof(uint64_t)+sizeof(pgoff_t);
 	*(pgid_t*)s=slot.next;
-	memcpy(s+sizeof(pgid_t),slot.strict_upper_bound.data(),slot.strict_upper_bound.size());
+	*(uint64_t*)(s+sizeof(pgid_t))=slot.count;
+	*(pgoff_t*)(s+sizeof(pgid_t)+sizeof(uint64_t))=keylen;
+	memcpy(s+head,slot.strict_upper_bound.data(),keylen);
+	memset(s+head+keylen,0,InnerSlotSize(slot)-head-keylen);
 }
 
 LeafSlot LeafSlotParse(std::string_view data) {
@@ -3,12 +3,18 @@
 
 #include "common/logging.hpp"
 
+#include <atomic>
 #include <cassert>
 #include <filesystem>
+#include <algorithm>
+#include <functional>
+#include <memory>
 #include <optional>
 #include <stack>
+#include <type_traits>
 #include <vector>
 #include <iostream>
+#include <mutex>
 #include <shared_mutex>
 
 #include "page-manager.hpp"
@@ -30,11 +36,13 @@ namespace wing {
  * 8          8         Number of tuples (i.e., KV pairs)
  *-----------------------------------------------------------------------------
  * Inner page:
- * next_0 key_0 next_1 key_1 next_2 ... next_{n-1} key_{n-1} next_n
- * ^^^^^^^^^^^^ ^^^^^^^^^^^^            ^^^^^^^^^^^^^^^^^^^^ ^^^^^^
- *    Slot_0       Slot_1                    Slot_{n-1}      Special
- * Note that the lengths of keys are omitted in slots because they can be
- * deduced with the lengths of slots.
+ * next_0 count_0 len(key_0) key_0 pad_0 ... next_n count_n
+ * ^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^     ^^^^^^^^^^^^^^
+ *                Slot_0                         Special
+ * count_i is the number of tuples in the subtree of next_i, which is 8 bytes.
+ * The type of len(key) is pgoff_t. Slots are padded with zeros to multiples of
+ * 8 bytes, and the special space is 12 bytes, so every count_i is aligned and
+ * can be updated atomically.
  *-----------------------------------------------------------------------------
  * Leaf page:
  * len(key_0) key_0 value_0 len(key_1) key_1 value_1 ...
@@ -47,12 +55,16 @@ namespace wing {
  * The type of len(key) is pgoff_t. Note that the lengths of values are omitted
  * in slots because they can be deduced with the lengths of slots:
  *     len(value_i) = len(Slot_i) - sizeof(pgoff_t) - len(key_i)
+ * If Compare has a static member KEY_SIZE, all keys are KEY_SIZE bytes, and
+ * len(key) is omitted as well, i.e., Slot_i is key_i value_i.
  */
 
 // Parsed inner slot.
 struct InnerSlot {
   // The child in this slot. See the layout of inner page above.
   pgid_t next;
+  // The number of tuples in the subtree of child.
+  uint64_t count;
   // The strict upper bound of the keys in the corresponding subtree of child.
   // i.e., all keys in the corresponding subtree of child < "strict_upper_bound"
   std::string_view strict_upper_bound;
@@ -62,7 +74,9 @@ InnerSlot InnerSlotParse(std::string_view slot);
 // The size of the inner slot in on-disk format. In other words, the size of
 // serialized inner slot using InnerSlotSerialize below.
 static inline size_t InnerSlotSize(InnerSlot slot) {
-  return sizeof(pgid_t) + slot.strict_upper_bound.size();
+  size_t size = sizeof(pgid_t) + sizeof(uint64_t) + sizeof(pgoff_t) +
+    slot.strict_upper_bound.size();
+  return (size + alignof(uint64_t) - 1) / alignof(uint64_t) * alignof(uint64_t);
 }
 // Convert/Serialize the parsed inner slot to on-disk format and write it to
 // the memory area starting with "addr".
@@ -108,6 +122,9 @@ class BPlusTree {
   class LeafSlotKeyCompare;
   class LeafSlotCompare;
   using LeafPage = SortedPage<LeafSlotKeyCompare, LeafSlotCompare>;
+  class InnerSlotKeyCompare;
+  class InnerSlotCompare;
+  using InnerPage = SortedPage<InnerSlotKeyCompare, InnerSlotCompare>;
  public:
   class Iter {
    public:
@@ -115,18 +132,22 @@ class BPlusTree {
     Iter& operator=(const Iter&) = delete;
     Iter(Iter&& iter):pg(std::move(iter.pg)) {
       //DB_ERR("Not implemented!");
-      mxid_=iter.mxid_;now=iter.now;
+      mxid_=iter.mxid_;mnid_=iter.mnid_;now=iter.now;
       is_empty=iter.is_empty;
-      hhh=iter.hhh;hh=iter.hh;
+      hhh=iter.hhh;hh=iter.hh;meta_=iter.meta_;
+      ring_=std::move(iter.ring_);
+      MoveReadAhead(iter);
       iter.hhh=nullptr;iter.hh=nullptr;
     }
-    Iter(std::reference_wrapper<PageManager> *hhh_,Compare *hh_):hhh(hhh_),hh(hh_),pg(std::move((*hhh_).get().GetSortedPage(0,LeafSlotKeyCompare((*hh_)),LeafSlotCompare((*hh_))))) { is_empty=true; }
+    Iter(std::reference_wrapper<PageManager> *hhh_,Compare *hh_,pgid_t meta):hhh(hhh_),hh(hh_),pg(std::move((*hhh_).get().GetSortedPage(0,LeafSlotKeyCompare((*hh_)),LeafSlotCompare((*hh_))))),meta_(meta) { is_empty=true; }
     Iter& operator=(Iter&& iter) {
       //DB_ERR("Not implemented!");
-      mxid_=iter.mxid_;now=iter.now;
+      mxid_=iter.mxid_;mnid_=iter.mnid_;now=iter.now;
       is_empty=iter.is_empty;
       hhh=iter.hhh;hh=iter.hh;
-      pg=std::move(iter.pg);
+      pg=std::move(iter.pg);meta_=iter.meta_;
+      ring_=std::move(iter.ring_);
+      MoveReadAhead(iter);
       iter.hhh=nullptr;iter.hh=nullptr;
       return *this;
     }
@@ -136,8 +157,15 @@ class BPlusTree {
       leaf.Init(sizeof(pgid_t)*2);
       return leaf;
     }
-    inline LeafPage GetLeafPage(pgid_t pgid) { return (*hhh).get().GetSortedPage(pgid,LeafSlotKeyCompare((*hh)),LeafSlotCompare((*hh))); }
+    inline LeafPage GetLeafPage(pgid_t pgid) {
+      if (ring_) return (*hhh).get().GetSortedPage(pgid,LeafSlotKeyCompare((*hh)),LeafSlotCompare((*hh)),*ring_);
+      return (*hhh).get().GetSortedPage(pgid,LeafSlotKeyCompare((*hh)),LeafSlotCompare((*hh)));
+    }
+    // The following leaf pages are read through a ScanRing, so that scanning
+    // a large tree does not flush the buffer pool.
+    void UseScanRing() { ring_=std::make_unique<ScanRing>(); }
     inline pgid_t GetLeafNext(LeafPage& leaf) { return *(pgid_t *)leaf.ReadSpecial(sizeof(pgid_t),sizeof(pgid_t)).data(); }
+    inline pgid_t GetLeafPrev(LeafPage& leaf) { return *(pgid_t *)leaf.ReadSpecial(0,sizeof(pgid_t)).data(); }
     // Returns the current key-value pair that this iterator currently points
     // to. If this iterator does not point to any key-value pair, then return
     // std::nullopt. The first std::string_view is the key and the second
@@ -147,38 +175,192 @@ class BPlusTree {
       LeafSlot slot=LeafSlotParse(pg.Slot(now));
       return std::pair<std::string_view,std::string_view>(slot.key,slot.value);
     }
+    // Keys >= "end" (or > "end" if "inclusive") will not be read, so the
+    // read-ahead stops before the leaves holding them.
+    void SetReadAheadEnd(std::string_view end,bool inclusive) {
+      ra_end_=std::string(end);ra_end_inclusive_=inclusive;
+    }
     void Next() {
       if (now<pg.SlotNum()-1) now++;
       else
       {
         if (pg.ID()==mxid_) is_empty=true;
-        else pg=GetLeafPage(GetLeafNext(pg)),now=0;
+        else
+        {
+          pgid_t nxt=GetLeafNext(pg);
+          ReadAhead();
+          pg=GetLeafPage(nxt),now=0;
+        }
+      }
+    }
+    // Move to the previous key-value pair. Leaves are not read ahead
+    // backwards.
+    void Prev() {
+      if (now>0) now--;
+      else
+      {
+        if (pg.ID()==mnid_) is_empty=true;
+        else
+        {
+          pgid_t pre=GetLeafPrev(pg);
+          pg=GetLeafPage(pre),now=pg.SlotNum()-1;
+        }
       }
     }
     LeafPage pg;
-    pgid_t mxid_;slotid_t now;
+    // The largest and the smallest leaf.
+    pgid_t mxid_,mnid_;slotid_t now;
     bool is_empty;
     std::reference_wrapper<PageManager> *hhh;
     Compare *hh;
    private:
+    /* Leaf read-ahead. A leaf only knows its neighbours, so the leaves to
+     * prefetch are found from the inner pages instead. ra_path_[i] is the
+     * inner page at level i+1 on the path to the last leaf prefetched, along
+     * with the index of its next child to prefetch. It is built when the
+     * iterator moves to the next leaf for the first time, i.e., the access
+     * turns out to be sequential.
+     *
+     * ra_ahead_ leaves after the current one have been prefetched. When it
+     * drops to half of the window, the window doubles and is filled again, so
+     * that a short scan only prefetches a few leaves, and a long scan keeps
+     * up to RA_MAX_WINDOW reads in flight.
+     */
+    static constexpr size_t RA_INIT_WINDOW=4;
+    static constexpr size_t RA_MAX_WINDOW=64;
+    struct ReadAheadPos { pgid_t pgid;slotid_t next; };
+    void ReadAhead() {
+      if (ra_done_) return;
+      if (ra_window_==0)
+      {
+        if (!InitReadAhead()) { ra_done_=true;return; }
+      }
+      // The next leaf has been prefetched, or is read right after this.
+      if (ra_ahead_>0) ra_ahead_--;
+      else if (!NextLeafToPrefetch().has_value()) { ra_done_=true;return; }
+      if (ra_ahead_>ra_window_/2) return;
+      PageManager& pgm=(*hhh).get();
+      if (ra_ahead_>0)
+      {
+        // Prefetched leaves should not be evicted before being read.
+        size_t mx=RA_MAX_WINDOW;
+        if (!pgm.IsReadOnlyMapped())
+        {
+          mx=std::min(mx,std::max<size_t>(pgm.MaxBufPages()/8,1));
+          if (ring_) mx=std::min(mx,ScanRing::SIZE/2);
+        }
+        ra_window_=std::min(ra_window_*2,mx);
+      }
+      std::vector<pgid_t> pgids;
+      while (ra_ahead_<ra_window_)
+      {
+        auto leaf=NextLeafToPrefetch();
+        if (!leaf.has_value()) { ra_done_=true;break; }
+        pgids.push_back(leaf.value());ra_ahead_++;
+      }
+      if (!pgids.empty()) pgm.PrefetchPages(pgids,ring_.get());
+    }
+    // Build ra_path_ for the current leaf. Return false if there is nothing
+    // to prefetch.
+    bool InitReadAhead() {
+      PageManager& pgm=(*hhh).get();
+      if (!pgm.CanPrefetch()||pg.SlotNum()==0) return false;
+      auto meta=pgm.GetPlainPage(meta_);
+      uint8_t level=meta.Read(0,1)[0];
+      pgid_t cur=*(pgid_t *)meta.Read(4,sizeof(pgid_t)).data();
+      if (level==0) return false;
+      std::string_view key=LeafSlotParse(pg.Slot(0)).key;
+      ra_path_.resize(level);
+      for (uint8_t i=level;i;i--)
+      {
+        auto inner=GetInnerPage(cur);
+        slotid_t id=inner.UpperBound(key);
+        ra_path_[i-1]=ReadAheadPos{cur,(slotid_t)(id+1)};
+        cur=InnerChild(inner,id);
+      }
+      // Modified concurrently. Just give up.
+      if (cur!=pg.ID()) return false;
+      ra_window_=RA_INIT_WINDOW;
+      return true;
+    }
+    // Advance ra_path_ to the next leaf and return it. Return std::nullopt if
+    // there is no more leaf, or the next leaf is beyond the end key.
+    std::optional<pgid_t> NextLeafToPrefetch() {
+      size_t i=0;
+      while (i<ra_path_.size()&&ra_path_[i].next>GetInnerPage(ra_path_[i].pgid).SlotNum()) i++;
+      if (i==ra_path_.size()) return std::nullopt;
+      for (;;)
+      {
+        auto inner=GetInnerPage(ra_path_[i].pgid);
+        slotid_t id=ra_path_[i].next++;
+        // All keys in the child >= the strict upper bound of the previous one.
+        if (id>0&&ra_end_.has_value())
+        {
+          auto cmp=(*hh)(InnerSlotParse(inner.Slot(id-1)).strict_upper_bound,ra_end_.value());
+          if (cmp>0||(cmp==0&&!ra_end_inclusive_)) return std::nullopt;
+        }
+        pgid_t child=InnerChild(inner,id);
+        if (i==0) return child;
+        ra_path_[--i]=ReadAheadPos{child,0};
+      }
+    }
+    // InnerPage is not declared yet.
+    inline auto GetInnerPage(pgid_t pgid) {
+      return (*hhh).get().GetSortedPage(pgid,InnerSlotKeyCompare((*hh)),InnerSlotCompare((*hh)));
+    }
+    inline pgid_t InnerChild(const auto& inner,slotid_t id) {
+      if (id<inner.SlotNum()) return InnerSlotParse(inner.Slot(id)).next;
+      return *(pgid_t *)inner.ReadSpecial(0,sizeof(pgid_t)).data();
+    }
+    void MoveReadAhead(Iter& iter) {
+      ra_path_=std::move(iter.ra_path_);
+      ra_ahead_=iter.ra_ahead_;ra_window_=iter.ra_window_;ra_done_=iter.ra_done_;
+      ra_end_=std::move(iter.ra_end_);ra_end_inclusive_=iter.ra_end_inclusive_;
+    }
+    pgid_t meta_;
+    std::unique_ptr<ScanRing> ring_;
+    std::vector<ReadAheadPos> ra_path_;
+    size_t ra_ahead_=0;
+    // 0 if the read-ahead has not started.
+    size_t ra_window_=0;
+    bool ra_done_=false;
+    std::optional<std::string> ra_end_;
+    bool ra_end_inclusive_=false;
   };
   BPlusTree(const Self&)=delete;
   Self& operator=(const Self&)=delete;
-  BPlusTree(Self&& rhs):pgm_(rhs.pgm_),meta_pgid_(rhs.meta_pgid_),comp_(rhs.comp_) {}
+  BPlusTree(Self&& rhs):pgm_(rhs.pgm_),meta_pgid_(rhs.meta_pgid_),comp_(rhs.comp_),min_fill_(rhs.min_fill_),meta_(std::move(rhs.meta_)) {}
   Self& operator=(Self&& rhs) {
     pgm_=std::move(rhs.pgm_);
     meta_pgid_=rhs.meta_pgid_;
-    comp_=rhs.comp_;
+    comp_=rhs.comp_;min_fill_=rhs.min_fill_;
+    meta_=std::move(rhs.meta_);
     return *this;
   }
   ~BPlusTree() {}
   static Self Create(std::reference_wrapper<PageManager> pgm) {
-    Self ret(pgm,pgm.get().Allocate(),Compare());
-    ret.UpdateTupleNum(0);
+    pgid_t meta_pgid=pgm.get().Allocate();
+    // The page may be reused. The root is 0 if and only if the tree is empty.
+    char zeros[16]={};
+    pgm.get().GetPlainPage(meta_pgid).Write(0,std::string_view(zeros,sizeof(zeros)));
+    return Self(pgm,meta_pgid,Compare());
+  }
+  static Self Open(std::reference_wrapper<PageManager> pgm,pgid_t meta_pgid) {
+    Self ret(pgm,meta_pgid,Compare());
+    // The tuple number on the meta page may be stale, see SyncTupleNum. The
+    // counts in the root are exact.
+    pgid_t root=ret.Root();
+    ret.meta_->tuple_num=root==0?0:ret.SubtreeCount(root,ret.LevelNum());
     return ret;
   }
-  static Self Open(std::reference_wrapper<PageManager> pgm,pgid_t meta_pgid) { return Self(pgm,meta_pgid,Compare()); }
   inline pgid_t MetaPageID() const { return meta_pgid_; }
+  /* A non-root page is underfull if less than "min_fill" of its slot space is
+   * used. After deleting from it, it is merged with or borrows from a sibling.
+   * 0 disables merging, and then only empty leaves are freed.
+   */
+  static constexpr double DEFAULT_MIN_FILL=0.25;
+  void SetMinFill(double min_fill) { min_fill_=min_fill; }
+  double GetMinFill() const { return min_fill_; }
   void dfs(pgid_t x,uint8_t y)
   {
     if (!y)
@@ -198,10 +380,149 @@ class BPlusTree {
     FreePage(std::move(meta));
   }
   inline bool IsEmpty() { return !TupleNum(); }
+  // Append the pages of the tree to "pages" in the order they should be laid
+  // out on disk: the meta page, the inner pages level by level, and then the
+  // leaves. Each level is in key order, so the leaf chain becomes sequential.
+  void CollectPages(std::vector<pgid_t>& pages) {
+    std::lock_guard<std::shared_mutex> lock(smo_latch_);
+    pages.push_back(meta_pgid_);
+    if (IsEmpty()) return;
+    std::vector<pgid_t> now{Root()};
+    for (uint8_t i=LevelNum();;i--)
+    {
+      pages.insert(pages.end(),now.begin(),now.end());
+      if (!i) break;
+      now=Children(now);
+    }
+  }
+  // Before the pages are moved by PageManager::Relocate, update the page IDs
+  // stored in the pages of the tree. "remap" maps an old page ID to the new
+  // one. The leaf chain is rebuilt in key order.
+  void RemapPages(const std::function<pgid_t(pgid_t)>& remap) {
+    auto lock=LockSMO();
+    if (IsEmpty()) UpdateRoot(0);
+    else
+    {
+      std::vector<pgid_t> now{Root()};
+      UpdateRoot(remap(Root()));
+      for (uint8_t i=LevelNum();i;i--)
+      {
+        auto nxt=Children(now);
+        for (pgid_t x:now)
+        {
+          auto inner=GetInnerPage(x);
+          for (slotid_t j=0;j<inner.SlotNum();j++)
+          {
+            std::string slot(inner.Slot(j));
+            *(pgid_t *)slot.data()=remap(*(pgid_t *)slot.data());
+            inner.Replace(j,slot);
+          }
+          SetInnerSpecial(inner,remap(GetInnerSpecial(inner)));
+        }
+        now=std::move(nxt);
+      }
+      for (size_t j=0;j<now.size();j++)
+      {
+        auto leaf=GetLeafPage(now[j]);
+        SetLeafPrev(leaf,j?remap(now[j-1]):0);
+        SetLeafNext(leaf,j+1<now.size()?remap(now[j+1]):0);
+      }
+    }
+    meta_pgid_=remap(meta_pgid_);
+  }
+  /* Build the tree bottom-up from the (key, value) pairs in [first, last),
+   * which should be sorted by key without duplicate keys. The tree should be
+   * empty. The leaves are filled up to "fill_factor" of a page and allocated
+   * one after another in key order, and then the inner levels are built in
+   * the same way level by level, so no page is split.
+   */
+  template <typename It>
+  void BulkLoad(It first,It last,double fill_factor=1.0)
+  {
+    auto lock=LockSMO();
+    if (!IsEmpty()) DB_ERR("Bulk loading a non-empty B+tree");
+    if (first==last) return;
+    // (page, smallest key) of the pages in the current level, and the numbers
+    // of tuples in their subtrees.
+    std::vector<std::pair<pgid_t,std::string> > now;
+    std::vector<uint64_t> counts;
+    size_t num=0;
+    {
+      size_t budget=PageBudget(sizeof(pgid_t)*2,fill_factor),used=0;
+      std::optional<LeafPage> leaf;
+      std::string slot;
+      std::string_view last_key;
+      for (;first!=last;++first)
+      {
+        LeafSlot hh;hh.key=first->first;hh.value=first->second;
+        assert(!leaf||comp_(LeafLargestKey(*leaf),hh.key)<0);
+        slot.resize(LeafSlotSize(hh));
+        LeafSlotSerialize(slot.data(),hh);
+        size_t need=slot.size()+LeafPage::SLOT_OVERHEAD;
+        if (!leaf||(used+need>budget||!leaf->IsInsertable(slot)))
+        {
+          auto nxt=AllocLeafPage();
+          SetLeafPrev(nxt,leaf?leaf->ID():0);
+          if (leaf) SetLeafNext(*leaf,nxt.ID());
+          now.emplace_back(nxt.ID(),std::string(leaf?Separator(last_key,hh.key):hh.key));
+          counts.push_back(0);
+          leaf.emplace(std::move(nxt));used=0;
+        }
+        leaf->AppendSlotUnchecked(slot);
+        used+=need;num++;counts.back()++;last_key=hh.key;
+      }
+      SetLeafNext(*leaf,0);
+    }
+    uint8_t level=0;
+    while (now.size()>1)
+    {
+      // The first child of an inner page takes no slot space.
+      std::vector<size_t> starts{0};
+      size_t budget=PageBudget(INNER_SPECIAL_SIZE,fill_factor),used=0;
+      for (size_t i=1;i<now.size();i++)
+      {
+        size_t need=InnerSlotSize({now[i].first,0,now[i].second})+InnerPage::SLOT_OVERHEAD;
+        if (i-starts.back()>=2&&used+need>budget) { starts.push_back(i);used=0; }
+        else used+=need;
+      }
+      // An inner page has at least two children.
+      if (starts.size()>1&&now.size()-starts.back()==1)
+      {
+        if (starts.back()-starts[starts.size()-2]>2) starts.back()--;
+        else starts.pop_back();
+      }
+      starts.push_back(now.size());
+      std::vector<std::pair<pgid_t,std::string> > nxt;
+      std::vector<uint64_t> nxt_counts;
+      for (size_t j=0;j+1<starts.size();j++)
+      {
+        auto inner=AllocInnerPage();
+        uint64_t count=0;
+        for (size_t i=starts[j];i+1<starts[j+1];i++)
+        {
+          InnerSlot hh;hh.next=now[i].first;hh.count=counts[i];hh.strict_upper_bound=now[i+1].second;
+          std::string slot(InnerSlotSize(hh),0);
+          InnerSlotSerialize(slot.data(),hh);
+          inner.AppendSlotUnchecked(slot);
+          count+=counts[i];
+        }
+        SetInnerSpecial(inner,now[starts[j+1]-1].first,counts[starts[j+1]-1]);
+        count+=counts[starts[j+1]-1];
+        nxt.emplace_back(inner.ID(),std::move(now[starts[j]].second));
+        nxt_counts.push_back(count);
+      }
+      now=std::move(nxt);counts=std::move(nxt_counts);level++;
+    }
+    // Optimistic readers see the new tree all at once.
+    PageWriteSet ws;
+    UpdateLevelNum(level);UpdateRoot(now[0].first);
+    IncreaseTupleNum(num);
+  }
   bool work1(std::string_view key,std::string_view value,bool bo)
   {
     LeafSlot hh;hh.key=key;hh.value=value;
-    std::string_view hhh=gao2(hh);
+    std::string hhh(LeafSlotSize(hh),0);
+    LeafSlotSerialize(hhh.data(),hh);
     if (IsEmpty())
     {
       if (bo) return false;
@@ -225,7 +546,7 @@ class BPlusTree {
     if (!bo)
     {
       if (id[0]>now.SlotNum()) return false;
-      IncreaseTupleNum(1);
+      IncreaseTupleNum(1);AddPathCount(fa,id,level,1);
       if (now.IsInsertable(hhh)) { now.InsertBeforeSlot(id[0],hhh);return true; }
     }
     else
@@ -236,7 +557,8 @@ class BPlusTree {
     auto right=AllocLeafPage();
     if (!bo) now.SplitInsert(right,id[0],hhh);
     else now.SplitReplace(right,id[0],hhh);
-    std::string_view y=LeafSmallestKey(right);
+    std::string_view y=Separator(LeafLargestKey(now),LeafSmallestKey(right));
+    std::string sep;
     pgid_t Right=right.ID();
     bool flag=true;
     if (level!=0&&now.ID()!=LargestLeaf(GetInnerPage(Root()),level))
@@ -247,35 +569,118 @@ class BPlusTree {
     SetLeafNext(now,Right);SetLeafPrev(right,now.ID());
     for (uint8_t i=1;i<=level;i++)
     {
+      // The child fa[i-1] has been split into itself and Right.
+      uint64_t cl=SubtreeCount(fa[i-1],i-1),cr=SubtreeCount(Right,i-1);
       auto now=GetInnerPage(fa[i]),right=AllocInnerPage();
-      if (id[i]==now.SlotNum()) SetInnerSpecial(now,Right);
+      if (id[i]==now.SlotNum()) SetInnerSpecial(now,Right,cr);
       else
       {
-        InnerSlot h2=InnerSlotParse(now.Slot(id[i]));h2.next=Right;
+        InnerSlot h2=InnerSlotParse(now.Slot(id[i]));h2.next=Right;h2.count=cr;
         now.Replace(id[i],gao1(h2));
       }
-      InnerSlot h1;h1.next=fa[i-1];h1.strict_upper_bound=y;
+      InnerSlot h1;h1.next=fa[i-1];h1.count=cl;h1.strict_upper_bound=y;
       now.SplitInsert(right,id[i],gao1(h1));
       if (right.SlotNum()==0) { flag=false;FreePage(std::move(right));break; }
-      SetInnerSpecial(right,GetInnerSpecial(now));
-      SetInnerSpecial(now,InnerSlotParse(right.Slot(0)).next);
-      right.DeleteSlot(0);y=InnerSmallestKey(right,i);
+      SetInnerSpecial(right,GetInnerSpecial(now),GetInnerSpecialCount(now));
+      // The bound of the moved-up slot separates the two pages, and it is
+      // usually much shorter than the smallest key of the right one.
+      InnerSlot up=InnerSlotParse(right.Slot(0));
+      SetInnerSpecial(now,up.next,up.count);
+      sep=up.strict_upper_bound;y=sep;
+      right.DeleteSlot(0);
       Right=right.ID();
     }
     if (flag)
     {
       UpdateLevelNum(level+1);
       auto Root=AllocInnerPage();
-      InnerSlot h1;h1.next=fa[level];h1.strict_upper_bound=y;
+      InnerSlot h1;h1.next=fa[level];h1.count=SubtreeCount(fa[level],level);h1.strict_upper_bound=y;
       Root.AppendSlotUnchecked(gao1(h1));
-      SetInnerSpecial(Root,Right);
+      SetInnerSpecial(Root,Right,SubtreeCount(Right,level));
       UpdateRoot(Root.ID());
       level++;
     }
     return true;
   }
-  inline bool Insert(std::string_view key,std::string_view value) { std::unique_lock<std::shared_mutex> lock(latch_);return work1(key,value,0); }
-  inline bool Update(std::string_view key,std::string_view value) { std::unique_lock<std::shared_mutex> lock(latch_);return work1(key,value,1); }
+  /* Insert, Update and Delete modify the leaf in place if they can, latching
+   * only the leaf. Otherwise they split or merge pages in work1/work2, which
+   * are serialized by smo_latch_ and latch the pages they touch in a
+   * PageWriteSet. Get latches nothing. See PageLatch.
+   */
+  inline bool Insert(std::string_view key,std::string_view value) {
+    auto res=FastWrite(key,value,0);
+    if (res.has_value()) return res.value();
+    auto lock=LockSMO();PageWriteSet ws;
+    return work1(key,value,0);
+  }
+  inline bool Update(std::string_view key,std::string_view value) {
+    auto res=FastWrite(key,value,1);
+    if (res.has_value()) return res.value();
+    auto lock=LockSMO();PageWriteSet ws;
+    return work1(key,value,1);
+  }
+  /* Insert the (key, value) pairs in [first, last), which should be sorted by
+   * key, until a key already exists. Return the number of inserted pairs,
+   * i.e., [first, first + returned value) are inserted.
+   * The pairs falling into the same leaf are inserted with one descent and
+   * one pin of the leaf. If the leaf is full, the pair is inserted by work1,
+   * which splits the leaf, and the rest go on from a new descent.
+   */
+  template <typename It>
+  size_t InsertSorted(It first,It last)
+  {
+    size_t n=0;
+    std::string slot;
+    while (first!=last)
+    {
+      auto lock=LockSMO();PageWriteSet ws;
+      if (IsEmpty())
+      {
+        work1(first->first,first->second,0);
+        ++first;n++;continue;
+      }
+      // The keys smaller than "bound" fall into the same leaf.
+      std::optional<std::string> bound;
+      uint8_t level=LevelNum();
+      pgid_t fa[level+1];slotid_t ids[level+1];
+      fa[level]=Root();
+      for (uint8_t i=level;i;i--)
+      {
+        auto now=GetInnerPage(fa[i]);slotid_t id=now.UpperBound(first->first);ids[i]=id;
+        if (id<now.SlotNum())
+        {
+          InnerSlot hh=InnerSlotParse(now.Slot(id));
+          if (!bound||comp_(hh.strict_upper_bound,*bound)<0) bound=std::string(hh.strict_upper_bound);
+          fa[i-1]=hh.next;
+        }
+        else fa[i-1]=InnerLastPage(now);
+      }
+      bool full=false;
+      {
+        auto now=GetLeafPage(fa[0]);
+        size_t cnt=0;
+        for (;first!=last&&(!bound||comp_(first->first,*bound)<0);++first,cnt++)
+        {
+          slotid_t id=now.Find1(first->first);
+          if (id>now.SlotNum()) { IncreaseTupleNum(cnt);AddPathCount(fa,ids,level,cnt);return n+cnt; }
+          LeafSlot hh;hh.key=first->first;hh.value=first->second;
+          slot.resize(LeafSlotSize(hh));
+          LeafSlotSerialize(slot.data(),hh);
+          if (!now.IsInsertable(slot)) { full=true;break; }
+          now.InsertBeforeSlot(id,slot);
+        }
+        // The leaf is latched until "ws" is destroyed, so no one sees the
+        // slots before the tuple number is increased.
+        IncreaseTupleNum(cnt);AddPathCount(fa,ids,level,cnt);n+=cnt;
+      }
+      if (full)
+      {
+        work1(first->first,first->second,0);
+        ++first;n++;
+      }
+    }
+    return n;
+  }
   std::optional<std::string> MaxKey() {
     if (IsEmpty()) return std::nullopt;
     pgid_t Now=Root();
@@ -284,21 +689,32 @@ class BPlusTree {
     return std::basic_string(str.data(),str.size());
   }
   std::optional<std::string> Get(std::string_view key) {
-    std::shared_lock<std::shared_mutex> lock(latch_);
-    if (IsEmpty()) return std::nullopt;
-    pgid_t Now=Root();
-    for (uint8_t i=LevelNum();i;i--)
+    std::string res;
+    if (!Get(key,res)) return std::nullopt;
+    return res;
+  }
+  /* Copy the value of "key" into "value" and return true if "key" exists.
+   * The buffer of "value" is reused, so looking up with the same "value" again
+   * and again allocates nothing once it is large enough. A view of the leaf
+   * would not do, since the leaf may be changed by writers at any time.
+   */
+  bool Get(std::string_view key,std::string& value) {
+    for (;;)
     {
-      auto now=GetInnerPage(Now);
-      slotid_t id=now.UpperBound(key);
-      if (id<now.SlotNum()) Now=InnerSlotParse(now.Slot(id)).next;
-      else Now=InnerLastPage(now);
+      auto path=FindLeaf(key);
+      if (!path.has_value()) return false;
+      auto& now=path->leaf;
+      slotid_t id=now.Find(key);
+      bool res=false;
+      if (id<now.SlotNum())
+      {
+        std::string_view str=LeafSlotParse(now.Slot(id)).value;
+        // The length may be garbage before validation.
+        if (!now.Latch().Validate(path->version)) continue;
+        value.assign(str.data(),str.size());res=true;
+      }
+      if (now.Latch().Validate(path->version)) return res;
     }
-    auto now=GetLeafPage(Now);
-    slotid_t id=now.Find(key);
-    if (id==now.SlotNum()) return std::nullopt;
-    std::string_view str=LeafSlotParse(now.Slot(id)).value;
-    return std::basic_string(str.data(),str.size());
   }
   #define pii std::pair<bool,std::optional<std::string> >
   pii work2(std::string_view key) {
@@ -320,13 +736,14 @@ class BPlusTree {
     if (id==Now.SlotNum()) return pii(false,std::nullopt);
     std::string_view str=LeafSlotParse(Now.Slot(id)).value;
     pii res(true,std::basic_string(str.data(),str.size()));
-    Now.DeleteSlot(id);IncreaseTupleNum(-1);
+    Now.DeleteSlot(id);IncreaseTupleNum(-1);AddPathCount(fa,ID,level,-1);
     if (id>0) return res;
     std::string_view y;pgid_t Right=0;
     int flag=0;
     if (Now.SlotNum()==0) 
     {
       flag=1;
+      if (level==0) UpdateRoot(0);
       if (level!=0&&now!=SmallestLeaf(GetInnerPage(Root()),level)&&now!=LargestLeaf(GetInnerPage(Root()),level))
       {
         pgid_t hh1=GetLeafPrev(Now),hh2=GetLeafNext(Now);
@@ -350,9 +767,9 @@ class BPlusTree {
           else
           {
             flag=2;
-            SetInnerSpecial(right,GetInnerSpecial(Now));
-            Right=InnerSlotParse(right.Slot(0)).next;
-            SetInnerSpecial(Now,Right);
+            SetInnerSpecial(right,GetInnerSpecial(Now),GetInnerSpecialCount(Now));
+            InnerSlot up=InnerSlotParse(right.Slot(0));
+            SetInnerSpecial(Now,up.next,up.count);
             right.DeleteSlot(0);
             y=InnerSmallestKey(right,i);
             Right=right.ID();
@@ -383,29 +800,31 @@ class BPlusTree {
           {
             flag=0;
             slotid_t n=Now.SlotNum();
-            pgid_t nxt=InnerSlotParse(Now.Slot(n-1)).next;
+            InnerSlot last=InnerSlotParse(Now.Slot(n-1));
+            SetInnerSpecial(Now,last.next,last.count);
             Now.DeleteSlot(n-1);
-            SetInnerSpecial(Now,nxt);
             y=InnerSmallestKey(Now,i);
           }
         }
       }
       else
       {
+        // The child fa[i-1] has been split into itself and Right.
+        uint64_t cl=SubtreeCount(fa[i-1],i-1),cr=SubtreeCount(Right,i-1);
         auto right=AllocInnerPage();
-        if (id==Now.SlotNum()) SetInnerSpecial(Now,Right);
+        if (id==Now.SlotNum()) SetInnerSpecial(Now,Right,cr);
         else
         {
-          InnerSlot h2=InnerSlotParse(Now.Slot(id));h2.next=Right;
+          InnerSlot h2=InnerSlotParse(Now.Slot(id));h2.next=Right;h2.count=cr;
           Now.Replace(id,gao1(h2));
         }
         InnerSlot h1;
-        h1.next=fa[i-1];h1.strict_upper_bound=y;
+        h1.next=fa[i-1];h1.count=cl;h1.strict_upper_bound=y;
         Now.SplitInsert(right,id,gao1(h1));
         if (right.SlotNum()==0) { flag=0;FreePage(std::move(right));break; }
-        SetInnerSpecial(right,GetInnerSpecial(Now));
-        Right=InnerSlotParse(right.Slot(0)).next;
-        SetInnerSpecial(Now,Right);
+        SetInnerSpecial(right,GetInnerSpecial(Now),GetInnerSpecialCount(Now));
+        InnerSlot up=InnerSlotParse(right.Slot(0));
+        SetInnerSpecial(Now,up.next,up.count);
         right.DeleteSlot(0);
         y=InnerSmallestKey(right,i);
         Right=right.ID();
@@ -415,32 +834,39 @@ class BPlusTree {
     {
       UpdateLevelNum(level+1);
       auto Root=AllocInnerPage();
-      InnerSlot h1;h1.next=fa[level];h1.strict_upper_bound=y;
+      InnerSlot h1;h1.next=fa[level];h1.count=SubtreeCount(fa[level],level);h1.strict_upper_bound=y;
       Root.AppendSlotUnchecked(gao1(h1));
-      SetInnerSpecial(Root,Right);
+      SetInnerSpecial(Root,Right,SubtreeCount(Right,level));
       UpdateRoot(Root.ID());
     }
     return res;
   }
-  inline bool Delete(std::string_view key) { std::unique_lock<std::shared_mutex> lock(latch_);return work2(key).first; }
-  inline std::optional<std::string> Take(std::string_view key) { return work2(key).second; }
+  inline bool Delete(std::string_view key) {
+    auto res=FastWrite(key,std::string_view(),2);
+    if (res.has_value()) return res.value();
+    auto lock=LockSMO();PageWriteSet ws;
+    bool ret=work2(key).first;
+    if (ret) Rebalance(key);
+    return ret;
+  }
+  inline std::optional<std::string> Take(std::string_view key) {
+    auto lock=LockSMO();PageWriteSet ws;
+    auto ret=work2(key).second;
+    if (ret.has_value()) Rebalance(key);
+    return ret;
+  }
   Iter Begin() {
-    Iter res(&pgm_,&comp_);
+    Iter res(&pgm_,&comp_,meta_pgid_);
     if (IsEmpty()) return res;
-    if (LevelNum()==0) res.mxid_=Root();
-    else res.mxid_=LargestLeaf(GetInnerPage(Root()),LevelNum());
+    SetLeafRange(res);
     res.is_empty=false;
-    pgid_t pgid_;
-    if (LevelNum()==0) pgid_=Root();
-    else pgid_=SmallestLeaf(GetInnerPage(Root()),LevelNum());
-    res.pg=GetLeafPage(pgid_);res.now=0;
+    res.pg=GetLeafPage(res.mnid_);res.now=0;
     return res;
   }
   Iter LowerBound(std::string_view key) {
-    Iter res(&pgm_,&comp_);
+    Iter res(&pgm_,&comp_,meta_pgid_);
     if (IsEmpty()) return res;
-    if (LevelNum()==0) res.mxid_=Root();
-    else res.mxid_=LargestLeaf(GetInnerPage(Root()),LevelNum());
+    SetLeafRange(res);
     pgid_t now=Root();
     for (uint8_t i=LevelNum();i;i--)
     {
@@ -453,7 +879,7 @@ class BPlusTree {
     slotid_t id=Now.LowerBound(key);
     if (id==Now.SlotNum())
     {
-      if (LevelNum()==0||now==LargestLeaf(GetInnerPage(Root()),LevelNum())) return res;
+      if (now==res.mxid_) return res;
       res.is_empty=false;
       res.pg=GetLeafPage(GetLeafNext(Now));res.now=0;
     }
@@ -465,10 +891,9 @@ class BPlusTree {
     return res;
   }
   Iter UpperBound(std::string_view key) {
-    Iter res(&pgm_,&comp_);
+    Iter res(&pgm_,&comp_,meta_pgid_);
     if (IsEmpty()) return res;
-    if (LevelNum()==0) res.mxid_=Root();
-    else res.mxid_=LargestLeaf(GetInnerPage(Root()),LevelNum());
+    SetLeafRange(res);
     pgid_t now=Root();
     for (uint8_t i=LevelNum();i;i--)
     {
@@ -478,10 +903,10 @@ class BPlusTree {
       else now=InnerLastPage(Now);
     }
     auto Now=GetLeafPage(now);
-    slotid_t id=Now.LowerBound(key);
+    slotid_t id=Now.UpperBound(key);
     if (id==Now.SlotNum())
     {
-      if (LevelNum()==0||now==LargestLeaf(GetInnerPage(Root()),LevelNum())) return res;
+      if (now==res.mxid_) return res;
       res.is_empty=false;
       res.pg=GetLeafPage(GetLeafNext(Now));res.now=0;
     }
@@ -492,8 +917,357 @@ class BPlusTree {
     }
     return res;
   }
-  size_t TupleNum() { return *(pgid_t *)GetMetaPage().Read(8,sizeof(size_t)).data(); }
+  // Return an iterator pointing to the largest key, which goes backwards with
+  // Iter::Prev.
+  Iter RBegin() {
+    Iter res(&pgm_,&comp_,meta_pgid_);
+    if (IsEmpty()) return res;
+    SetLeafRange(res);
+    res.is_empty=false;
+    res.pg=GetLeafPage(res.mxid_);res.now=res.pg.SlotNum()-1;
+    return res;
+  }
+  // Return an iterator pointing to the largest key <= "key".
+  Iter ReverseLowerBound(std::string_view key) { return ReverseBound(key,true); }
+  // Return an iterator pointing to the largest key < "key".
+  Iter ReverseUpperBound(std::string_view key) { return ReverseBound(key,false); }
+  /* The number of keys < "key" (or <= "key" if "inclusive"), i.e., the
+   * position of "key" in the tree. Each inner slot counts the tuples in the
+   * subtree of its child, so only one path from the root is read.
+   */
+  size_t Rank(std::string_view key,bool inclusive=false) {
+    std::shared_lock<std::shared_mutex> lock(smo_latch_);
+    if (IsEmpty()) return 0;
+    size_t res=0;
+    pgid_t now=Root();
+    for (uint8_t i=LevelNum();i;i--)
+    {
+      auto Now=GetInnerPage(now);
+      slotid_t id=Now.UpperBound(key);
+      for (slotid_t j=0;j<id;j++) res+=ChildCount(Now,j);
+      if (id<Now.SlotNum()) now=InnerSlotParse(Now.Slot(id)).next;
+      else now=InnerLastPage(Now);
+    }
+    auto Now=GetLeafPage(now);
+    return res+(inclusive?Now.UpperBound(key):Now.LowerBound(key));
+  }
+  // Return an iterator pointing to the "k"-th smallest key (0-based), or an
+  // empty iterator if there are no more than "k" keys.
+  Iter Nth(size_t k) {
+    std::shared_lock<std::shared_mutex> lock(smo_latch_);
+    Iter res(&pgm_,&comp_,meta_pgid_);
+    if (k>=TupleNum()) return res;
+    SetLeafRange(res);
+    pgid_t now=Root();
+    for (uint8_t i=LevelNum();i;i--)
+    {
+      auto Now=GetInnerPage(now);
+      slotid_t id=0;
+      for (;id<Now.SlotNum();id++)
+      {
+        uint64_t count=ChildCount(Now,id);
+        if (k<count) break;
+        k-=count;
+      }
+      if (id<Now.SlotNum()) now=InnerSlotParse(Now.Slot(id)).next;
+      else now=InnerLastPage(Now);
+    }
+    auto Now=GetLeafPage(now);
+    if (k>=Now.SlotNum()) return res;
+    res.is_empty=false;
+    res.pg=std::move(Now);res.now=k;
+    return res;
+  }
+  /* Split the keys in ["lo", "hi") (or the whole tree) into at most "n" ranges
+   * of equal size, and return the keys between the ranges in ascending order.
+   * The positions of the keys are found with Rank and Nth, so only a few
+   * paths from the root are read. Each range can then be scanned by its own
+   * iterator.
+   *
+   * The returned keys are only a hint. A concurrent change to the tree can
+   * make the ranges uneven, but never makes them miss or overlap keys.
+   */
+  std::vector<std::string> SplitKeys(size_t n,
+      std::optional<std::string_view> lo=std::nullopt,
+      std::optional<std::string_view> hi=std::nullopt) {
+    std::vector<std::string> res;
+    if (n<=1||IsEmpty()) return res;
+    size_t first=lo.has_value()?Rank(*lo):0;
+    size_t last=hi.has_value()?Rank(*hi):TupleNum();
+    if (first>=last) return res;
+    for (size_t k=1;k<n;k++)
+    {
+      size_t id=first+k*(last-first)/n;
+      if (id==first) continue;
+      auto it=Nth(id);
+      auto cur=it.Cur();
+      if (!cur.has_value()) break;
+      if (!res.empty()&&comp_(res.back(),cur->first)>=0) continue;
+      res.emplace_back(cur->first);
+    }
+    return res;
+  }
+  size_t TupleNum() { return meta_->tuple_num.load(std::memory_order_relaxed); }
  private:
+  void SetLeafRange(Iter& res) {
+    if (LevelNum()==0) res.mxid_=res.mnid_=Root();
+    else
+    {
+      auto root=GetInnerPage(Root());
+      res.mxid_=LargestLeaf(root,LevelNum());
+      res.mnid_=SmallestLeaf(root,LevelNum());
+    }
+  }
+  Iter ReverseBound(std::string_view key,bool inclusive) {
+    Iter res(&pgm_,&comp_,meta_pgid_);
+    if (IsEmpty()) return res;
+    SetLeafRange(res);
+    pgid_t now=Root();
+    for (uint8_t i=LevelNum();i;i--)
+    {
+      auto Now=GetInnerPage(now);
+      slotid_t id=Now.UpperBound(key);
+      if (id<Now.SlotNum()) now=InnerSlotParse(Now.Slot(id)).next;
+      else now=InnerLastPage(Now);
+    }
+    auto Now=GetLeafPage(now);
+    // The first slot after the wanted one.
+    slotid_t id=inclusive?Now.UpperBound(key):Now.LowerBound(key);
+    if (id==0)
+    {
+      if (now==res.mnid_) return res;
+      res.is_empty=false;
+      res.pg=GetLeafPage(GetLeafPrev(Now));res.now=res.pg.SlotNum()-1;
+    }
+    else
+    {
+      res.is_empty=false;
+      res.pg=std::move(Now);res.now=id-1;
+    }
+    return res;
+  }
+  // The leaf found by FindLeaf, and its parent, or std::nullopt if the leaf
+  // is the root. "parent_latch" is the latch of the parent, or that of the
+  // cached meta data. The versions are those validated when it is found.
+  // The leaf is the "parent_slot"-th child of the parent.
+  struct LeafPath {
+    LeafPage leaf;
+    uint64_t version;
+    std::optional<InnerPage> parent;
+    slotid_t parent_slot;
+    const PageLatch *parent_latch;
+    uint64_t parent_version;
+  };
+  // Find the leaf that may contain "key" optimistically. std::nullopt if the
+  // tree is empty. The inner pages above the parent are appended to
+  // "ancestors" if it is given, with the slots of the children taken.
+  std::optional<LeafPath> FindLeaf(std::string_view key,
+      std::vector<std::pair<InnerPage,slotid_t> > *ancestors=nullptr) {
+    for (;;)
+    {
+      uint64_t pv=meta_->latch.ReadLock();
+      if (TupleNum()==0) return std::nullopt;
+      uint8_t level=LevelNum();
+      pgid_t now=Root();
+      std::optional<InnerPage> parent;
+      slotid_t parent_slot=0;
+      const PageLatch *latch=&meta_->latch;
+      if (ancestors) ancestors->clear();
+      bool restart=false;
+      for (;level&&!restart;level--)
+      {
+        auto inner=pgm_.get().TryGetSortedPage(now,InnerSlotKeyCompare(comp_),InnerSlotCompare(comp_));
+        if (!inner.has_value()) { restart=true;break; }
+        uint64_t v=inner->Latch().ReadLock();
+        // "now" may be stale.
+        if (!latch->Validate(pv)) { restart=true;break; }
+        slotid_t id=inner->UpperBound(key);
+        if (id<inner->SlotNum()) now=InnerSlotParse(inner->Slot(id)).next;
+        else now=InnerLastPage(*inner);
+        if (ancestors&&parent) ancestors->emplace_back(std::move(parent.value()),parent_slot);
+        parent.emplace(std::move(inner.value()));parent_slot=id;
+        latch=&parent->Latch();pv=v;
+      }
+      if (restart) continue;
+      auto leaf=pgm_.get().TryGetSortedPage(now,LeafSlotKeyCompare(comp_),LeafSlotCompare(comp_));
+      if (!leaf.has_value()) continue;
+      uint64_t v=leaf->Latch().ReadLock();
+      if (!latch->Validate(pv)) continue;
+      return LeafPath{std::move(leaf.value()),v,std::move(parent),parent_slot,latch,pv};
+    }
+  }
+  // Lock smo_latch_ exclusively for an SMO, which may move the right-most
+  // leaf. The tuple number is written back meanwhile.
+  std::unique_lock<std::shared_mutex> LockSMO() {
+    std::unique_lock<std::shared_mutex> lock(smo_latch_);
+    SyncTupleNum();
+    meta_->rightmost_latch.Lock();
+    meta_->rightmost=0;
+    meta_->rightmost_latch.Unlock();
+    return lock;
+  }
+  // The caller holds smo_latch_ shared and the right-most leaf "id" latched.
+  void SetRightmostHint(pgid_t id,std::string_view max_key) {
+    size_t len=max_key.size();
+    if (len>MAX_HINT_KEY)
+    {
+      // A prefix is not larger for keys compared byte by byte.
+      if constexpr (std::is_same_v<Compare,std::compare_three_way>) len=MAX_HINT_KEY;
+      else len=NO_HINT;
+    }
+    meta_->rightmost_latch.Lock();
+    meta_->rightmost=id;
+    meta_->rightmost_max_len=len;
+    if (len!=NO_HINT) memcpy(meta_->rightmost_max,max_key.data(),len);
+    meta_->rightmost_latch.Unlock();
+  }
+  /* Keys larger than all keys in the tree, e.g., auto-generated ones, always
+   * go to the right-most leaf. It is cached in meta_ with a lower bound of
+   * its largest key, so other keys are told apart without touching any page,
+   * and "slot" is appended to the leaf without searching. std::nullopt if
+   * "key" may not be the largest, the leaf is full or latched by others. The
+   * caller holds smo_latch_ shared, so the right-most path does not change.
+   */
+  std::optional<bool> AppendRightmost(std::string_view key,std::string_view slot) {
+    if (IsEmpty()) return std::nullopt;
+    auto v=meta_->rightmost_latch.TryReadLock();
+    if (!v.has_value()) return std::nullopt;
+    pgid_t id=meta_->rightmost;
+    size_t len=meta_->rightmost_max_len;
+    char max_key[MAX_HINT_KEY];
+    if (len!=NO_HINT) memcpy(max_key,meta_->rightmost_max,std::min(len,MAX_HINT_KEY));
+    if (!meta_->rightmost_latch.Validate(v.value())) return std::nullopt;
+    if (id!=0&&(len==NO_HINT||comp_(std::string_view(max_key,len),key)>=0))
+      return std::nullopt;
+    if (id==0)
+    {
+      // Reset by an SMO. Find it through the right-most children.
+      id=Root();
+      for (uint8_t i=LevelNum();i;i--) id=InnerLastPage(GetInnerPage(id));
+    }
+    auto leaf=GetLeafPage(id);
+    // Never wait for the latch, so that appenders do not queue on the leaf.
+    auto lv=leaf.Latch().TryReadLock();
+    if (!lv.has_value()||!leaf.Latch().TryUpgrade(lv.value())) return std::nullopt;
+    if (leaf.IsEmpty())
+    {
+      leaf.Latch().Unlock();
+      return std::nullopt;
+    }
+    std::string_view largest=LeafLargestKey(leaf);
+    bool append=comp_(largest,key)<0&&leaf.IsInsertable(slot);
+    if (append)
+    {
+      // Before inserting, so that the tree is never empty with tuples.
+      IncreaseTupleNum(1);
+      leaf.InsertBeforeSlot(leaf.SlotNum(),slot);
+      SetRightmostHint(id,key);
+    }
+    else SetRightmostHint(id,largest);
+    leaf.Latch().Unlock();
+    if (!append) return std::nullopt;
+    std::vector<InnerPage> path;
+    pgid_t now=Root();
+    for (uint8_t i=LevelNum();i;i--)
+    {
+      path.push_back(GetInnerPage(now));
+      now=InnerLastPage(path.back());
+    }
+    for (auto& inner : path) AddChildCount(inner,inner.SlotNum(),1);
+    return true;
+  }
+  // op: 0 for Insert, 1 for Update, 2 for Delete. Modify the leaf in place
+  // with only the leaf latched. std::nullopt if the tree is empty or pages
+  // have to be split or merged. smo_latch_ is held shared, so that the path
+  // to the leaf stays the same until the counts on it are updated.
+  std::optional<bool> FastWrite(std::string_view key,std::string_view value,int op) {
+    std::shared_lock<std::shared_mutex> lock(smo_latch_);
+    std::vector<std::pair<InnerPage,slotid_t> > ancestors;
+    std::string hhh;
+    if (op!=2)
+    {
+      LeafSlot hh;hh.key=key;hh.value=value;
+      hhh.resize(LeafSlotSize(hh));
+      LeafSlotSerialize(hhh.data(),hh);
+    }
+    if (op==0)
+    {
+      auto res=AppendRightmost(key,hhh);
+      if (res.has_value()) return res;
+    }
+    for (;;)
+    {
+      auto path=FindLeaf(key,op!=1?&ancestors:nullptr);
+      if (!path.has_value()) return std::nullopt;
+      auto& now=path->leaf;
+      if (!now.Latch().TryUpgrade(path->version)) continue;
+      if (!path->parent_latch->Validate(path->parent_version))
+      {
+        now.Latch().Unlock();
+        continue;
+      }
+      std::optional<bool> res;
+      if (op==0)
+      {
+        slotid_t id=now.Find1(key);
+        if (id>now.SlotNum()) res=false;
+        else if (now.IsInsertable(hhh))
+        {
+          // Before inserting, so that the tree is never empty with tuples.
+          IncreaseTupleNum(1);
+          now.InsertBeforeSlot(id,hhh);res=true;
+        }
+      }
+      else if (op==1)
+      {
+        slotid_t id=now.Find(key);
+        if (id==now.SlotNum()) res=false;
+        else if (now.IsReplacable(id,hhh)) { now.ReplaceSlot(id,hhh);res=true; }
+      }
+      else
+      {
+        slotid_t id=now.Find(key);
+        if (id==now.SlotNum()) res=false;
+        // The smallest key may be a separator in the inner pages, and a
+        // non-root leaf may become underfull.
+        else if (id>0&&(!path->parent.has_value()||now.UsedSpace()-now.Slot(id).size()-LeafPage::SLOT_OVERHEAD>=MinUsed(sizeof(pgid_t)*2)))
+        {
+          now.DeleteSlot(id);IncreaseTupleNum(-1);res=true;
+        }
+      }
+      now.Latch().Unlock();
+      if (op!=1&&res==true&&path->parent.has_value())
+      {
+        int64_t delta=op==0?1:-1;
+        AddChildCount(*path->parent,path->parent_slot,delta);
+        for (auto& [inner,id] : ancestors) AddChildCount(inner,id,delta);
+      }
+      return res;
+    }
+  }
+
+  /* The normalized prefix of a key for searching in pages, which preserves
+   * the order of keys, i.e., KeyHead(a) < KeyHead(b) implies a < b.
+   * "Compare" may provide it with a static member function "Head". Keys
+   * compared byte by byte use their first 4 bytes in big endian. Otherwise it
+   * is 0, and then pages are searched as usual.
+   */
+  static slothead_t KeyHead(std::string_view key) {
+    if constexpr (requires { Compare::Head(key); }) {
+      return Compare::Head(key);
+    } else if constexpr (std::is_same_v<Compare, std::compare_three_way>) {
+      slothead_t head = 0;
+      for (size_t i = 0; i < sizeof(head); ++i) {
+        head <<= 8;
+        if (i < key.size())
+          head |= (uint8_t)key[i];
+      }
+      return head;
+    } else {
+      return 0;
+    }
+  }
+
   // Here we provide some helper classes/functions that you may use.
 
   class InnerSlotKeyCompare {
@@ -504,6 +1278,13 @@ class BPlusTree {
     ) const {
       return comp_(InnerSlotParse(slot).strict_upper_bound, key);
     }
+    // See SortedPage.
+    slothead_t SlotHead(std::string_view slot) const {
+      return KeyHead(InnerSlotParse(slot).strict_upper_bound);
+    }
+    slothead_t KeyHead(std::string_view key) const {
+      return BPlusTree::KeyHead(key);
+    }
   private:
     InnerSlotKeyCompare(const Compare& comp) : comp_(comp) {}
     Compare comp_;
@@ -524,7 +1305,6 @@ class BPlusTree {
     Compare comp_;
     friend class BPlusTree;
   };
-  typedef SortedPage<InnerSlotKeyCompare, InnerSlotCompare> InnerPage;
 
   class LeafSlotKeyCompare {
   public:
@@ -534,6 +1314,13 @@ class BPlusTree {
     ) const {
       return comp_(LeafSlotParse(slot).key, key);
     }
+    // See SortedPage.
+    slothead_t SlotHead(std::string_view slot) const {
+      return KeyHead(LeafSlotParse(slot).key);
+    }
+    slothead_t KeyHead(std::string_view key) const {
+      return BPlusTree::KeyHead(key);
+    }
   private:
     LeafSlotKeyCompare(const Compare& comp) : comp_(comp) {}
     Compare comp_;
@@ -555,7 +1342,13 @@ class BPlusTree {
 
   BPlusTree(std::reference_wrapper<PageManager> pgm, pgid_t meta_pgid,
       const Compare& comp)
-    : pgm_(pgm), meta_pgid_(meta_pgid), comp_(comp) {}
+    : pgm_(pgm), meta_pgid_(meta_pgid), comp_(comp),
+      meta_(std::make_unique<Meta>()) {
+    auto meta = GetMetaPage();
+    meta_->level = meta.Read(0, 1)[0];
+    meta_->root = *(pgid_t *)meta.Read(4, sizeof(pgid_t)).data();
+    meta_->tuple_num = meta.template AtomicRead<size_t>(8);
+  }
 
   // Reference the inner page and return a handle for it.
   inline InnerPage GetInnerPage(pgid_t pgid) {
@@ -563,9 +1356,13 @@ class BPlusTree {
         InnerSlotCompare(comp_));
   }
   // Reference the leaf page and return a handle for it.
+  // Leaves are modified by FastWrite concurrently, so a split or merge latches
+  // the leaves it reads, not only those it modifies.
   inline LeafPage GetLeafPage(pgid_t pgid) {
-    return pgm_.get().GetSortedPage(pgid, LeafSlotKeyCompare(comp_),
+    auto leaf = pgm_.get().GetSortedPage(pgid, LeafSlotKeyCompare(comp_),
         LeafSlotCompare(comp_));
+    PageWriteSet::Latch(leaf);
+    return leaf;
   }
   // Reference the meta page and return a handle for it.
   inline PlainPage GetMetaPage() {
@@ -589,16 +1386,250 @@ class BPlusTree {
    * FreePage(std::move(inner1));
    */
   inline void FreePage(Page&& page) {
+    // Optimistic readers may still be reading it.
+    PageWriteSet::Latch(page);
     pgid_t id = page.ID();
     page.Drop();
     pgm_.get().Free(id);
   }
 
+  // The used slot space below which a page is underfull.
+  size_t MinUsed(size_t special_size) const {
+    return PageBudget(special_size, 1.0) * min_fill_;
+  }
+  // Serialize the inner slot into "buf" and return it.
+  static std::string_view InnerSlotString(std::string& buf, InnerSlot slot) {
+    buf.resize(InnerSlotSize(slot));
+    InnerSlotSerialize(buf.data(), slot);
+    return buf;
+  }
+
+  /* Called after "key" is deleted. From the leaf that "key" falls into up to
+   * the children of the root, an underfull page is merged with an adjacent
+   * sibling if they fit into one page, and otherwise slots are moved from
+   * the sibling to balance them. Then the root levels with a single child
+   * are removed. The caller should hold smo_latch_ and have a PageWriteSet.
+   */
+  void Rebalance(std::string_view key) {
+    if (IsEmpty() || min_fill_ <= 0)
+      return;
+    uint8_t level = LevelNum();
+    // path[i] is the page at level i, which is the idx[i]-th child of
+    // path[i + 1].
+    std::vector<pgid_t> path(level + 1);
+    std::vector<slotid_t> idx(level + 1);
+    path[level] = Root();
+    for (uint8_t i = level; i > 0; --i) {
+      InnerPage inner = GetInnerPage(path[i]);
+      idx[i - 1] = inner.UpperBound(key);
+      if (idx[i - 1] < inner.SlotNum())
+        path[i - 1] = InnerSlotParse(inner.Slot(idx[i - 1])).next;
+      else
+        path[i - 1] = InnerLastPage(inner);
+    }
+    for (uint8_t i = 0; i < level; ++i)
+      RebalanceChild(path[i + 1], idx[i], i);
+    for (;;) {
+      level = LevelNum();
+      if (level == 0)
+        break;
+      InnerPage root = GetInnerPage(Root());
+      if (root.SlotNum() > 0)
+        break;
+      pgid_t child = InnerLastPage(root);
+      FreePage(std::move(root));
+      UpdateRoot(child);
+      UpdateLevelNum(level - 1);
+    }
+  }
+  // Rebalance the "k"-th child of the inner page "parent_id" with its left
+  // sibling, or with its right sibling if it is the first child. The children
+  // are at level "level".
+  void RebalanceChild(pgid_t parent_id, slotid_t k, uint8_t level) {
+    InnerPage parent = GetInnerPage(parent_id);
+    slotid_t n = parent.SlotNum();
+    if (n == 0)
+      return;
+    // Children s and s + 1, which are separated by the bound of slot s.
+    slotid_t s = k > 0 ? k - 1 : 0;
+    InnerSlot slot = InnerSlotParse(parent.Slot(s));
+    pgid_t a = slot.next;
+    pgid_t b = s + 1 < n ? InnerSlotParse(parent.Slot(s + 1)).next
+                         : GetInnerSpecial(parent);
+    std::string sep(slot.strict_upper_bound);
+    bool merged = level == 0 ? RebalanceLeaves(parent, s, a, b)
+                             : RebalanceInners(parent, s, a, b, sep);
+    if (!merged)
+      return;
+    // Child s + 1 has been merged into child s.
+    if (s + 1 < n) {
+      InnerSlot next = InnerSlotParse(parent.Slot(s + 1));
+      next.next = a;
+      next.count += slot.count;
+      std::string buf;
+      parent.Replace(s + 1, InnerSlotString(buf, next));
+    } else {
+      SetInnerSpecial(parent, a, GetInnerSpecialCount(parent) + slot.count);
+    }
+    parent.DeleteSlot(s);
+  }
+  // Return true if leaf "b" is merged into leaf "a" and freed. Otherwise
+  // slots may be moved between them, and then their separator in slot "s" of
+  // "parent" is updated.
+  bool RebalanceLeaves(InnerPage& parent, slotid_t s, pgid_t a, pgid_t b) {
+    size_t min_used = MinUsed(sizeof(pgid_t) * 2);
+    LeafPage left = GetLeafPage(a);
+    LeafPage right = GetLeafPage(b);
+    size_t ua = left.UsedSpace(), ub = right.UsedSpace();
+    if (ua >= min_used && ub >= min_used)
+      return false;
+    if (ua + ub <= PageBudget(sizeof(pgid_t) * 2, 1.0)) {
+      for (slotid_t i = 0; i < right.SlotNum(); ++i)
+        left.AppendSlotUnchecked(right.Slot(i));
+      if (b != LargestLeaf(GetInnerPage(Root()), LevelNum())) {
+        pgid_t next = GetLeafNext(right);
+        LeafPage next_leaf = GetLeafPage(next);
+        SetLeafPrev(next_leaf, a);
+        SetLeafNext(left, next);
+      }
+      FreePage(std::move(right));
+      return true;
+    }
+    // Move m slots from the fuller one to the other one.
+    slotid_t na = left.SlotNum(), nb = right.SlotNum(), m = 0;
+    bool to_left = ua < ub;
+    std::string sep;
+    if (to_left) {
+      for (;; ++m) {
+        size_t size = right.Slot(m).size() + LeafPage::SLOT_OVERHEAD;
+        if (m + 1 >= nb || ua + size >= ub)
+          break;
+        ua += size;
+        ub -= size;
+      }
+      if (m == 0)
+        return false;
+      sep = Separator(LeafSlotParse(right.Slot(m - 1)).key,
+          LeafSlotParse(right.Slot(m)).key);
+    } else {
+      for (;; ++m) {
+        size_t size =
+            left.Slot(na - 1 - m).size() + LeafPage::SLOT_OVERHEAD;
+        if (m + 1 >= na || ub + size >= ua)
+          break;
+        ua -= size;
+        ub += size;
+      }
+      if (m == 0)
+        return false;
+      sep = Separator(LeafSlotParse(left.Slot(na - m - 1)).key,
+          LeafSlotParse(left.Slot(na - m)).key);
+    }
+    std::string buf;
+    std::string_view new_slot = InnerSlotString(buf,
+        {a, to_left ? uint64_t(na + m) : uint64_t(na - m), sep});
+    if (!parent.IsReplacable(s, new_slot))
+      return false;
+    if (to_left) {
+      for (slotid_t i = 0; i < m; ++i)
+        left.AppendSlotUnchecked(right.Slot(i));
+      for (slotid_t i = 0; i < m; ++i)
+        right.DeleteSlot(0);
+    } else {
+      for (slotid_t i = 0; i < m; ++i) {
+        right.InsertBeforeSlot(0, left.Slot(na - 1 - i));
+        left.DeleteSlot(na - 1 - i);
+      }
+    }
+    parent.ReplaceSlot(s, new_slot);
+    SetChildCount(parent, s + 1, right.SlotNum());
+    return false;
+  }
+  // The same as RebalanceLeaves but for inner pages. Their separator "sep" is
+  // moved down into "a" when merging, and children are rotated through slot
+  // "s" of "parent" when balancing.
+  bool RebalanceInners(InnerPage& parent, slotid_t s, pgid_t a, pgid_t b,
+      std::string& sep) {
+    size_t min_used = MinUsed(INNER_SPECIAL_SIZE);
+    InnerPage left = GetInnerPage(a);
+    InnerPage right = GetInnerPage(b);
+    size_t ua = left.UsedSpace(), ub = right.UsedSpace();
+    if (ua >= min_used && ub >= min_used)
+      return false;
+    std::string buf;
+    size_t down = InnerSlotSize({a, 0, sep}) + InnerPage::SLOT_OVERHEAD;
+    if (ua + down + ub <= PageBudget(INNER_SPECIAL_SIZE, 1.0)) {
+      left.AppendSlotUnchecked(InnerSlotString(buf,
+          {GetInnerSpecial(left), GetInnerSpecialCount(left), sep}));
+      for (slotid_t i = 0; i < right.SlotNum(); ++i)
+        left.AppendSlotUnchecked(right.Slot(i));
+      SetInnerSpecial(left, GetInnerSpecial(right),
+          GetInnerSpecialCount(right));
+      FreePage(std::move(right));
+      return true;
+    }
+    // Rotate one child at a time while it makes them more balanced.
+    for (;;) {
+      ua = left.UsedSpace();
+      ub = right.UsedSpace();
+      down = InnerSlotSize({a, 0, sep}) + InnerPage::SLOT_OVERHEAD;
+      std::string up, up_slot;
+      // The number of tuples moved from "right" to "left".
+      int64_t moved;
+      uint64_t count = ChildCount(parent, s);
+      if (ua < ub) {
+        if (right.SlotNum() < 2 || ua + down > ub - right.Slot(0).size() -
+                                                   InnerPage::SLOT_OVERHEAD)
+          break;
+        InnerSlot first = InnerSlotParse(right.Slot(0));
+        up = first.strict_upper_bound;
+        moved = first.count;
+        if (!parent.IsReplacable(s,
+                InnerSlotString(up_slot, {a, count + moved, up})))
+          break;
+        left.AppendSlotUnchecked(InnerSlotString(buf,
+            {GetInnerSpecial(left), GetInnerSpecialCount(left), sep}));
+        SetInnerSpecial(left, first.next, first.count);
+        right.DeleteSlot(0);
+      } else {
+        slotid_t na = left.SlotNum();
+        if (na < 2 || ub + down > ua - left.Slot(na - 1).size() -
+                                      InnerPage::SLOT_OVERHEAD)
+          break;
+        InnerSlot last = InnerSlotParse(left.Slot(na - 1));
+        up = last.strict_upper_bound;
+        moved = -(int64_t)GetInnerSpecialCount(left);
+        if (!parent.IsReplacable(s,
+                InnerSlotString(up_slot, {a, count + moved, up})))
+          break;
+        right.InsertBeforeSlot(0, InnerSlotString(buf,
+            {GetInnerSpecial(left), GetInnerSpecialCount(left), sep}));
+        SetInnerSpecial(left, last.next, last.count);
+        left.DeleteSlot(na - 1);
+      }
+      parent.ReplaceSlot(s, up_slot);
+      AddChildCount(parent, s + 1, -moved);
+      sep = std::move(up);
+    }
+    return false;
+  }
+
+  // The slot space of a page with "special_size" bytes of special space that
+  // is filled up to "fill_factor".
+  static size_t PageBudget(size_t special_size, double fill_factor) {
+    size_t space =
+      Page::SIZE - sizeof(slotid_t) - sizeof(pgoff_t) - special_size;
+    return std::min(space, (size_t)(space * fill_factor));
+  }
+
+  // The right-most child and the number of tuples in its subtree.
+  static constexpr size_t INNER_SPECIAL_SIZE =
+    sizeof(pgid_t) + sizeof(uint64_t);
   // Allocate an inner page and return a handle that references it.
   inline InnerPage AllocInnerPage() {
     auto inner = pgm_.get().AllocSortedPage(InnerSlotKeyCompare(comp_),
         InnerSlotCompare(comp_));
-    inner.Init(sizeof(pgid_t));
+    inner.Init(INNER_SPECIAL_SIZE);
     return inner;
   }
   // Allocate a leaf page and return a handle that references it.
@@ -617,6 +1648,62 @@ class BPlusTree {
   inline void SetInnerSpecial(InnerPage& inner, pgid_t page) {
     inner.WriteSpecial(0, std::string_view((char *)&page, sizeof(page)));
   }
+  // The number of tuples in the subtree of the right-most child.
+  inline uint64_t GetInnerSpecialCount(const InnerPage& inner) {
+    return *(uint64_t *)inner.ReadSpecial(sizeof(pgid_t), sizeof(uint64_t))
+      .data();
+  }
+  // Set the right-most child and the number of tuples in its subtree.
+  inline void SetInnerSpecial(InnerPage& inner, pgid_t page, uint64_t count) {
+    SetInnerSpecial(inner, page);
+    inner.WriteSpecial(sizeof(pgid_t),
+      std::string_view((char *)&count, sizeof(count)));
+  }
+  // The counts of the children are aligned, see the layout of inner page.
+  static_assert((Page::SIZE - INNER_SPECIAL_SIZE + sizeof(pgid_t)) %
+    alignof(uint64_t) == 0);
+  // The number of tuples in the subtree of the "i"-th child, where the
+  // SlotNum()-th child is the right-most one. It may be updated concurrently
+  // by AddChildCount.
+  inline uint64_t ChildCount(const InnerPage& inner, slotid_t i) {
+    if (i < inner.SlotNum())
+      return inner.template AtomicReadSlot<uint64_t>(i, sizeof(pgid_t));
+    return inner.template AtomicReadSpecial<uint64_t>(sizeof(pgid_t));
+  }
+  inline void SetChildCount(InnerPage& inner, slotid_t i, uint64_t count) {
+    std::string_view data((char *)&count, sizeof(count));
+    if (i < inner.SlotNum())
+      inner.WriteSlot(i, sizeof(pgid_t), data);
+    else
+      inner.WriteSpecial(sizeof(pgid_t), data);
+  }
+  // Atomic, so that writers holding smo_latch_ shared update the counts on
+  // their paths without latching the inner pages.
+  inline void AddChildCount(InnerPage& inner, slotid_t i, int64_t delta) {
+    if (i < inner.SlotNum())
+      inner.template FetchAddSlot<uint64_t>(i, sizeof(pgid_t), delta);
+    else
+      inner.template FetchAddSpecial<uint64_t>(sizeof(pgid_t), delta);
+  }
+  // The number of tuples in the subtree of the page at "level".
+  uint64_t SubtreeCount(pgid_t pgid, uint8_t level) {
+    if (level == 0)
+      return GetLeafPage(pgid).SlotNum();
+    InnerPage inner = GetInnerPage(pgid);
+    uint64_t count = 0;
+    for (slotid_t i = 0; i <= inner.SlotNum(); ++i)
+      count += ChildCount(inner, i);
+    return count;
+  }
+  // Add "delta" to the counts of the "id[i]"-th child of page "fa[i]" for
+  // each level i in [1, "level"], i.e., along the path to a leaf.
+  void AddPathCount(const pgid_t *fa, const slotid_t *id, uint8_t level,
+      int64_t delta) {
+    for (uint8_t i = 1; i <= level; ++i) {
+      InnerPage inner = GetInnerPage(fa[i]);
+      AddChildCount(inner, id[i], delta);
+    }
+  }
   inline pgid_t GetLeafPrev(LeafPage& leaf) {
     return *(pgid_t *)leaf.ReadSpecial(0, sizeof(pgid_t)).data();
   }
@@ -631,28 +1718,94 @@ class BPlusTree {
     leaf.WriteSpecial(sizeof(pgid_t), data);
   }
 
+  // The meta data is read from meta_, and written to both meta_ and the meta
+  // page, except that the tuple number is written back lazily.
   inline uint8_t LevelNum() {
-    return GetMetaPage().Read(0, 1)[0];
+    return meta_->level.load(std::memory_order_relaxed);
   }
   inline void UpdateLevelNum(uint8_t level_num) {
+    PageWriteSet::Latch(meta_->latch);
+    meta_->level.store(level_num, std::memory_order_relaxed);
     GetMetaPage().Write(0,
       std::string_view((char *)&level_num, sizeof(level_num)));
   }
   inline pgid_t Root() {
-    return *(pgid_t *)GetMetaPage().Read(4, sizeof(pgid_t)).data();
+    return meta_->root.load(std::memory_order_relaxed);
   }
   inline void UpdateRoot(pgid_t root) {
+    PageWriteSet::Latch(meta_->latch);
+    meta_->root.store(root, std::memory_order_relaxed);
     GetMetaPage().Write(4, std::string_view((char *)&root, sizeof(root)));
   }
-  inline void UpdateTupleNum(size_t num) {
-    static_assert(sizeof(size_t) == 8);
-    GetMetaPage().Write(8, std::string_view((char *)&num, sizeof(num)));
-  }
+  // Concurrent FastWrite may update it, so it is updated atomically. Only
+  // meta_ is updated, so that writers do not contend on the meta page. See
+  // SyncTupleNum.
   inline void IncreaseTupleNum(ssize_t delta) {
-    size_t tuple_num = TupleNum();
+    [[maybe_unused]] size_t tuple_num =
+      meta_->tuple_num.fetch_add(delta, std::memory_order_relaxed);
     if (delta < 0)
       assert(tuple_num >= (size_t)(-delta));
-    UpdateTupleNum(tuple_num + delta);
+  }
+  // Write the tuple number in meta_ back to the meta page. It is only done
+  // before SMOs, when no FastWrite is running, so the meta page may be stale
+  // and the tree is opened with the counts in the root instead.
+  inline void SyncTupleNum() {
+    static_assert(sizeof(size_t) == 8);
+    auto meta = GetMetaPage();
+    size_t num = TupleNum();
+    // Not dirtied if unchanged.
+    if (meta.template AtomicRead<size_t>(8) != num)
+      meta.Write(8, std::string_view((char *)&num, sizeof(num)));
+  }
+
+  // The size of keys given by Compare::KEY_SIZE, or 0 if keys are of variable
+  // sizes. See the layout of leaf page above.
+  static constexpr size_t FixedKeySize() {
+    if constexpr (requires { Compare::KEY_SIZE; }) {
+      return Compare::KEY_SIZE;
+    } else {
+      return 0;
+    }
+  }
+  // They replace the ones for variable-sized keys in this class.
+  static LeafSlot LeafSlotParse(std::string_view data) {
+    if constexpr (FixedKeySize() > 0) {
+      return LeafSlot{
+        data.substr(0, FixedKeySize()), data.substr(FixedKeySize())};
+    } else {
+      return wing::LeafSlotParse(data);
+    }
+  }
+  static size_t LeafSlotSize(LeafSlot slot) {
+    if constexpr (FixedKeySize() > 0) {
+      return FixedKeySize() + slot.value.size();
+    } else {
+      return wing::LeafSlotSize(slot);
+    }
+  }
+  static void LeafSlotSerialize(char *addr, LeafSlot slot) {
+    if constexpr (FixedKeySize() > 0) {
+      assert(slot.key.size() == FixedKeySize());
+      memcpy(addr, slot.key.data(), FixedKeySize());
+      memcpy(addr + FixedKeySize(), slot.value.data(), slot.value.size());
+    } else {
+      wing::LeafSlotSerialize(addr, slot);
+    }
+  }
+
+  // The shortest separator between two adjacent keys "left" < "right", i.e.,
+  // left < separator <= right. It is a prefix of "right". Only keys compared
+  // byte by byte can be truncated, otherwise it is "right" itself.
+  static std::string_view Separator(std::string_view left,
+      std::string_view right) {
+    if constexpr (!std::is_same_v<Compare, std::compare_three_way>) {
+      return right;
+    } else {
+      size_t i = 0;
+      while (i < left.size() && left[i] == right[i])
+        ++i;
+      return right.substr(0, i + 1);
+    }
   }
 
   inline std::string_view LeafSmallestKey(const LeafPage& leaf) {
@@ -676,6 +1829,18 @@ class BPlusTree {
      return GetInnerSpecial(inner);
   }
 
+  // The children of the inner pages, in key order.
+  std::vector<pgid_t> Children(const std::vector<pgid_t>& inners) {
+    std::vector<pgid_t> ret;
+    for (pgid_t pgid : inners) {
+      InnerPage inner = GetInnerPage(pgid);
+      for (slotid_t i = 0; i < inner.SlotNum(); ++i)
+        ret.push_back(InnerSlotParse(inner.Slot(i)).next);
+      ret.push_back(GetInnerSpecial(inner));
+    }
+    return ret;
+  }
+
   pgid_t SmallestLeaf(const InnerPage& inner, uint8_t level) {
     assert(level > 0);
     pgid_t cur = InnerFirstPage(inner);
@@ -810,7 +1975,34 @@ class BPlusTree {
   std::reference_wrapper<PageManager> pgm_;
   pgid_t meta_pgid_;
   Compare comp_;
-  std::shared_mutex latch_;
+  double min_fill_{DEFAULT_MIN_FILL};
+  static constexpr size_t MAX_HINT_KEY = 64;
+  static constexpr size_t NO_HINT = SIZE_MAX;
+  /* The meta page cached in memory, so that looking up does not pin the meta
+   * page. "latch" versions root and level for optimistic readers as the latch
+   * of a page does, and writers changing them hold it in their PageWriteSet.
+   */
+  struct Meta {
+    PageLatch latch;
+    std::atomic<uint8_t> level{0};
+    std::atomic<pgid_t> root{0};
+    std::atomic<size_t> tuple_num{0};
+    /* For appending keys larger than all others without searching: the
+     * right-most leaf, or 0 if unknown, and a key not larger than the largest
+     * key in it, or none if it does not fit here. Writers hold smo_latch_
+     * exclusively or the right-most leaf latched, and lock
+     * "rightmost_latch" for optimistic readers.
+     */
+    PageLatch rightmost_latch;
+    pgid_t rightmost{0};
+    size_t rightmost_max_len{NO_HINT};
+    char rightmost_max[MAX_HINT_KEY];
+  };
+  // In a std::unique_ptr so that the tree can be moved.
+  std::unique_ptr<Meta> meta_;
+  // Serializes work1 and work2. FastWrite holds it shared, so that the inner
+  // pages do not change while it updates the counts in them.
+  std::shared_mutex smo_latch_;
 };
 
 }
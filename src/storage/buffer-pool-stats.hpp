@@ -0,0 +1,129 @@
+#ifndef BUFFER_POOL_STATS_H_
+#define BUFFER_POOL_STATS_H_
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <fmt/format.h>
+
+namespace wing {
+
+// A snapshot of buffer pool counters.
+struct BufferPoolCounters {
+  // Page accesses that found the page in the buffer pool.
+  uint64_t hits = 0;
+  // Page accesses that had to read the page from disk.
+  uint64_t misses = 0;
+  // Pages evicted to make room for other pages.
+  uint64_t evictions = 0;
+  // Dirty pages written back to disk, by eviction or the background writer.
+  uint64_t write_backs = 0;
+  // Bytes read from disk, including prefetched pages.
+  uint64_t bytes_read = 0;
+  // Bytes written to disk, including the pages of the free list.
+  uint64_t bytes_written = 0;
+
+  BufferPoolCounters& operator+=(const BufferPoolCounters& rhs) {
+    hits += rhs.hits;
+    misses += rhs.misses;
+    evictions += rhs.evictions;
+    write_backs += rhs.write_backs;
+    bytes_read += rhs.bytes_read;
+    bytes_written += rhs.bytes_written;
+    return *this;
+  }
+  double HitRate() const {
+    return hits + misses == 0 ? 1 : (double)hits / (hits + misses);
+  }
+  std::string ToString() const {
+    return fmt::format("{} hits, {} misses (hit rate {:.2f}%), {} evictions, "
+      "{} write-backs, {} KiB read, {} KiB written", hits, misses,
+      HitRate() * 100, evictions, write_backs, bytes_read >> 10,
+      bytes_written >> 10);
+  }
+};
+
+// The buffer pool counters of a storage.
+struct BufferPoolReport {
+  // 0 if the storage has no buffer pool.
+  size_t capacity_pages = 0;
+  // All accesses, including those to the catalog.
+  BufferPoolCounters total;
+  // Tables that have been accessed since the storage was opened.
+  std::vector<std::pair<std::string, BufferPoolCounters>> tables;
+};
+
+/* Counters of a table or a query. They are updated by any thread accessing
+ * the buffer pool on behalf of the table or the query, see
+ * BufferPoolStatsScope.
+ */
+class BufferPoolStats {
+public:
+  enum Counter {
+    HITS,
+    MISSES,
+    EVICTIONS,
+    WRITE_BACKS,
+    BYTES_READ,
+    BYTES_WRITTEN,
+    NUM_COUNTERS,
+  };
+  void Add(Counter counter, uint64_t n = 1) {
+    counters_[counter].fetch_add(n, std::memory_order_relaxed);
+  }
+  BufferPoolCounters Load() const {
+    BufferPoolCounters ret;
+    ret.hits = Get(HITS);
+    ret.misses = Get(MISSES);
+    ret.evictions = Get(EVICTIONS);
+    ret.write_backs = Get(WRITE_BACKS);
+    ret.bytes_read = Get(BYTES_READ);
+    ret.bytes_written = Get(BYTES_WRITTEN);
+    return ret;
+  }
+private:
+  uint64_t Get(Counter counter) const {
+    return counters_[counter].load(std::memory_order_relaxed);
+  }
+  std::atomic<uint64_t> counters_[NUM_COUNTERS] = {};
+};
+
+/* While a scope is alive, the page manager also counts the buffer pool
+ * accesses of this thread in the given stats. Scopes nest: the innermost
+ * TABLE scope and the innermost QUERY scope are counted, so a query scope
+ * set by the instance and a table scope set by the storage are both updated.
+ * Work done by background threads (e.g., the background writer) is only
+ * counted in PageManager::GetStats().
+ */
+class BufferPoolStatsScope {
+public:
+  enum Kind { TABLE, QUERY };
+  BufferPoolStatsScope(Kind kind, BufferPoolStats *stats)
+    : slot_(kind == TABLE ? table_ : query_), prev_(slot_) {
+    slot_ = stats;
+  }
+  BufferPoolStatsScope(const BufferPoolStatsScope&) = delete;
+  BufferPoolStatsScope& operator=(const BufferPoolStatsScope&) = delete;
+  ~BufferPoolStatsScope() { slot_ = prev_; }
+  // The stats of the innermost QUERY scope of this thread, e.g., for worker
+  // threads to count their accesses in the query that started them.
+  static BufferPoolStats *Query() { return query_; }
+  static void Add(BufferPoolStats::Counter counter, uint64_t n = 1) {
+    if (table_ != nullptr)
+      table_->Add(counter, n);
+    if (query_ != nullptr)
+      query_->Add(counter, n);
+  }
+private:
+  BufferPoolStats *&slot_;
+  BufferPoolStats *prev_;
+  static thread_local inline BufferPoolStats *table_ = nullptr;
+  static thread_local inline BufferPoolStats *query_ = nullptr;
+};
+
+}
+
+#endif	//BUFFER_POOL_STATS_H_
@@ -0,0 +1,391 @@
+#include "storage/eviction-policy.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <deque>
+#include <limits>
+#include <unordered_map>
+#include <vector>
+
+namespace wing {
+
+namespace {
+
+using slot_t = EvictionPolicy::slot_t;
+
+constexpr slot_t NIL = std::numeric_limits<slot_t>::max();
+
+// Maps slot IDs to page IDs. Slot IDs are recycled, so the arrays indexed by
+// slot ID are as large as the maximum number of pages in the shard.
+class SlotTable {
+public:
+  slot_t Alloc(pgid_t pgid) {
+    if (!free_.empty()) {
+      slot_t slot = free_.back();
+      free_.pop_back();
+      pgids_[slot] = pgid;
+      return slot;
+    }
+    pgids_.push_back(pgid);
+    return pgids_.size() - 1;
+  }
+  void Free(slot_t slot) { free_.push_back(slot); }
+  pgid_t PageID(slot_t slot) const { return pgids_[slot]; }
+  // The number of slots ever allocated.
+  size_t Capacity() const { return pgids_.size(); }
+  // The number of slots in use.
+  size_t Size() const { return pgids_.size() - free_.size(); }
+private:
+  std::vector<pgid_t> pgids_;
+  std::vector<slot_t> free_;
+};
+
+// Doubly linked list of slots. The links are stored in arrays indexed by slot
+// ID, so that no node is allocated.
+class SlotList {
+public:
+  void Grow(size_t capacity) {
+    prev_.resize(capacity, NIL);
+    next_.resize(capacity, NIL);
+  }
+  bool Empty() const { return head_ == NIL; }
+  size_t Size() const { return size_; }
+  slot_t Front() const { return head_; }
+  slot_t Next(slot_t slot) const { return next_[slot]; }
+  void PushBack(slot_t slot) {
+    prev_[slot] = tail_;
+    next_[slot] = NIL;
+    if (tail_ == NIL)
+      head_ = slot;
+    else
+      next_[tail_] = slot;
+    tail_ = slot;
+    size_ += 1;
+  }
+  void Erase(slot_t slot) {
+    if (prev_[slot] == NIL)
+      head_ = next_[slot];
+    else
+      next_[prev_[slot]] = next_[slot];
+    if (next_[slot] == NIL)
+      tail_ = prev_[slot];
+    else
+      prev_[next_[slot]] = prev_[slot];
+    size_ -= 1;
+  }
+private:
+  std::vector<slot_t> prev_;
+  std::vector<slot_t> next_;
+  slot_t head_ = NIL;
+  slot_t tail_ = NIL;
+  size_t size_ = 0;
+};
+
+// Remembers a bounded number of recently evicted pages.
+template <typename V>
+class GhostQueue {
+public:
+  void Push(pgid_t pgid, V v, size_t capacity) {
+    seq_ += 1;
+    map_[pgid] = std::make_pair(seq_, v);
+    fifo_.emplace_back(pgid, seq_);
+    while (fifo_.size() > capacity) {
+      auto [old, seq] = fifo_.front();
+      fifo_.pop_front();
+      // The page may have been re-admitted and evicted again since then.
+      auto it = map_.find(old);
+      if (it != map_.end() && it->second.first == seq)
+        map_.erase(it);
+    }
+  }
+  std::optional<V> Take(pgid_t pgid) {
+    auto it = map_.find(pgid);
+    if (it == map_.end())
+      return std::nullopt;
+    V v = it->second.second;
+    map_.erase(it);
+    return v;
+  }
+private:
+  std::unordered_map<pgid_t, std::pair<uint64_t, V>> map_;
+  std::deque<std::pair<pgid_t, uint64_t>> fifo_;
+  uint64_t seq_ = 0;
+};
+
+class LRUPolicy : public EvictionPolicy {
+public:
+  slot_t Admit(pgid_t pgid) override {
+    slot_t slot = slots_.Alloc(pgid);
+    evictable_.Grow(slots_.Capacity());
+    return slot;
+  }
+  void Pin(slot_t slot) override { evictable_.Erase(slot); }
+  void Unpin(slot_t slot) override { evictable_.PushBack(slot); }
+  void Remove(slot_t slot) override {
+    evictable_.Erase(slot);
+    slots_.Free(slot);
+  }
+  std::optional<pgid_t> Evict() override {
+    if (evictable_.Empty())
+      return std::nullopt;
+    slot_t slot = evictable_.Front();
+    evictable_.Erase(slot);
+    slots_.Free(slot);
+    return slots_.PageID(slot);
+  }
+private:
+  SlotTable slots_;
+  SlotList evictable_;
+};
+
+class ClockPolicy : public EvictionPolicy {
+public:
+  slot_t Admit(pgid_t pgid) override {
+    slot_t slot = slots_.Alloc(pgid);
+    if (ref_.size() < slots_.Capacity()) {
+      ref_.resize(slots_.Capacity());
+      unpinned_.resize(slots_.Capacity());
+    }
+    ref_[slot] = false;
+    unpinned_[slot] = false;
+    return slot;
+  }
+  void Pin(slot_t slot) override {
+    assert(unpinned_[slot]);
+    unpinned_[slot] = false;
+    unpinned_num_ -= 1;
+  }
+  void Unpin(slot_t slot) override {
+    assert(!unpinned_[slot]);
+    unpinned_[slot] = true;
+    ref_[slot] = true;
+    unpinned_num_ += 1;
+  }
+  void Remove(slot_t slot) override {
+    Pin(slot);
+    slots_.Free(slot);
+  }
+  std::optional<pgid_t> Evict() override {
+    if (unpinned_num_ == 0)
+      return std::nullopt;
+    // Free slots are never unpinned, so they are skipped. Terminates within two
+    // rounds because the first round clears all reference bits.
+    for (;;) {
+      if (hand_ >= slots_.Capacity())
+        hand_ = 0;
+      slot_t slot = hand_++;
+      if (!unpinned_[slot])
+        continue;
+      if (ref_[slot]) {
+        ref_[slot] = false;
+        continue;
+      }
+      Remove(slot);
+      return slots_.PageID(slot);
+    }
+  }
+private:
+  SlotTable slots_;
+  std::vector<bool> ref_;
+  std::vector<bool> unpinned_;
+  size_t unpinned_num_ = 0;
+  slot_t hand_ = 0;
+};
+
+class LRUKPolicy : public EvictionPolicy {
+public:
+  static constexpr size_t K = 2;
+  slot_t Admit(pgid_t pgid) override {
+    slot_t slot = slots_.Alloc(pgid);
+    if (hist_.size() < slots_.Capacity()) {
+      hist_.resize(slots_.Capacity());
+      heap_pos_.resize(slots_.Capacity(), NIL);
+    }
+    // The history of a recently evicted page is retained, so that a page
+    // accessed repeatedly with long intervals is not regarded as accessed once.
+    hist_[slot] = ghost_.Take(pgid).value_or(History{});
+    Access(slot);
+    return slot;
+  }
+  void Pin(slot_t slot) override {
+    HeapErase(slot);
+    Access(slot);
+  }
+  void Unpin(slot_t slot) override { HeapPush(slot); }
+  void Remove(slot_t slot) override {
+    HeapErase(slot);
+    slots_.Free(slot);
+  }
+  std::optional<pgid_t> Evict() override {
+    if (heap_.empty())
+      return std::nullopt;
+    slot_t slot = heap_[0];
+    HeapErase(slot);
+    slots_.Free(slot);
+    pgid_t pgid = slots_.PageID(slot);
+    ghost_.Push(pgid, hist_[slot], std::max<size_t>(slots_.Size(), 16));
+    return pgid;
+  }
+private:
+  // The timestamps of the last K accesses. The most recent one comes first.
+  // 0 means no access.
+  using History = std::array<uint64_t, K>;
+  void Access(slot_t slot) {
+    History& h = hist_[slot];
+    std::copy_backward(h.begin(), h.end() - 1, h.end());
+    h[0] = ++now_;
+  }
+  // The page with the oldest K-th most recent access is evicted first. Pages
+  // accessed less than K times have infinite backward K-distance, among which
+  // the least recently used one is evicted first.
+  bool Before(slot_t a, slot_t b) const {
+    const History& ha = hist_[a];
+    const History& hb = hist_[b];
+    if (ha[K - 1] != hb[K - 1])
+      return ha[K - 1] < hb[K - 1];
+    return ha[0] < hb[0];
+  }
+  void HeapSet(size_t pos, slot_t slot) {
+    heap_[pos] = slot;
+    heap_pos_[slot] = pos;
+  }
+  void SiftUp(size_t pos) {
+    slot_t slot = heap_[pos];
+    while (pos > 0) {
+      size_t parent = (pos - 1) / 2;
+      if (!Before(slot, heap_[parent]))
+        break;
+      HeapSet(pos, heap_[parent]);
+      pos = parent;
+    }
+    HeapSet(pos, slot);
+  }
+  void SiftDown(size_t pos) {
+    slot_t slot = heap_[pos];
+    for (;;) {
+      size_t child = pos * 2 + 1;
+      if (child >= heap_.size())
+        break;
+      if (child + 1 < heap_.size() && Before(heap_[child + 1], heap_[child]))
+        child += 1;
+      if (!Before(heap_[child], slot))
+        break;
+      HeapSet(pos, heap_[child]);
+      pos = child;
+    }
+    HeapSet(pos, slot);
+  }
+  void HeapPush(slot_t slot) {
+    assert(heap_pos_[slot] == NIL);
+    heap_.push_back(slot);
+    SiftUp(heap_.size() - 1);
+  }
+  void HeapErase(slot_t slot) {
+    size_t pos = heap_pos_[slot];
+    assert(pos != NIL);
+    heap_pos_[slot] = NIL;
+    slot_t last = heap_.back();
+    heap_.pop_back();
+    if (pos == heap_.size())
+      return;
+    HeapSet(pos, last);
+    SiftUp(pos);
+    SiftDown(heap_pos_[last]);
+  }
+
+  SlotTable slots_;
+  std::vector<History> hist_;
+  // Binary heap of unpinned slots.
+  std::vector<slot_t> heap_;
+  std::vector<slot_t> heap_pos_;
+  GhostQueue<History> ghost_;
+  uint64_t now_ = 0;
+};
+
+// The full version of 2Q. A1in is a FIFO queue of pages accessed once. Am is an
+// LRU queue of hot pages. A1out remembers the pages recently evicted from
+// A1in. A page is admitted to Am only if it is found in A1out, so that pages
+// read only once by a scan do not push hot pages out.
+class TwoQPolicy : public EvictionPolicy {
+public:
+  slot_t Admit(pgid_t pgid) override {
+    slot_t slot = slots_.Alloc(pgid);
+    if (in_am_.size() < slots_.Capacity()) {
+      a1in_.Grow(slots_.Capacity());
+      am_.Grow(slots_.Capacity());
+      in_am_.resize(slots_.Capacity());
+      pinned_.resize(slots_.Capacity());
+    }
+    pinned_[slot] = true;
+    in_am_[slot] = a1out_.Take(pgid).has_value();
+    Queue(slot).PushBack(slot);
+    return slot;
+  }
+  void Pin(slot_t slot) override {
+    pinned_[slot] = true;
+    // Accesses to pages in A1in are regarded as correlated.
+    if (in_am_[slot]) {
+      am_.Erase(slot);
+      am_.PushBack(slot);
+    }
+  }
+  void Unpin(slot_t slot) override { pinned_[slot] = false; }
+  void Remove(slot_t slot) override {
+    Queue(slot).Erase(slot);
+    slots_.Free(slot);
+  }
+  std::optional<pgid_t> Evict() override {
+    size_t resident = a1in_.Size() + am_.Size();
+    // A1in takes 1/4 of the buffer, and A1out remembers as many pages as half
+    // of the buffer, as suggested by the paper.
+    bool from_a1in = a1in_.Size() > std::max<size_t>(resident / 4, 1);
+    slot_t slot = FirstUnpinned(from_a1in ? a1in_ : am_);
+    if (slot == NIL) {
+      from_a1in = !from_a1in;
+      slot = FirstUnpinned(from_a1in ? a1in_ : am_);
+      if (slot == NIL)
+        return std::nullopt;
+    }
+    Remove(slot);
+    pgid_t pgid = slots_.PageID(slot);
+    if (from_a1in)
+      a1out_.Push(pgid, true, std::max<size_t>(resident / 2, 16));
+    return pgid;
+  }
+private:
+  SlotList& Queue(slot_t slot) { return in_am_[slot] ? am_ : a1in_; }
+  // Pinned pages stay in the queues. There are usually only a few of them.
+  slot_t FirstUnpinned(const SlotList& queue) const {
+    slot_t slot = queue.Front();
+    while (slot != NIL && pinned_[slot])
+      slot = queue.Next(slot);
+    return slot;
+  }
+
+  SlotTable slots_;
+  SlotList a1in_;
+  SlotList am_;
+  std::vector<bool> in_am_;
+  std::vector<bool> pinned_;
+  GhostQueue<bool> a1out_;
+};
+
+}
+
+std::unique_ptr<EvictionPolicy> EvictionPolicy::New(EvictionPolicyKind kind) {
+  switch (kind) {
+    case EvictionPolicyKind::LRU:
+      return std::make_unique<LRUPolicy>();
+    case EvictionPolicyKind::CLOCK:
+      return std::make_unique<ClockPolicy>();
+    case EvictionPolicyKind::LRU_K:
+      return std::make_unique<LRUKPolicy>();
+    case EvictionPolicyKind::TWO_Q:
+      return std::make_unique<TwoQPolicy>();
+  }
+  assert(0);
+  return nullptr;
+}
+
+}
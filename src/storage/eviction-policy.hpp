@@ -0,0 +1,59 @@
+#ifndef EVICTION_POLICY_H_
+#define EVICTION_POLICY_H_
+
+#include <cstdint>
+#include <memory>
+#include <optional>
+
+namespace wing {
+
+typedef uint32_t pgid_t;
+
+enum class EvictionPolicyKind {
+  // Evict the page that has been unpinned for the longest time.
+  LRU,
+  // Second chance. Cheapest, but only approximates LRU.
+  CLOCK,
+  // LRU-2. Evict the page whose second most recent access is the oldest.
+  // Pages accessed only once are evicted first.
+  LRU_K,
+  // Pages accessed once stay in a FIFO queue, and are promoted to an LRU queue
+  // only if they are accessed again after being evicted recently.
+  TWO_Q,
+};
+
+/* Decides which unpinned page to evict from (a shard of) the buffer pool.
+ *
+ * When a page is brought into the buffer pool, it is admitted to the policy
+ * and gets a slot ID. The page manager stores the slot ID along with the page
+ * and passes it back in later calls, so that the policies can keep their
+ * bookkeeping in arrays indexed by slot ID instead of allocating list nodes or
+ * looking up hash tables on every pin and unpin.
+ *
+ * A page is pinned when it is admitted. Pin() and Unpin() are called when its
+ * reference count changes from 0 to 1 and from 1 to 0 respectively. So the
+ * accesses to a page while it is pinned are regarded as one access.
+ *
+ * The policy is not thread-safe. The caller should hold the shard latch.
+ */
+class EvictionPolicy {
+public:
+  typedef uint32_t slot_t;
+  virtual ~EvictionPolicy() = default;
+  // The page is brought into the buffer pool. Return its slot ID.
+  virtual slot_t Admit(pgid_t pgid) = 0;
+  virtual void Pin(slot_t slot) = 0;
+  virtual void Unpin(slot_t slot) = 0;
+  // Remove an unpinned page from the buffer pool without evicting it, e.g.,
+  // because the page is freed.
+  virtual void Remove(slot_t slot) = 0;
+  // Remove the page to evict and return its page ID. Return std::nullopt if
+  // all pages are pinned.
+  virtual std::optional<pgid_t> Evict() = 0;
+
+  static std::unique_ptr<EvictionPolicy> New(EvictionPolicyKind kind);
+};
+
+}
+
+#endif	//EVICTION_POLICY_H_
@@ -0,0 +1,373 @@
+#include "storage/io-engine.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "common/logging.hpp"
+
+namespace wing {
+
+void ReadFull(int fd, char *buf, size_t len, off_t offset) {
+  size_t done = 0;
+  while (done < len) {
+    ssize_t ret = pread(fd, buf + done, len - done, offset + done);
+    if (ret < 0) {
+      if (errno == EINTR)
+        continue;
+      DB_ERR("Fail to read {} bytes at {}: {}", len, offset, strerror(errno));
+    }
+    if (ret == 0) {
+      memset(buf + done, 0, len - done);
+      break;
+    }
+    done += ret;
+  }
+}
+
+void WriteFull(int fd, const char *buf, size_t len, off_t offset) {
+  size_t done = 0;
+  while (done < len) {
+    ssize_t ret = pwrite(fd, buf + done, len - done, offset + done);
+    if (ret < 0) {
+      if (errno == EINTR)
+        continue;
+      DB_ERR("Fail to write {} bytes at {}: {}", len, offset, strerror(errno));
+    }
+    done += ret;
+  }
+}
+
+namespace {
+
+void Execute(int fd, const IORequest& req) {
+  if (req.write)
+    WriteFull(fd, req.buf, req.len, req.offset);
+  else
+    ReadFull(fd, req.buf, req.len, req.offset);
+}
+
+class ThreadPoolEngine : public IOEngine {
+public:
+  static constexpr size_t THREADS = 4;
+  ThreadPoolEngine(int fd) : fd_(fd), stopping_(false) {
+    for (size_t i = 0; i < THREADS; ++i)
+      threads_.emplace_back([this]() { Work(); });
+  }
+  ~ThreadPoolEngine() override {
+    {
+      std::lock_guard l(latch_);
+      stopping_ = true;
+    }
+    cv_.notify_all();
+    for (auto& t : threads_)
+      t.join();
+  }
+  void Submit(std::span<IOChain> chains) override {
+    {
+      std::lock_guard l(latch_);
+      for (auto& chain : chains)
+        queue_.push_back(std::move(chain));
+    }
+    cv_.notify_all();
+  }
+  IOEngineKind Kind() const override { return IOEngineKind::THREAD_POOL; }
+private:
+  void Work() {
+    for (;;) {
+      std::unique_lock l(latch_);
+      cv_.wait(l, [this]() { return stopping_ || !queue_.empty(); });
+      // Drain the queue before stopping.
+      if (queue_.empty())
+        return;
+      IOChain chain = std::move(queue_.front());
+      queue_.pop_front();
+      l.unlock();
+      for (const auto& req : chain.requests)
+        Execute(fd_, req);
+      chain.done();
+    }
+  }
+
+  int fd_;
+  std::mutex latch_;
+  std::condition_variable cv_;
+  std::deque<IOChain> queue_;
+  bool stopping_;
+  std::vector<std::thread> threads_;
+};
+
+/* Talks to io_uring with raw system calls, so that liburing is not needed.
+ * The requests of a chain are linked with IOSQE_IO_LINK. A dedicated thread
+ * reaps the completions and calls IOChain::done.
+ */
+class IoUringEngine : public IOEngine {
+public:
+  static constexpr unsigned ENTRIES = 256;
+  static std::unique_ptr<IoUringEngine> New(int fd) {
+    io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    int ring_fd = syscall(__NR_io_uring_setup, ENTRIES, &params);
+    if (ring_fd < 0)
+      return nullptr;
+    auto engine = std::unique_ptr<IoUringEngine>(new IoUringEngine(fd, ring_fd));
+    if (!engine->Map(params))
+      return nullptr;
+    engine->reaper_ = std::thread([e = engine.get()]() { e->Reap(); });
+    return engine;
+  }
+  ~IoUringEngine() override {
+    if (reaper_.joinable()) {
+      {
+        std::unique_lock l(latch_);
+        space_.wait(l, [this]() { return in_flight_ == 0; });
+      }
+      {
+        // Wake up the reaper.
+        std::lock_guard l(submit_latch_);
+        io_uring_sqe *sqe = NextSqe();
+        sqe->opcode = IORING_OP_NOP;
+        sqe->user_data = 0;
+        Flush();
+      }
+      reaper_.join();
+    }
+    if (sqes_ != MAP_FAILED)
+      munmap(sqes_, sqes_size_);
+    if (cq_ring_ != MAP_FAILED && cq_ring_ != sq_ring_)
+      munmap(cq_ring_, cq_ring_size_);
+    if (sq_ring_ != MAP_FAILED)
+      munmap(sq_ring_, sq_ring_size_);
+    close(ring_fd_);
+  }
+  void Submit(std::span<IOChain> chains) override {
+    std::lock_guard l(submit_latch_);
+    for (auto& chain : chains) {
+      size_t n = chain.requests.size();
+      assert(n > 0 && n <= ENTRIES);
+      {
+        std::unique_lock ll(latch_);
+        if (in_flight_ + n > ENTRIES) {
+          // Let the kernel start on what we have before waiting.
+          ll.unlock();
+          Flush();
+          ll.lock();
+          space_.wait(ll, [this, n]() { return in_flight_ + n <= ENTRIES; });
+        }
+        in_flight_ += n;
+      }
+      auto *pending = new Pending{std::move(chain), n, {}};
+      pending->results.resize(n);
+      for (size_t i = 0; i < n; ++i) {
+        pending->results[i] = Result{pending, i, 0};
+        const IORequest& req = pending->chain.requests[i];
+        io_uring_sqe *sqe = NextSqe();
+        sqe->opcode = req.write ? IORING_OP_WRITE : IORING_OP_READ;
+        sqe->fd = fd_;
+        sqe->addr = reinterpret_cast<uint64_t>(req.buf);
+        sqe->len = req.len;
+        sqe->off = req.offset;
+        sqe->flags = i + 1 < n ? IOSQE_IO_LINK : 0;
+        sqe->user_data = reinterpret_cast<uint64_t>(&pending->results[i]);
+      }
+    }
+    Flush();
+  }
+  IOEngineKind Kind() const override { return IOEngineKind::IO_URING; }
+private:
+  struct Pending;
+  struct Result {
+    Pending *pending;
+    size_t index;
+    int res;
+  };
+  struct Pending {
+    IOChain chain;
+    // The number of requests whose completion has not been reaped.
+    size_t remaining;
+    std::vector<Result> results;
+  };
+  IoUringEngine(int fd, int ring_fd)
+    : fd_(fd), ring_fd_(ring_fd), sq_ring_(MAP_FAILED), cq_ring_(MAP_FAILED),
+      sqes_(MAP_FAILED), to_submit_(0), in_flight_(0) {}
+  bool Map(const io_uring_params& p) {
+    sq_ring_size_ = p.sq_off.array + p.sq_entries * sizeof(uint32_t);
+    cq_ring_size_ = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+    bool single = p.features & IORING_FEAT_SINGLE_MMAP;
+    if (single)
+      sq_ring_size_ = cq_ring_size_ = std::max(sq_ring_size_, cq_ring_size_);
+    sq_ring_ = mmap(nullptr, sq_ring_size_, PROT_READ | PROT_WRITE,
+      MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_SQ_RING);
+    if (sq_ring_ == MAP_FAILED)
+      return false;
+    cq_ring_ = single ? sq_ring_ : mmap(nullptr, cq_ring_size_,
+      PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd_,
+      IORING_OFF_CQ_RING);
+    if (cq_ring_ == MAP_FAILED)
+      return false;
+    sqes_size_ = p.sq_entries * sizeof(io_uring_sqe);
+    sqes_ = mmap(nullptr, sqes_size_, PROT_READ | PROT_WRITE,
+      MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_SQES);
+    if (sqes_ == MAP_FAILED)
+      return false;
+    char *sq = (char *)sq_ring_;
+    sq_tail_ = (unsigned *)(sq + p.sq_off.tail);
+    sq_mask_ = *(unsigned *)(sq + p.sq_off.ring_mask);
+    sq_array_ = (unsigned *)(sq + p.sq_off.array);
+    for (unsigned i = 0; i < p.sq_entries; ++i)
+      sq_array_[i] = i;
+    char *cq = (char *)cq_ring_;
+    cq_head_ = (unsigned *)(cq + p.cq_off.head);
+    cq_tail_ = (unsigned *)(cq + p.cq_off.tail);
+    cq_mask_ = *(unsigned *)(cq + p.cq_off.ring_mask);
+    cqes_ = (io_uring_cqe *)(cq + p.cq_off.cqes);
+    return true;
+  }
+  // The caller should hold submit_latch_.
+  io_uring_sqe *NextSqe() {
+    unsigned tail = *sq_tail_ + to_submit_;
+    io_uring_sqe *sqe = (io_uring_sqe *)sqes_ + (tail & sq_mask_);
+    memset(sqe, 0, sizeof(*sqe));
+    to_submit_ += 1;
+    return sqe;
+  }
+  // The caller should hold submit_latch_.
+  void Flush() {
+    if (to_submit_ == 0)
+      return;
+    __atomic_store_n(sq_tail_, *sq_tail_ + to_submit_, __ATOMIC_RELEASE);
+    while (to_submit_ > 0) {
+      int ret = syscall(__NR_io_uring_enter, ring_fd_, to_submit_, 0, 0,
+        nullptr, 0);
+      if (ret < 0) {
+        if (errno == EINTR || errno == EAGAIN || errno == EBUSY)
+          continue;
+        DB_ERR("io_uring_enter: {}", strerror(errno));
+      }
+      to_submit_ -= ret;
+    }
+  }
+  void Reap() {
+    for (;;) {
+      int ret = syscall(__NR_io_uring_enter, ring_fd_, 0, 1,
+        IORING_ENTER_GETEVENTS, nullptr, 0);
+      if (ret < 0 && errno != EINTR)
+        DB_ERR("io_uring_enter: {}", strerror(errno));
+      unsigned head = *cq_head_;
+      unsigned tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+      size_t reaped = 0;
+      bool stop = false;
+      for (; head != tail; ++head) {
+        const io_uring_cqe& cqe = cqes_[head & cq_mask_];
+        if (cqe.user_data == 0) {
+          stop = true;
+          continue;
+        }
+        Complete(reinterpret_cast<Result *>(cqe.user_data), cqe.res);
+        reaped += 1;
+      }
+      __atomic_store_n(cq_head_, head, __ATOMIC_RELEASE);
+      if (reaped) {
+        std::lock_guard l(latch_);
+        in_flight_ -= reaped;
+        space_.notify_all();
+      }
+      if (stop)
+        return;
+    }
+  }
+  void Complete(Result *result, int res) {
+    result->res = res;
+    Pending *pending = result->pending;
+    pending->remaining -= 1;
+    if (pending->remaining > 0)
+      return;
+    // A short transfer breaks the link and cancels the rest of the chain. Now
+    // that all of them are reaped, finish them in order synchronously.
+    for (size_t i = 0; i < pending->results.size(); ++i) {
+      IORequest req = pending->chain.requests[i];
+      int res = pending->results[i].res;
+      if (res == (int)req.len)
+        continue;
+      if (res == -ECANCELED)
+        res = 0;
+      if (res < 0)
+        DB_ERR("Fail to {} {} bytes at {}: {}", req.write ? "write" : "read",
+          req.len, req.offset, strerror(-res));
+      req.buf += res;
+      req.len -= res;
+      req.offset += res;
+      Execute(fd_, req);
+    }
+    pending->chain.done();
+    delete pending;
+  }
+
+  int fd_;
+  int ring_fd_;
+  void *sq_ring_;
+  void *cq_ring_;
+  void *sqes_;
+  size_t sq_ring_size_;
+  size_t cq_ring_size_;
+  size_t sqes_size_;
+  unsigned *sq_tail_;
+  unsigned sq_mask_;
+  unsigned *sq_array_;
+  unsigned *cq_head_;
+  unsigned *cq_tail_;
+  unsigned cq_mask_;
+  io_uring_cqe *cqes_;
+
+  // Protects the submission queue.
+  std::mutex submit_latch_;
+  unsigned to_submit_;
+  // Protects in_flight_.
+  std::mutex latch_;
+  std::condition_variable space_;
+  size_t in_flight_;
+  std::thread reaper_;
+};
+
+}
+
+std::unique_ptr<IOEngine> IOEngine::New(IOEngineKind kind, int fd) {
+  switch (kind) {
+    case IOEngineKind::SYNC:
+      return nullptr;
+    case IOEngineKind::IO_URING: {
+      auto engine = IoUringEngine::New(fd);
+      if (engine != nullptr)
+        return engine;
+      DB_WARNING("io_uring is not available. Fall back to the thread pool.");
+      return std::make_unique<ThreadPoolEngine>(fd);
+    }
+    case IOEngineKind::THREAD_POOL:
+      return std::make_unique<ThreadPoolEngine>(fd);
+  }
+  assert(0);
+  return nullptr;
+}
+
+bool IOEngine::IsAvailable(IOEngineKind kind) {
+  if (kind != IOEngineKind::IO_URING)
+    return true;
+  io_uring_params params;
+  memset(&params, 0, sizeof(params));
+  int ring_fd = syscall(__NR_io_uring_setup, 1, &params);
+  if (ring_fd < 0)
+    return false;
+  close(ring_fd);
+  return true;
+}
+
+}
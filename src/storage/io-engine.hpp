@@ -0,0 +1,66 @@
+#ifndef IO_ENGINE_H_
+#define IO_ENGINE_H_
+
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <span>
+#include <vector>
+
+#include <sys/types.h>
+
+namespace wing {
+
+enum class IOEngineKind {
+  // Pages are read and written synchronously by the calling thread. Prefetch
+  // is not supported.
+  SYNC,
+  // Linux io_uring. Fall back to THREAD_POOL if io_uring is not available.
+  IO_URING,
+  // Background threads doing pread/pwrite.
+  THREAD_POOL,
+};
+
+struct IORequest {
+  bool write;
+  off_t offset;
+  char *buf;
+  size_t len;
+};
+
+// Requests in a chain are executed one after another. The chains are executed
+// concurrently.
+struct IOChain {
+  std::vector<IORequest> requests;
+  // Called in a background thread after all requests in the chain complete.
+  // It should not submit I/O itself.
+  std::function<void()> done;
+};
+
+/* Executes page I/O asynchronously for PageManager. All chains passed to one
+ * Submit() call are submitted to the kernel in a single batch if possible.
+ * A read hitting the end of file is padded with zeros, because pages may be
+ * allocated without being written. I/O errors are fatal.
+ */
+class IOEngine {
+public:
+  virtual ~IOEngine() = default;
+  virtual void Submit(std::span<IOChain> chains) = 0;
+  // The kind actually used, which differs from the requested one after a
+  // fallback.
+  virtual IOEngineKind Kind() const = 0;
+  // Return nullptr for IOEngineKind::SYNC. The engine does not own "fd".
+  // Destroying the engine waits for all submitted chains to complete.
+  static std::unique_ptr<IOEngine> New(IOEngineKind kind, int fd);
+  // Whether New(kind, fd) would use "kind" instead of falling back.
+  static bool IsAvailable(IOEngineKind kind);
+};
+
+// Synchronous positional I/O of exactly "len" bytes, retrying on short
+// transfers. A read hitting the end of file is padded with zeros.
+void ReadFull(int fd, char *buf, size_t len, off_t offset);
+void WriteFull(int fd, const char *buf, size_t len, off_t offset);
+
+}
+
+#endif	//IO_ENGINE_H_
@@ -14,6 +14,7 @@
 #include "catalog/schema.hpp"
 #include "common/allocator.hpp"
 #include "storage.hpp"
+#include "storage/buffer-pool-stats.hpp"
 
 namespace wing {
 
@@ -25,10 +26,10 @@ class MemoryTable {
   typedef std::map<std::string, std::string, std::less<>> map_t;
 
  public:
-  class Iterator : public wing::Iterator<const uint8_t*> {
+  template <typename MapIter>
+  class BasicIterator : public wing::Iterator<const uint8_t*> {
    public:
-    Iterator(MemoryTable::map_t::const_iterator iter_begin,
-        MemoryTable::map_t::const_iterator iter_end)
+    BasicIterator(MapIter iter_begin, MapIter iter_end)
       : iter_(iter_begin), iter_end_(iter_end) {}
     void Init() override { first_flag_ = true; }
     const uint8_t* Next() override {
@@ -47,9 +48,11 @@ class MemoryTable {
 
    private:
     bool first_flag_{true};
-    MemoryTable::map_t::const_iterator iter_;
-    MemoryTable::map_t::const_iterator iter_end_;
+    MapIter iter_;
+    MapIter iter_end_;
   };
+  using Iterator = BasicIterator<map_t::const_iterator>;
+  using ReverseIterator = BasicIterator<map_t::const_reverse_iterator>;
 
   class ModifyHandle : public wing::ModifyHandle {
    public:
@@ -208,7 +211,7 @@ class MemoryTableStorage {
 
   std::unique_ptr<Iterator<const uint8_t*>> GetRangeIterator(
       std::string_view table_name, std::tuple<std::string_view, bool, bool> L,
-      std::tuple<std::string_view, bool, bool> R) {
+      std::tuple<std::string_view, bool, bool> R, bool reverse = false) {
     auto& table = GetMemoryTable(table_name);
     auto iter_l = std::get<1>(L)   ? table.GetIndexBegin()
                   : std::get<2>(L) ? table.GetIndexLower(std::get<0>(L))
@@ -216,9 +219,21 @@ class MemoryTableStorage {
     auto iter_r = std::get<1>(R)   ? table.GetIndexEnd()
                   : std::get<2>(R) ? table.GetIndexUpper(std::get<0>(R))
                                    : table.GetIndexLower(std::get<0>(R));
+    if (reverse)
+      return std::make_unique<MemoryTable::ReverseIterator>(
+          std::make_reverse_iterator(iter_r), std::make_reverse_iterator(iter_l));
     return std::make_unique<MemoryTable::Iterator>(iter_l, iter_r);
   }
 
+  // Tables in memory are not split.
+  std::vector<std::unique_ptr<Iterator<const uint8_t*>>> GetRangeIterators(
+      std::string_view table_name, std::tuple<std::string_view, bool, bool> L,
+      std::tuple<std::string_view, bool, bool> R, size_t) {
+    std::vector<std::unique_ptr<Iterator<const uint8_t*>>> ret;
+    ret.push_back(GetRangeIterator(table_name, L, R));
+    return ret;
+  }
+
   std::unique_ptr<ModifyHandle> GetModifyHandle(std::string_view table_name) {
     return std::make_unique<MemoryTable::ModifyHandle>(
         GetMemoryTable(table_name));
@@ -253,6 +268,11 @@ class MemoryTableStorage {
 
   const DBSchema& GetDBSchema() const { return schema_; }
 
+  // Tables are kept in memory, so there is no buffer pool.
+  BufferPoolReport GetBufferPoolReport() const { return {}; }
+  void SetMaxBufPages(size_t) {}
+  void Compact() {}
+
  private:
   MemoryTableStorage(std::filesystem::path&& path) : path_(std::move(path)) {}
   MemoryTableStorage(
@@ -1,11 +1,38 @@
 #include "page-manager.hpp"
 #include "common/logging.hpp"
+#include <latch>
 #include <memory>
 #include <mutex>
 
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
 namespace wing {
 
 PageManager::~PageManager() {
+  if (mapped_ != nullptr) {
+    munmap(mapped_, mapped_size_);
+    close(fd_);
+    munmap(arena_map_, arena_map_size_);
+    munmap(latches_, latches_map_size_);
+    return;
+  }
+  if (writer_.joinable()) {
+    {
+      std::lock_guard l(writer_latch_);
+      writer_stop_ = true;
+    }
+    writer_cv_.notify_all();
+    writer_.join();
+  }
+  if (rejected_) {
+    io_engine_.reset();
+    close(fd_);
+    munmap(arena_map_, arena_map_size_);
+    munmap(latches_, latches_map_size_);
+    return;
+  }
   // Flush free list standby buffer
   if (free_list_buf_standby_full_) {
     if (free_list_buf_used_ != 0) {
@@ -22,62 +49,108 @@ PageManager::~PageManager() {
   if (free_list_buf_used_ != 0) {
     free_list_buf_used_ -= 1;
     pgid_t pgid = free_list_buf_[free_list_buf_used_];
-    file_.seekp(pgid * Page::SIZE);
-    file_.write(reinterpret_cast<const char *>(free_list_buf_),
-      free_list_buf_used_ * sizeof(pgid_t));
-    pgid_t head = FreeListHead();
-    file_.seekp((pgid + 1) * Page::SIZE - sizeof(pgid_t));
-    file_.write(reinterpret_cast<const char *>(&head), sizeof(head));
+    free_list_buf_[PGID_PER_PAGE] = FreeListHead();
+    WritePage(pgid, reinterpret_cast<const char *>(free_list_buf_));
     FreeListHead() = pgid;
     FreePagesInHead() = free_list_buf_used_;
     free_list_buf_used_ = 0;
   }
-  // Flush dirty pages
-  std::vector<pgid_t> pages;
-  pages.reserve(buf_.size());
-  for (const auto& buf : buf_)
-    pages.push_back(buf.first);
-  std::sort(pages.begin(), pages.end());
-  assert(pages[0] == 0);
-  assert(buf_[0].refcount == 1);
-  buf_[0].refcount = 0;
-  for (pgid_t i : pages) {
-    auto it = buf_.find(i);
-    assert(it != buf_.end());
-    assert(it->second.refcount == 0);
-    if (it->second.dirty) {
-      file_.seekp(i * Page::SIZE);
-      file_.write(it->second.addr(), Page::SIZE);
+  // Flush dirty pages. In-flight prefetches may still be writing back their
+  // victims, which are skipped here.
+  std::vector<std::pair<pgid_t, frame_t>> pages;
+  for (size_t i = 0; i < NumShards(); ++i) {
+    std::lock_guard l(shards_[i].latch);
+    for (const auto& [pgid, info] : shards_[i].buf) {
+      assert(info.refcount == 0 || info.io_in_progress);
+      if (info.dirty && !info.io_in_progress)
+        pages.emplace_back(pgid, info.frame);
     }
   }
+  std::sort(pages.begin(), pages.end());
+  WritePages(pages);
+  // Wait for in-flight prefetches.
+  io_engine_.reset();
+  WritePage(0, meta_buf_);
+  // Return the space reserved but not used. Pages never written are read as
+  // zeros.
+  if (file_pages_ != PageNum() &&
+      ftruncate(fd_, (off_t)PageNum() * Page::SIZE) != 0) {
+    DB_WARNING("Fail to truncate file {}: {}", path_.string(),
+      strerror(errno));
+  }
+  close(fd_);
+  munmap(arena_map_, arena_map_size_);
+  munmap(latches_, latches_map_size_);
 }
 
 auto PageManager::Create(
-  std::filesystem::path path, size_t max_buf_pages
+  std::filesystem::path path, size_t max_buf_pages,
+  const PageManagerOptions& options
 ) -> std::unique_ptr<PageManager> {
-  std::ofstream f(path); // Used to create the file
+  int fd = OpenFile(path, O_RDWR | O_CREAT | O_TRUNC, options.direct_io);
+  if (fd < 0)
+    DB_ERR("Fail to create file {}: {}", path.string(), strerror(errno));
   auto pgm = std::unique_ptr<PageManager>(
-    new PageManager(path, std::fstream(path), max_buf_pages));
+    new PageManager(path, fd, max_buf_pages, options));
   pgm->Init();
   return pgm;
 }
 
 auto PageManager::Open(
-  std::filesystem::path path, size_t max_buf_pages
+  std::filesystem::path path, size_t max_buf_pages,
+  const PageManagerOptions& options
 ) -> Result<std::unique_ptr<PageManager>, io::Error> {
-  std::fstream file(path);
-  // TODO: Detect more detailed reason
-  if (!file.good())
-    return io::Error::New(io::ErrorKind::Other,
-      "Fail to open file " + path.string());
+  int fd = OpenFile(path, O_RDWR, options.direct_io);
+  if (fd < 0) {
+    return io::Error::New(
+      errno == ENOENT ? io::ErrorKind::NotFound : io::ErrorKind::Other,
+      "Fail to open file " + path.string() + ": " + strerror(errno));
+  }
   auto pgm = std::unique_ptr<PageManager>(
-    new PageManager(path, std::move(file), max_buf_pages));
+    new PageManager(path, fd, max_buf_pages, options));
   auto ret = pgm->Load();
   if (ret.has_value())
     return std::move(ret.value());
   return pgm;
 }
 
+auto PageManager::OpenReadOnlyMapped(std::filesystem::path path)
+    -> Result<std::unique_ptr<PageManager>, io::Error> {
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return io::Error::New(
+      errno == ENOENT ? io::ErrorKind::NotFound : io::ErrorKind::Other,
+      "Fail to open file " + path.string() + ": " + strerror(errno));
+  }
+  off_t size = lseek(fd, 0, SEEK_END);
+  if (size < (off_t)Page::SIZE) {
+    close(fd);
+    return io::Error::New(io::ErrorKind::Other,
+      "Error occurred when reading file " + path.string());
+  }
+  void *mapped = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+  if (mapped == MAP_FAILED) {
+    int err = errno;
+    close(fd);
+    return io::Error::New(io::ErrorKind::Other,
+      "Fail to map file " + path.string() + ": " + strerror(err));
+  }
+  madvise(mapped, size, MADV_RANDOM);
+  // The buffer pool is not used. Two frames is the minimum.
+  auto pgm = std::unique_ptr<PageManager>(new PageManager(path, fd, 2, {}));
+  pgm->mapped_ = (char *)mapped;
+  pgm->mapped_size_ = size;
+  pgm->meta_buf_ = pgm->mapped_;
+  auto err = pgm->CheckFormatVersion();
+  if (err.has_value())
+    return std::move(err.value());
+  if ((size_t)pgm->PageNum() * Page::SIZE > pgm->mapped_size_) {
+    return io::Error::New(io::ErrorKind::Other,
+      "File " + path.string() + " is truncated");
+  }
+  return pgm;
+}
+
 pgid_t PageManager::__Allocate() {
   if (free_list_buf_used_ == 0) {
     if (free_list_buf_standby_full_) {
@@ -88,47 +161,52 @@ pgid_t PageManager::__Allocate() {
     }
     pgid_t pgid = FreeListHead();
     if (pgid != 0) {
-      file_.seekg(pgid * Page::SIZE);
+      ReadPage(pgid, reinterpret_cast<char *>(free_list_buf_));
       free_list_buf_used_ = PGID_PER_PAGE;
-      file_.read(reinterpret_cast<char *>(free_list_buf_),
-        free_list_buf_used_ * sizeof(pgid_t));
-      pgid_t head;
-      file_.read(reinterpret_cast<char *>(&head), sizeof(pgid_t));
-      FreeListHead() = head;
+      FreeListHead() = free_list_buf_[PGID_PER_PAGE];
       return free_list_buf_[--free_list_buf_used_];
     }
     pgid_t ret = PageNum();
     PageNum() += 1;
-    std::filesystem::resize_file(path_, PageNum() * Page::SIZE);
+    ReserveFilePages(PageNum());
     return ret;
   } else {
     return free_list_buf_[--free_list_buf_used_];
   }
 }
 pgid_t PageManager::Allocate() {
-  std::lock_guard l(latch_);
-  pgid_t ret = __Allocate();
-  assert(ret <= is_free_.size());
-  if (ret == is_free_.size()) {
-    is_free_.push_back(false);
-  } else {
-    assert(is_free_[ret] == true);
-    is_free_[ret] = false;
+  if (mapped_ != nullptr)
+    DB_ERR("Allocating a page in a read-only page manager");
+  pgid_t ret;
+  {
+    std::lock_guard l(latch_);
+    ret = __Allocate();
+    assert(ret <= is_free_.size());
+    if (ret == is_free_.size()) {
+      is_free_.push_back(false);
+    } else {
+      assert(is_free_[ret] == true);
+      is_free_[ret] = false;
+    }
   }
+  // The page may still be pinned by those who referenced it before it was
+  // freed. It is ours again.
+  Shard& shard = shards_[ShardIndex(ret)];
+  std::lock_guard l(shard.latch);
+  auto it = shard.buf.find(ret);
+  if (it != shard.buf.end())
+    it->second.freed = false;
   return ret;
 }
 
 void PageManager::Free(pgid_t pgid) {
+  if (mapped_ != nullptr)
+    DB_ERR("Freeing a page in a read-only page manager");
+  DiscardPage(pgid);
   std::lock_guard l(latch_);
   if (is_free_[pgid])
     DB_ERR("Internal error: Double free of page {}\n", pgid);
   is_free_[pgid] = true;
-  eviction_policy_.Remove(pgid);
-  auto it = buf_.find(pgid);
-  if (it != buf_.end()) {
-    assert(it->second.refcount == 0);
-    buf_.erase(it);
-  }
   if (free_list_buf_used_ == PGID_PER_PAGE) {
     if (free_list_buf_standby_full_) {
       FlushFreeListStandby(pgid);
@@ -143,7 +221,105 @@ void PageManager::Free(pgid_t pgid) {
   free_list_buf_used_ += 1;
 }
 
+void PageManager::DiscardPage(pgid_t pgid) {
+  frame_t frame = NO_FRAME;
+  {
+    Shard& shard = shards_[ShardIndex(pgid)];
+    std::unique_lock l(shard.latch);
+    auto it = shard.buf.find(pgid);
+    while (it != shard.buf.end() &&
+        (it->second.io_in_progress || it->second.cleaning)) {
+      // It is being written back by eviction or the background writer.
+      shard.io_done.wait(l);
+      it = shard.buf.find(pgid);
+    }
+    if (it != shard.buf.end() && it->second.refcount > 0) {
+      // Removed when unpinned. See DropPage.
+      it->second.freed = true;
+      it->second.dirty = false;
+      return;
+    }
+    if (it != shard.buf.end()) {
+      UnlinkDirty(shard, it->second);
+      shard.eviction_policy->Remove(it->second.slot);
+      frame = it->second.frame;
+      shard.buf.erase(it);
+    }
+  }
+  if (frame != NO_FRAME)
+    ReleaseFrame(frame);
+}
+
+void PageManager::Relocate(std::span<const pgid_t> pages) {
+  if (mapped_ != nullptr)
+    DB_ERR("Relocating pages in a read-only page manager");
+  pgid_t old_num;
+  pgid_t new_num = pages.size() + 2;
+  // pos[pgid]: where the content of the page "pgid" is now.
+  // owner[pgid]: whose content is at "pgid" now, 0 if none.
+  std::vector<pgid_t> pos, owner;
+  {
+    std::lock_guard l(latch_);
+    old_num = PageNum();
+    pos.assign(old_num, 0);
+    owner.assign(old_num, 0);
+    for (pgid_t pgid : pages) {
+      if (pgid < 2 || pgid >= old_num || is_free_[pgid] || pos[pgid] != 0)
+        DB_ERR("Internal error: Relocating invalid page {}", pgid);
+      pos[pgid] = owner[pgid] = pgid;
+    }
+    for (pgid_t pgid = 2; pgid < old_num; ++pgid) {
+      if (pos[pgid] == 0 && !is_free_[pgid])
+        DB_ERR("Internal error: Page {} is neither free nor relocated", pgid);
+    }
+    // All free pages will be beyond the end of the file. The pages below
+    // new_num are taken by the relocated pages.
+    FreeListHead() = 0;
+    free_list_buf_used_ = 0;
+    free_list_buf_standby_full_ = false;
+    for (pgid_t pgid = 2; pgid < new_num; ++pgid)
+      is_free_[pgid] = false;
+  }
+  alignas(Page::SIZE) char tmp[Page::SIZE];
+  for (pgid_t to = 2; to < new_num; ++to) {
+    pgid_t pgid = pages[to - 2];
+    pgid_t from = pos[pgid];
+    if (from == to)
+      continue;
+    // Pages are moved to the front, so the content here, if any, belongs to
+    // a page that has not been moved yet. Swap it with the page to move.
+    Page dst = GetPage(to), src = GetPage(from);
+    pgid_t other = owner[to];
+    if (other != 0)
+      memcpy(tmp, dst.page_, Page::SIZE);
+    memcpy(dst.page_, src.page_, Page::SIZE);
+    dst.MarkDirty();
+    pos[pgid] = to;
+    owner[to] = pgid;
+    owner[from] = other;
+    if (other != 0) {
+      memcpy(src.page_, tmp, Page::SIZE);
+      src.MarkDirty();
+      pos[other] = from;
+    }
+  }
+  // Nothing is at the pages beyond the end any more. Drop them without
+  // writing them back.
+  for (pgid_t pgid = new_num; pgid < old_num; ++pgid)
+    DiscardPage(pgid);
+  std::lock_guard l(latch_);
+  PageNum() = new_num;
+  is_free_.resize(new_num);
+  if (ftruncate(fd_, (off_t)new_num * Page::SIZE) != 0)
+    DB_ERR("Fail to truncate file {}: {}", path_.string(), strerror(errno));
+  file_pages_ = new_num;
+  next_extent_pages_ = MIN_EXTENT_PAGES;
+}
+
 void PageManager::ShrinkToFit() {
+  if (mapped_ != nullptr)
+    return;
+  std::lock_guard l(latch_);
   std::vector<pgid_t> free_pages;
   while (free_list_buf_used_) {
     free_list_buf_used_ -= 1;
@@ -156,10 +332,8 @@ void PageManager::ShrinkToFit() {
   pgid_t pgid = FreeListHead();
   while (pgid != 0) {
     free_pages.push_back(pgid);
-    file_.seekg(pgid * Page::SIZE);
-    file_.read(reinterpret_cast<char *>(free_list_buf_),
-      PGID_PER_PAGE * sizeof(pgid_t));
-    file_.read(reinterpret_cast<char *>(&pgid), sizeof(pgid));
+    ReadPage(pgid, reinterpret_cast<char *>(free_list_buf_));
+    pgid = free_list_buf_[PGID_PER_PAGE];
     for (size_t i = 0; i < PGID_PER_PAGE; ++i)
       free_pages.push_back(free_list_buf_[i]);
   }
@@ -179,12 +353,11 @@ void PageManager::ShrinkToFit() {
   size_t i = 0;
   while (free_pages.size() - i > PGID_PER_PAGE) {
     pgid = free_pages[i++];
-    file_.seekp(pgid * Page::SIZE);
-    file_.write(reinterpret_cast<const char *>(free_pages.data() + i),
-      PGID_PER_PAGE * Page::SIZE);
+    memcpy(free_list_buf_, free_pages.data() + i,
+      PGID_PER_PAGE * sizeof(pgid_t));
     i += PGID_PER_PAGE;
-    pgid_t head = FreeListHead();
-    file_.write(reinterpret_cast<const char *>(&head), sizeof(head));
+    free_list_buf_[PGID_PER_PAGE] = FreeListHead();
+    WritePage(pgid, reinterpret_cast<const char *>(free_list_buf_));
     FreeListHead() = pgid;
   }
   free_list_buf_used_ = free_pages.size() - i;
@@ -196,123 +369,706 @@ void PageManager::ShrinkToFit() {
   is_free_.resize(PageNum());
 }
 
+void PageManager::ReserveFilePages(size_t pages) {
+  if (pages <= file_pages_)
+    return;
+  // Extending the file page by page would update the metadata of the file
+  // system on every allocation.
+  size_t target = std::max(pages, file_pages_ + next_extent_pages_);
+  off_t offset = (off_t)file_pages_ * Page::SIZE;
+  off_t len = (off_t)(target - file_pages_) * Page::SIZE;
+  if (fallocate(fd_, 0, offset, len) != 0) {
+    if (errno != EOPNOTSUPP)
+      DB_ERR("Fail to extend file {}: {}", path_.string(), strerror(errno));
+    // The file system does not support fallocate.
+    if (ftruncate(fd_, offset + len) != 0)
+      DB_ERR("Fail to extend file {}: {}", path_.string(), strerror(errno));
+  }
+  file_pages_ = target;
+  next_extent_pages_ = std::min(next_extent_pages_ * 2, MAX_EXTENT_PAGES);
+}
+
+void PageManager::AllocArena(HugePageMode huge_pages) {
+  constexpr size_t HUGE_PAGE_SIZE = 2 << 20;
+  arena_map_ = MAP_FAILED;
+  if (huge_pages == HugePageMode::EXPLICIT) {
+    // Huge pages are reserved when they are mapped, so the arena can not be
+    // larger than the buffer pool.
+    arena_map_size_ = (max_buf_pages_ * Page::SIZE + HUGE_PAGE_SIZE - 1)
+      / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE;
+    arena_map_ = mmap(nullptr, arena_map_size_, PROT_READ | PROT_WRITE,
+      MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (arena_map_ == MAP_FAILED) {
+      DB_WARNING("Fail to map the buffer pool with huge pages: {}. "
+        "Fall back to normal pages.", strerror(errno));
+    }
+    arena_ = (char *)arena_map_;
+    arena_pages_ = arena_map_size_ / Page::SIZE;
+  }
+  if (arena_map_ == MAP_FAILED) {
+    long phys_pages = sysconf(_SC_PHYS_PAGES);
+    long phys_page_size = sysconf(_SC_PAGE_SIZE);
+    arena_pages_ = max_buf_pages_;
+    if (phys_pages > 0 && phys_page_size > 0) {
+      arena_pages_ = std::max<size_t>(arena_pages_,
+        (size_t)phys_pages * phys_page_size / Page::SIZE);
+    }
+    size_t size = arena_pages_ * Page::SIZE;
+    // Transparent huge pages only back 2MiB-aligned regions, so map one more
+    // huge page for alignment.
+    arena_map_size_ = huge_pages == HugePageMode::TRANSPARENT
+      ? size + HUGE_PAGE_SIZE : size;
+    arena_map_ = mmap(nullptr, arena_map_size_, PROT_READ | PROT_WRITE,
+      MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (arena_map_ == MAP_FAILED)
+      DB_ERR("Fail to map the buffer pool: {}", strerror(errno));
+    arena_ = (char *)arena_map_;
+    if (huge_pages == HugePageMode::TRANSPARENT) {
+      arena_ = (char *)(((uintptr_t)arena_map_ + HUGE_PAGE_SIZE - 1)
+        / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE);
+      madvise(arena_, size, MADV_HUGEPAGE);
+    }
+  }
+  assert((uintptr_t)arena_ % Page::SIZE == 0);
+  // Zero-filled, i.e., unlocked.
+  latches_map_size_ = arena_pages_ * sizeof(FrameLatchSlot);
+  void *latches = mmap(nullptr, latches_map_size_, PROT_READ | PROT_WRITE,
+    MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  if (latches == MAP_FAILED)
+    DB_ERR("Fail to map the page latches: {}", strerror(errno));
+  latches_ = (FrameLatchSlot *)latches;
+}
 void PageManager::AllocMeta() {
-  auto buf = std::unique_ptr<char[]>(new char[Page::SIZE]);
-  // Mark dirty to force the meta page to be flushed when closing,
-  // so that we don't need to mark it dirty anymore when running.
-  auto ret = buf_.emplace(0, PageBufInfo{std::move(buf), 1, true});
-  (void)ret;
-  assert(ret.second);
-  assert(buf_.size() < max_buf_pages_);
+  meta_buf_ = FrameAddr(0);
+  buf_pages_ += 1;
+  used_frames_ += 1;
+  assert(used_frames_ < max_buf_pages_);
 }
 void PageManager::Init() {
   AllocMeta();
-  memset(buf_[0].addr_mut(), 0, Page::SIZE);
+  memset(meta_buf_, 0, Page::SIZE);
   FreeListHead() = 0;
   FreePagesInHead() = 0;
   PageNum() = 2;
+  FormatVersion() = FORMAT_VERSION;
   std::filesystem::resize_file(path_, Page::SIZE);
+  file_pages_ = 1;
   is_free_.resize(PageNum(), false);
 }
 
 std::optional<io::Error> PageManager::Load() {
   AllocMeta();
-  file_.read(buf_[0].addr_mut(), Page::SIZE);
-  if (!file_.good())
+  if (pread(fd_, meta_buf_, Page::SIZE, 0) != Page::SIZE)
     return io::Error::New(io::ErrorKind::Other,
       "Error occurred when reading file " + path_.string());
+  auto err = CheckFormatVersion();
+  if (err.has_value()) {
+    rejected_ = true;
+    return err;
+  }
+  file_pages_ = lseek(fd_, 0, SEEK_END) / Page::SIZE;
   is_free_.resize(PageNum(), false);
   pgid_t head = FreeListHead();
   if (head == 0)
     return std::nullopt;
-  file_.seekg(head * Page::SIZE);
+  ReadPage(head, reinterpret_cast<char *>(free_list_buf_));
   free_list_buf_used_ = FreePagesInHead();
-  file_.read(reinterpret_cast<char *>(free_list_buf_),
-     free_list_buf_used_ * sizeof(pgid_t));
-  pgid_t pgid;
-  file_.seekg((head + 1) * Page::SIZE - sizeof(pgid_t));
-  file_.read(reinterpret_cast<char *>(&pgid), sizeof(pgid));
+  pgid_t pgid = free_list_buf_[PGID_PER_PAGE];
   FreeListHead() = pgid;
 
   for (size_t i = 0; i < free_list_buf_used_; ++i)
     is_free_[free_list_buf_[i]] = true;
   while (pgid) {
-    file_.seekg(pgid * Page::SIZE);
     assert(!free_list_buf_standby_full_);
+    // The pages of the list are free as well, as in Free.
+    is_free_[pgid] = true;
     // Borrow free_list_buf_standby_ here
-    file_.read(reinterpret_cast<char *>(free_list_buf_standby_),
-      PGID_PER_PAGE * sizeof(pgid_t));
+    ReadPage(pgid, reinterpret_cast<char *>(free_list_buf_standby_));
     for (size_t i = 0; i < PGID_PER_PAGE; ++i)
       is_free_[free_list_buf_standby_[i]] = true;
-    file_.read(reinterpret_cast<char *>(&pgid), sizeof(pgid));
+    pgid = free_list_buf_standby_[PGID_PER_PAGE];
   }
 
   // Postpone the free here to make sure that free_list_buf_standby_ is empty.
   Free(head);
 
-  if (!file_.good())
-    return io::Error::New(io::ErrorKind::Other,
-      "Error occurred when reading file " + path_.string());
   return std::nullopt;
 }
 
-Page PageManager::GetPage(pgid_t pgid) {
-  if (pgid >= PageNum()) {
-    DB_ERR("Internal Error: " + std::to_string(pgid) + " >= " +
-        std::to_string(PageNum()));
+std::optional<io::Error> PageManager::CheckFormatVersion() {
+  if (FormatVersion() == FORMAT_VERSION)
+    return std::nullopt;
+  return io::Error::New(io::ErrorKind::Other,
+    "File " + path_.string() + " has format version " +
+    std::to_string(FormatVersion()) + ", but version " +
+    std::to_string(FORMAT_VERSION) + " is expected");
+}
+
+Page PageManager::GetPage(pgid_t pgid, ScanRing *ring) {
+  auto page = TryGetPage(pgid, ring);
+  if (!page.has_value()) {
+    DB_ERR("Internal error: Accessing free page {}, page num {}", pgid,
+      PageNum());
   }
-  if (is_free_[pgid])
-    DB_ERR("Internal error: Accessing free page {}", pgid);
-  char *addr;
-  auto it = buf_.find(pgid);
-  if (it != buf_.end()) {
-    addr = it->second.addr_mut();
-    if (it->second.refcount == 0)
-      eviction_policy_.Pin(pgid);
-    it->second.refcount += 1;
+  return std::move(page.value());
+}
+auto PageManager::TryGetPage(pgid_t pgid, ScanRing *ring)
+    -> std::optional<Page> {
+  // The meta page is always in memory and is never dropped.
+  if (pgid == 0)
+    return Page(0, meta_buf_, *this, false);
+  if (mapped_ != nullptr) {
+    if (pgid >= PageNum())
+      return std::nullopt;
+    return Page(pgid, mapped_ + (size_t)pgid * Page::SIZE, *this, false);
+  }
+  size_t home = ShardIndex(pgid);
+  Shard& shard = shards_[home];
+  std::unique_lock l(shard.latch);
+  for (;;) {
+    auto it = shard.buf.find(pgid);
+    if (it == shard.buf.end())
+      break;
+    PageBufInfo& info = it->second;
+    if (info.io_in_progress) {
+      shard.io_done.wait(l);
+      continue;
+    }
+    if (info.freed)
+      return std::nullopt;
+    if (info.refcount == 0) {
+      shard.eviction_policy->Pin(info.slot);
+      UnlinkDirty(shard, info);
+    }
+    info.refcount += 1;
+    Count(pgid, BufferPoolStats::HITS);
+    return Page(pgid, FrameAddr(info.frame), *this, false);
+  }
+  {
+    std::lock_guard alloc_l(latch_);
+    if (pgid >= PageNum() || is_free_[pgid])
+      return std::nullopt;
+  }
+  Count(pgid, BufferPoolStats::MISSES);
+  // Insert a placeholder so that other threads wait for us instead of reading
+  // the same page again. References to elements of unordered_map stay valid
+  // even if it rehashes.
+  PageBufInfo& info = shard.buf.emplace(pgid, PageBufInfo{
+    NO_FRAME, 1, false, shard.eviction_policy->Admit(pgid), true
+  }).first->second;
+  l.unlock();
+  Frame frame = ring == nullptr ? AllocFrame(home)
+    : AllocFrameForScan(home, *ring, pgid);
+  if (frame.victim == 0) {
+    ReadPage(pgid, FrameAddr(frame.id));
+  } else if (io_engine_ == nullptr) {
+    Count(frame.victim, BufferPoolStats::WRITE_BACKS);
+    WritePage(frame.victim, FrameAddr(frame.id));
+    FinishEviction(frame.victim);
+    ReadPage(pgid, FrameAddr(frame.id));
   } else {
-    assert(buf_.size() <= max_buf_pages_);
-    std::unique_ptr<char[]> buf;
-    if (buf_.size() == max_buf_pages_) {
-      pgid_t pgid_to_evict = eviction_policy_.Evict();
-      auto it = buf_.find(pgid_to_evict);
-      assert(it->second.refcount == 0);
-      if (it->second.dirty) {
-        file_.seekp(pgid_to_evict * Page::SIZE);
-        file_.write(it->second.addr(), Page::SIZE);
+    // Write back the victim and read the page in one submission.
+    Count(frame.victim, BufferPoolStats::WRITE_BACKS);
+    Count(frame.victim, BufferPoolStats::BYTES_WRITTEN, Page::SIZE);
+    Count(pgid, BufferPoolStats::BYTES_READ, Page::SIZE);
+    std::latch done(1);
+    IOChain chain{{
+      {true, (off_t)((size_t)frame.victim * Page::SIZE), FrameAddr(frame.id),
+        Page::SIZE},
+      {false, (off_t)((size_t)pgid * Page::SIZE), FrameAddr(frame.id),
+        Page::SIZE},
+    }, [this, &frame, &done]() {
+      FinishEviction(frame.victim);
+      done.count_down();
+    }};
+    io_engine_->Submit(std::span(&chain, 1));
+    done.wait();
+  }
+  l.lock();
+  info.frame = frame.id;
+  info.io_in_progress = false;
+  shard.io_done.notify_all();
+  return Page(pgid, FrameAddr(frame.id), *this, false);
+}
+void PageManager::PrefetchPages(std::span<const pgid_t> pgids,
+    ScanRing *ring) {
+  if (mapped_ != nullptr) {
+    for (pgid_t pgid : pgids) {
+      if (pgid < PageNum()) {
+        madvise(mapped_ + (size_t)pgid * Page::SIZE, Page::SIZE,
+          MADV_WILLNEED);
       }
-      buf = std::move(it->second.buf);
-      buf_.erase(it);
-    } else {
-      buf = std::unique_ptr<char[]>(new char[Page::SIZE]);
     }
-    PageBufInfo buf_info{std::move(buf), 1, false};
-    addr = buf_info.addr_mut();
-    file_.seekg(pgid * Page::SIZE);
-    file_.read(addr, Page::SIZE);
-    auto ret = buf_.emplace(pgid, std::move(buf_info));
-    (void)ret;
-    assert(ret.second);
+    return;
   }
-  return Page(pgid, addr, *this, false);
+  if (io_engine_ == nullptr)
+    return;
+  std::vector<IOChain> chains;
+  for (pgid_t pgid : pgids) {
+    if (pgid == 0)
+      continue;
+    size_t home = ShardIndex(pgid);
+    Shard& shard = shards_[home];
+    EvictionPolicy::slot_t slot;
+    {
+      std::lock_guard l(shard.latch);
+      if (shard.buf.find(pgid) != shard.buf.end())
+        continue;
+      {
+        std::lock_guard alloc_l(latch_);
+        // It is just a hint.
+        if (pgid >= PageNum() || is_free_[pgid])
+          continue;
+      }
+      // Pinned until the read completes.
+      slot = shard.eviction_policy->Admit(pgid);
+      shard.buf.emplace(pgid, PageBufInfo{NO_FRAME, 1, false, slot, true});
+    }
+    Frame frame = ring == nullptr ? TryEvict(home)
+      : TryEvictForScan(home, *ring, pgid);
+    if (frame.id == NO_FRAME) {
+      // All pages are pinned. Give up prefetching.
+      std::lock_guard l(shard.latch);
+      shard.eviction_policy->Unpin(slot);
+      shard.eviction_policy->Remove(slot);
+      shard.buf.erase(pgid);
+      shard.io_done.notify_all();
+      break;
+    }
+    IOChain chain;
+    if (frame.victim != 0) {
+      chain.requests.push_back({true,
+        (off_t)((size_t)frame.victim * Page::SIZE), FrameAddr(frame.id),
+        Page::SIZE});
+      Count(frame.victim, BufferPoolStats::WRITE_BACKS);
+      Count(frame.victim, BufferPoolStats::BYTES_WRITTEN, Page::SIZE);
+    }
+    chain.requests.push_back({false, (off_t)((size_t)pgid * Page::SIZE),
+      FrameAddr(frame.id), Page::SIZE});
+    Count(pgid, BufferPoolStats::BYTES_READ, Page::SIZE);
+    chain.done = [this, pgid, frame]() {
+      if (frame.victim != 0)
+        FinishEviction(frame.victim);
+      Shard& shard = shards_[ShardIndex(pgid)];
+      std::lock_guard l(shard.latch);
+      PageBufInfo& info = shard.buf.at(pgid);
+      info.frame = frame.id;
+      info.io_in_progress = false;
+      info.refcount -= 1;
+      if (info.refcount == 0) {
+        shard.eviction_policy->Unpin(info.slot);
+        shard.unpin_ticks += 1;
+      }
+      shard.io_done.notify_all();
+    };
+    chains.push_back(std::move(chain));
+  }
+  if (!chains.empty())
+    io_engine_->Submit(chains);
 }
 void PageManager::DropPage(pgid_t pgid, bool dirty) {
-  std::lock_guard l(latch_);
   assert(pgid != 0);
-  auto it = buf_.find(pgid);
-  assert(it != buf_.end());
-  it->second.dirty |= dirty;
-  assert(it->second.refcount > 0);
-  it->second.refcount -= 1;
-  if (it->second.refcount == 0)
-    eviction_policy_.Unpin(pgid);
+  if (mapped_ != nullptr) {
+    if (dirty)
+      DB_ERR("Modifying page {} in a read-only page manager", pgid);
+    return;
+  }
+  frame_t frame = NO_FRAME;
+  {
+    Shard& shard = shards_[ShardIndex(pgid)];
+    std::lock_guard l(shard.latch);
+    auto it = shard.buf.find(pgid);
+    assert(it != shard.buf.end());
+    PageBufInfo& info = it->second;
+    assert(info.refcount > 0);
+    info.refcount -= 1;
+    if (info.freed) {
+      // Freed while pinned. Its content does not matter anymore.
+      if (info.refcount == 0) {
+        shard.eviction_policy->Unpin(info.slot);
+        shard.eviction_policy->Remove(info.slot);
+        frame = info.frame;
+        shard.buf.erase(it);
+      }
+    } else {
+      info.dirty |= dirty;
+      if (info.refcount == 0) {
+        shard.eviction_policy->Unpin(info.slot);
+        shard.unpin_ticks += 1;
+        if (info.dirty)
+          LinkDirty(shard, pgid, info);
+      }
+    }
+  }
+  if (frame != NO_FRAME)
+    ReleaseFrame(frame);
+}
+auto PageManager::AllocFrame(size_t home) -> Frame {
+  Frame frame = TryEvict(home);
+  if (frame.id == NO_FRAME)
+    DB_ERR("Buffer size for PageManager is too small!");
+  return frame;
+}
+auto PageManager::TryEvict(size_t home) -> Frame {
+  frame_t id = TryAllocFrame();
+  if (id != NO_FRAME)
+    return Frame{id, 0};
+  for (size_t i = 0; i < NumShards(); ++i) {
+    Frame frame = EvictFrom(shards_[(home + i) & (NumShards() - 1)]);
+    if (frame.id != NO_FRAME)
+      return frame;
+  }
+  return Frame{NO_FRAME, 0};
+}
+auto PageManager::AllocFrameForScan(size_t home, ScanRing& ring, pgid_t pgid)
+    -> Frame {
+  Frame frame = TryEvictForScan(home, ring, pgid);
+  if (frame.id == NO_FRAME)
+    DB_ERR("Buffer size for PageManager is too small!");
+  return frame;
+}
+auto PageManager::TryEvictForScan(size_t home, ScanRing& ring, pgid_t pgid)
+    -> Frame {
+  pgid_t old = ring.pages_[ring.next_];
+  ring.pages_[ring.next_] = pgid;
+  ring.next_ = (ring.next_ + 1) % ScanRing::SIZE;
+  frame_t id = TryAllocFrame();
+  if (id != NO_FRAME)
+    return Frame{id, 0};
+  if (old != 0) {
+    Frame frame = EvictPage(old);
+    if (frame.id != NO_FRAME)
+      return frame;
+  }
+  // The old page is pinned or has been evicted by others.
+  return TryEvict(home);
+}
+auto PageManager::TryAllocFrame() -> frame_t {
+  if (used_frames_.fetch_add(1) >= MaxBufPages()) {
+    used_frames_.fetch_sub(1);
+    return NO_FRAME;
+  }
+  {
+    std::lock_guard l(free_frames_latch_);
+    if (!free_frames_.empty()) {
+      frame_t frame = free_frames_.back();
+      free_frames_.pop_back();
+      return frame;
+    }
+  }
+  // Frames are pushed to free_frames_ before used_frames_ is decreased, so
+  // the arena is not exhausted unless the buffer pool is full.
+  size_t frame = buf_pages_.fetch_add(1);
+  if (frame < arena_pages_)
+    return frame;
+  buf_pages_.fetch_sub(1);
+  used_frames_.fetch_sub(1);
+  return NO_FRAME;
+}
+void PageManager::ReleaseFrame(frame_t frame) {
+  {
+    std::lock_guard l(free_frames_latch_);
+    free_frames_.push_back(frame);
+  }
+  used_frames_.fetch_sub(1);
+}
+void PageManager::SetMaxBufPages(size_t max_buf_pages) {
+  if (mapped_ != nullptr)
+    return;
+  max_buf_pages = std::clamp<size_t>(max_buf_pages, 2, arena_pages_);
+  max_buf_pages_.store(max_buf_pages);
+  for (size_t i = 0; used_frames_.load() > max_buf_pages; ++i) {
+    // TryAllocFrame fails now, so it only evicts.
+    Frame frame = TryEvict(i & (NumShards() - 1));
+    if (frame.id == NO_FRAME)
+      break;
+    if (frame.victim != 0) {
+      Count(frame.victim, BufferPoolStats::WRITE_BACKS);
+      WritePage(frame.victim, FrameAddr(frame.id));
+      FinishEviction(frame.victim);
+    }
+    // Return the memory to the operating system. It fails harmlessly for
+    // explicit huge pages.
+    madvise(FrameAddr(frame.id), Page::SIZE, MADV_DONTNEED);
+    ReleaseFrame(frame.id);
+  }
+}
+auto PageManager::EvictFrom(Shard& shard) -> Frame {
+  std::lock_guard l(shard.latch);
+  for (;;) {
+    auto victim = shard.eviction_policy->Evict();
+    if (!victim.has_value())
+      return Frame{NO_FRAME, 0};
+    Frame frame = TakeFrame(shard, victim.value());
+    // Otherwise the victim is being cleaned, and its frame will be released
+    // by the background writer.
+    if (frame.id != NO_FRAME)
+      return frame;
+  }
+}
+auto PageManager::EvictPage(pgid_t pgid) -> Frame {
+  Shard& shard = shards_[ShardIndex(pgid)];
+  std::lock_guard l(shard.latch);
+  auto it = shard.buf.find(pgid);
+  if (it == shard.buf.end() || it->second.refcount != 0 ||
+      it->second.io_in_progress)
+    return Frame{NO_FRAME, 0};
+  shard.eviction_policy->Remove(it->second.slot);
+  return TakeFrame(shard, pgid);
+}
+auto PageManager::TakeFrame(Shard& shard, pgid_t pgid) -> Frame {
+  auto it = shard.buf.find(pgid);
+  assert(it != shard.buf.end());
+  PageBufInfo& info = it->second;
+  assert(info.refcount == 0);
+  UnlinkDirty(shard, info);
+  Count(pgid, BufferPoolStats::EVICTIONS);
+  if (info.cleaning) {
+    // The background writer is still reading the frame.
+    info.io_in_progress = true;
+    return Frame{NO_FRAME, 0};
+  }
+  if (info.dirty) {
+    // Readers of the victim have to wait until the write-back completes,
+    // otherwise they would read the stale version on disk.
+    info.io_in_progress = true;
+    WakeUpWriter();
+    return Frame{info.frame, pgid};
+  }
+  frame_t frame = info.frame;
+  shard.buf.erase(it);
+  shard.io_done.notify_all();
+  return Frame{frame, 0};
+}
+void PageManager::FinishEviction(pgid_t victim) {
+  Shard& shard = shards_[ShardIndex(victim)];
+  std::lock_guard l(shard.latch);
+  size_t erased = shard.buf.erase(victim);
+  (void)erased;
+  assert(erased == 1);
+  shard.io_done.notify_all();
+}
+void PageManager::LinkDirty(Shard& shard, pgid_t pgid, PageBufInfo& info) {
+  UnlinkDirty(shard, info);
+  info.in_dirty_list = true;
+  info.pgid = pgid;
+  info.unpin_tick = shard.unpin_ticks;
+  info.dirty_prev = shard.dirty_tail;
+  info.dirty_next = nullptr;
+  if (shard.dirty_tail == nullptr)
+    shard.dirty_head = &info;
+  else
+    shard.dirty_tail->dirty_next = &info;
+  shard.dirty_tail = &info;
+  shard.dirty_num += 1;
+}
+void PageManager::UnlinkDirty(Shard& shard, PageBufInfo& info) {
+  if (!info.in_dirty_list)
+    return;
+  if (info.dirty_prev == nullptr)
+    shard.dirty_head = info.dirty_next;
+  else
+    info.dirty_prev->dirty_next = info.dirty_next;
+  if (info.dirty_next == nullptr)
+    shard.dirty_tail = info.dirty_prev;
+  else
+    info.dirty_next->dirty_prev = info.dirty_prev;
+  info.in_dirty_list = false;
+  info.dirty_prev = info.dirty_next = nullptr;
+  shard.dirty_num -= 1;
+}
+void PageManager::WriterMain() {
+  auto next_checkpoint = std::chrono::steady_clock::now() +
+    checkpoint_interval_;
+  std::unique_lock l(writer_latch_);
+  while (!writer_stop_) {
+    writer_cv_.wait_for(l, writer_interval_,
+      [this]() { return writer_stop_ || writer_wakeup_; });
+    if (writer_stop_)
+      break;
+    // Clean more pages if eviction still finds dirty pages, and fewer pages
+    // if it does not, to avoid writing pages that are modified again soon.
+    if (writer_wakeup_)
+      writer_cold_shift_ = std::min(writer_cold_shift_ + 1, MAX_COLD_SHIFT);
+    else
+      writer_cold_shift_ = std::max<size_t>(writer_cold_shift_ - 1, 1);
+    writer_wakeup_ = false;
+    l.unlock();
+    CleanColdPages();
+    if (checkpoint_interval_.count() != 0 &&
+        std::chrono::steady_clock::now() >= next_checkpoint) {
+      Checkpoint();
+      next_checkpoint = std::chrono::steady_clock::now() +
+        checkpoint_interval_;
+    }
+    l.lock();
+  }
+}
+void PageManager::CleanColdPages() {
+  std::vector<std::pair<pgid_t, frame_t>> pages;
+  for (size_t i = 0; i < NumShards(); ++i) {
+    for (;;) {
+      pages.clear();
+      TakeDirtyPages(shards_[i], WRITER_BATCH, true, pages);
+      if (pages.empty())
+        break;
+      WritePages(pages);
+      for (auto [pgid, frame] : pages)
+        FinishCleaning(pgid);
+    }
+  }
+}
+void PageManager::Checkpoint() {
+  // Pages dirtied again during the checkpoint are appended to the dirty
+  // lists, so only the pages in the dirty lists now are written.
+  std::vector<size_t> remaining(NumShards());
+  for (size_t i = 0; i < NumShards(); ++i) {
+    std::lock_guard l(shards_[i].latch);
+    remaining[i] = shards_[i].dirty_num;
+  }
+  size_t batch = WRITER_BATCH;
+  if (checkpoint_pages_per_sec_ != 0)
+    batch = std::min(batch, checkpoint_pages_per_sec_);
+  auto next = std::chrono::steady_clock::now();
+  std::vector<std::pair<pgid_t, frame_t>> pages;
+  for (size_t i = 0; i < NumShards(); ++i) {
+    while (remaining[i] > 0) {
+      {
+        std::unique_lock l(writer_latch_);
+        if (checkpoint_pages_per_sec_ != 0) {
+          // The destructor writes the rest.
+          if (writer_cv_.wait_until(l, next, [this]() { return writer_stop_; }))
+            return;
+        }
+        if (writer_stop_)
+          return;
+        if (writer_wakeup_) {
+          writer_wakeup_ = false;
+          l.unlock();
+          CleanColdPages();
+        }
+      }
+      pages.clear();
+      TakeDirtyPages(shards_[i], std::min(batch, remaining[i]), false, pages);
+      if (pages.empty())
+        break;
+      remaining[i] -= pages.size();
+      WritePages(pages);
+      for (auto [pgid, frame] : pages)
+        FinishCleaning(pgid);
+      if (checkpoint_pages_per_sec_ != 0) {
+        next += std::chrono::microseconds(
+          pages.size() * 1000000 / checkpoint_pages_per_sec_);
+      }
+    }
+  }
+}
+void PageManager::TakeDirtyPages(Shard& shard, size_t max, bool cold_only,
+    std::vector<std::pair<pgid_t, frame_t>>& pages) {
+  std::lock_guard l(shard.latch);
+  // A page is regarded as cold if enough pages of the shard have been
+  // unpinned after it.
+  uint64_t cold_age = shard.buf.size() >> writer_cold_shift_;
+  PageBufInfo *info = shard.dirty_head;
+  while (info != nullptr && pages.size() < max) {
+    if (cold_only && shard.unpin_ticks - info->unpin_tick < cold_age)
+      break;
+    PageBufInfo *next = info->dirty_next;
+    assert(info->refcount == 0 && !info->io_in_progress && !info->cleaning);
+    UnlinkDirty(shard, *info);
+    // Cleared before writing, so that modifications during the write mark it
+    // dirty again.
+    info->dirty = false;
+    info->cleaning = true;
+    pages.emplace_back(info->pgid, info->frame);
+    info = next;
+  }
+}
+void PageManager::WritePages(
+    std::span<const std::pair<pgid_t, frame_t>> pages) {
+  for (auto [pgid, frame] : pages)
+    Count(pgid, BufferPoolStats::WRITE_BACKS);
+  if (io_engine_ == nullptr) {
+    for (auto [pgid, frame] : pages)
+      WritePage(pgid, FrameAddr(frame));
+  } else {
+    std::latch done(pages.size());
+    std::vector<IOChain> chains;
+    for (auto [pgid, frame] : pages) {
+      Count(pgid, BufferPoolStats::BYTES_WRITTEN, Page::SIZE);
+      chains.push_back(IOChain{{
+        {true, (off_t)((size_t)pgid * Page::SIZE), FrameAddr(frame),
+          Page::SIZE},
+      }, [&done]() { done.count_down(); }});
+    }
+    io_engine_->Submit(chains);
+    done.wait();
+  }
+}
+void PageManager::FinishCleaning(pgid_t pgid) {
+  Shard& shard = shards_[ShardIndex(pgid)];
+  std::unique_lock l(shard.latch);
+  auto it = shard.buf.find(pgid);
+  assert(it != shard.buf.end());
+  PageBufInfo& info = it->second;
+  info.cleaning = false;
+  if (info.io_in_progress) {
+    // Evicted during cleaning. Nobody can access it now.
+    if (info.dirty) {
+      l.unlock();
+      Count(pgid, BufferPoolStats::WRITE_BACKS);
+      WritePage(pgid, FrameAddr(info.frame));
+      l.lock();
+    }
+    frame_t frame = info.frame;
+    shard.buf.erase(it);
+    ReleaseFrame(frame);
+  }
+  shard.io_done.notify_all();
+}
+BufferPoolCounters PageManager::GetStats() const {
+  BufferPoolCounters ret;
+  for (size_t i = 0; i < NumShards(); ++i)
+    ret += shards_[i].stats.Load();
+  return ret;
+}
+void PageManager::WakeUpWriter() {
+  if (!writer_.joinable())
+    return;
+  {
+    std::lock_guard l(writer_latch_);
+    writer_wakeup_ = true;
+  }
+  writer_cv_.notify_one();
+}
+void PageManager::ReadPage(pgid_t pgid, char *buf) {
+  // The page may have been allocated but never written, in which case it is
+  // read as zeros.
+  Count(pgid, BufferPoolStats::BYTES_READ, Page::SIZE);
+  ReadFull(fd_, buf, Page::SIZE, (off_t)pgid * Page::SIZE);
+}
+void PageManager::WritePage(pgid_t pgid, const char *buf) {
+  Count(pgid, BufferPoolStats::BYTES_WRITTEN, Page::SIZE);
+  WriteFull(fd_, buf, Page::SIZE, (off_t)pgid * Page::SIZE);
+}
+bool PageManager::IsDirectIO() const {
+  int flags = fcntl(fd_, F_GETFL);
+  return flags >= 0 && (flags & O_DIRECT);
+}
+int PageManager::OpenFile(const std::filesystem::path& path, int flags,
+    bool direct_io) {
+  if (direct_io) {
+    int fd = open(path.c_str(), flags | O_DIRECT, 0644);
+    if (fd >= 0 || errno != EINVAL)
+      return fd;
+    DB_WARNING("{} does not support O_DIRECT. Fall back to buffered I/O.",
+      path.string());
+  }
+  return open(path.c_str(), flags, 0644);
 }
 void PageManager::FlushFreeListStandby(pgid_t pgid) {
-  file_.seekp(pgid * Page::SIZE);
-  file_.write(reinterpret_cast<const char *>(free_list_buf_standby_),
-    PGID_PER_PAGE * sizeof(pgid_t));
-  pgid_t head = FreeListHead();
-  file_.write(reinterpret_cast<const char *>(&head), sizeof(head));
+  free_list_buf_standby_[PGID_PER_PAGE] = FreeListHead();
+  WritePage(pgid, reinterpret_cast<const char *>(free_list_buf_standby_));
   FreeListHead() = pgid;
   free_list_buf_standby_full_ = false;
 }
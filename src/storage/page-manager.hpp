@@ -3,18 +3,26 @@
 
 #include "common/error.hpp"
 #include "common/logging.hpp"
+#include "storage/buffer-pool-stats.hpp"
+#include "storage/eviction-policy.hpp"
+#include "storage/io-engine.hpp"
 
 #include<iostream>
 #include <algorithm>
+#include <atomic>
+#include <bit>
 #include <cassert>
+#include <chrono>
+#include <condition_variable>
 #include <cstdint>
 #include <cstring>
 #include <filesystem>
 #include <fstream>
-#include <list>
 #include <mutex>
 #include <optional>
+#include <span>
 #include <string_view>
+#include <thread>
 #include <unordered_map>
 #include <variant>
 #include <vector>
@@ -27,6 +35,71 @@ typedef uint32_t pgid_t;
 typedef uint16_t pgoff_t;
 typedef int16_t signed_pgoff_t;
 typedef uint16_t slotid_t;
+// A normalized key prefix. See SortedPage.
+typedef uint32_t slothead_t;
+
+/* A version latch of a page buffer for optimistic lock coupling.
+ *
+ * Readers do not write the latch. A reader gets the version with ReadLock,
+ * reads the page, and then checks with Validate that the page has not been
+ * modified meanwhile. If it has, what has been read may be inconsistent and
+ * the reader should restart. So a reader should not trust what it reads
+ * before validating, e.g., a page ID read from an inner page should be
+ * validated before the page is used.
+ *
+ * A writer locks the latch exclusively with Lock, or with TryUpgrade if it
+ * has read the page optimistically, and the version changes when it unlocks.
+ * A writer never waits for a latch while holding one, unless it is in a
+ * PageWriteSet, so there is no deadlock.
+ *
+ * The lowest bit of the version is set while it is locked.
+ */
+class PageLatch {
+public:
+  uint64_t ReadLock() const {
+    for (size_t spin = 0; ; ++spin) {
+      uint64_t version = version_.load(std::memory_order_acquire);
+      if (!(version & 1))
+        return version;
+      Backoff(spin);
+    }
+  }
+  // Same as ReadLock, but std::nullopt instead of waiting if it is locked.
+  std::optional<uint64_t> TryReadLock() const {
+    uint64_t version = version_.load(std::memory_order_acquire);
+    if (version & 1)
+      return std::nullopt;
+    return version;
+  }
+  bool Validate(uint64_t version) const {
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return version_.load(std::memory_order_relaxed) == version;
+  }
+  bool TryUpgrade(uint64_t version) {
+    if (!version_.compare_exchange_strong(version, version + 1,
+        std::memory_order_acquire))
+      return false;
+    std::atomic_thread_fence(std::memory_order_release);
+    return true;
+  }
+  void Lock() {
+    for (size_t spin = 0; ; ++spin) {
+      if (TryUpgrade(ReadLock()))
+        return;
+      Backoff(spin);
+    }
+  }
+  void Unlock() {
+    version_.fetch_add(1, std::memory_order_release);
+  }
+private:
+  static void Backoff(size_t spin) {
+    if (spin >= 64)
+      std::this_thread::yield();
+  }
+  std::atomic<uint64_t> version_{0};
+};
+
 // A page handle that references a page buffer. This is not expected to be used
 // directly by the user. The user should use PlainPage or SortedPage instead,
 // which are derived classes of this class.
@@ -51,17 +124,37 @@ public:
   ~Page();
   inline pgid_t ID() const { return id_; }
   inline const char *as_ptr() const { return page_; }
-  inline void MarkDirty() { dirty_=true; }
+  // If the thread is in a PageWriteSet, the page is latched exclusively.
+  inline void MarkDirty();
+  // The latch of the page buffer.
+  inline PageLatch& Latch() const;
   inline void Drop();
 protected:
   Page(pgid_t id,char *page,std::reference_wrapper<PageManager> pgm,bool dirty):id_(id),page_(page),pgm_(pgm),dirty_(dirty) {}
   inline pgoff_t Offset(void *addr) { return (pgoff_t)((char *)addr-page_); }
+  // Atomically access an aligned integer at "start", e.g., a counter that
+  // concurrent writers update. Unlike Write, FetchAdd does not latch the page
+  // even if the thread is in a PageWriteSet.
+  template <typename T>
+  inline T AtomicRead(pgoff_t start) const {
+    assert(start % alignof(T) == 0);
+    return std::atomic_ref<T>(*(T *)(page_ + start))
+      .load(std::memory_order_relaxed);
+  }
+  template <typename T>
+  inline T FetchAdd(pgoff_t start, T delta) {
+    assert(start % alignof(T) == 0);
+    dirty_ = true;
+    return std::atomic_ref<T>(*(T *)(page_ + start))
+      .fetch_add(delta, std::memory_order_relaxed);
+  }
   inline void __Drop();
   pgid_t id_;
   char *page_;
   std::reference_wrapper<PageManager> pgm_;
   bool dirty_;
   friend class PageManager;
+  friend class PageWriteSet;
 };
 
 class PlainPage : public Page {
@@ -84,16 +177,71 @@ public:
     MarkDirty();
     memcpy(page_ + start, data.data(), data.size());
   }
+  using Page::AtomicRead;
+  using Page::FetchAdd;
 private:
   friend class PageManager;
 };
 
+/* The pages latched by a writer that modifies several pages at once, e.g., a
+ * B+tree split. While it is alive, a page is latched exclusively right before
+ * the thread modifies it for the first time (see Page::MarkDirty), or when the
+ * thread calls Latch on it, and all pages are unlatched together when it
+ * destructs. So optimistic readers never see the modification half done.
+ *
+ * Writers in write sets may wait for each other, so they should be
+ * serialized by the user.
+ */
+class PageWriteSet {
+public:
+  PageWriteSet() : prev_(current_) { current_ = this; }
+  PageWriteSet(const PageWriteSet&) = delete;
+  PageWriteSet& operator=(const PageWriteSet&) = delete;
+  ~PageWriteSet() {
+    for (auto& page : pages_)
+      page.Latch().Unlock();
+    pages_.clear();
+    for (auto latch : latches_)
+      latch->Unlock();
+    current_ = prev_;
+  }
+  // Latch the page if the thread is in a write set.
+  static void Latch(const Page& page) {
+    if (current_ != nullptr)
+      current_->Add(page);
+  }
+  // The same for a latch not in a page buffer, e.g., of the data of a page
+  // cached in memory.
+  static void Latch(PageLatch& latch) {
+    if (current_ != nullptr)
+      current_->Add(latch);
+  }
+private:
+  inline void Add(const Page& page);
+  void Add(PageLatch& latch) {
+    if (std::find(latches_.begin(), latches_.end(), &latch) != latches_.end())
+      return;
+    latch.Lock();
+    latches_.push_back(&latch);
+  }
+  // Pinned until unlatched.
+  std::vector<Page> pages_;
+  std::vector<PageLatch *> latches_;
+  PageWriteSet *prev_;
+  static thread_local inline PageWriteSet *current_ = nullptr;
+};
+
+inline void Page::MarkDirty() {
+  dirty_ = true;
+  PageWriteSet::Latch(*this);
+}
+
 /* The handle that references a page buffer whose format is SortedPage.
  * All tuples are sorted in SortedPage. Layout:
  * +--------+-----------------------------------------------------+
- * | N (2B) | special (2B)   start_0 (2B)  start_1 (2B)     ...   |
+ * | N (2B) | special (2B)  start_0 (2B) head_0 (4B)  start_1 ... |
  * +--------+---------+-------------------------+-----------------+
- * | ... start_{N-1}  |       Free space        | tuple_{N-1} ... |
+ * | ... head_{N-1}   |       Free space        | tuple_{N-1} ... |
  * +----------+-------+---+----------------+----+-----------------+
  * | ... | tuple_1        | tuple_0        | "special space"      |
  * +----------------------+----------------+----------------------+
@@ -103,7 +251,7 @@ private:
  * the format of a tuple is (key, value), each tuple is of size 8,
  * and keys are compared as integers.
  * If I want to store (2, 3), (4, 5), (114, 514) in this page,
- * then the page layout is:
+ * then the page layout is (heads omitted):
  * 
  * | 3 | 4092 | 4084 | 4076 | 4068 | (free space) | (114, 514) | (4, 5) | (2, 3) | special space |
  *
@@ -111,11 +259,20 @@ private:
  * and the comparison between two slots is performed by SlotCompare.
  * The parse of slots is performed in SlotKeyCompare and SlotCompare,
  * so we don't have to care about the content of slots in this class.
+ *
+ * head_i is a 4-byte normalized prefix of the key of tuple_i, which is given
+ * by SlotKeyCompare::SlotHead if it exists (otherwise 0). The key of "key"
+ * should be given by SlotKeyCompare::KeyHead. They preserve the order, i.e.,
+ * if head(a) < head(b) then a < b. So a search first narrows the range by
+ * the heads, which are next to the offsets, and only compares the tuples
+ * with the same head as the key.
  */
 template <typename SlotKeyCompare,typename SlotCompare>
 class SortedPage:public Page
 {
 public:
+  // The space taken by each slot besides its content.
+  static constexpr size_t SLOT_OVERHEAD=sizeof(pgoff_t)+sizeof(slothead_t);
   SortedPage(Page&& page, const SlotKeyCompare& slot_key_comp, const SlotCompare& slot_comp):Page(std::move(page)),slot_key_comp_(slot_key_comp),slot_comp_(slot_comp) {}
   SortedPage(const SortedPage&)=delete;
   SortedPage& operator=(const SortedPage&)=delete;
@@ -135,14 +292,16 @@ public:
     return *(slotid_t *)page_;
   }
   inline bool IsEmpty() const { return (SlotNum()==0); }
+  // The space used by the slots, including their offsets and heads.
+  inline size_t UsedSpace() const { return SlotsSpace(0,SlotNum()); }
   inline const char *SlotRaw(slotid_t slot) const {
     assert(slot<SlotNum());
-    return page_+Starts()[slot];
+    return page_+Start(slot);
   }
   inline char *SlotRawMut(slotid_t slot) {
     MarkDirty();
     assert(slot<SlotNum());
-    return page_+StartsMut()[slot];
+    return page_+Start(slot);
   }
   inline std::string_view Slot(slotid_t slot) const {
     assert(slot<SlotNum());
@@ -153,9 +312,28 @@ public:
     MarkDirty();
     memcpy(SpecialMut()+start,data.data(),data.size());
   }
-  inline bool IsInsertable(std::string_view slot) const { return (FreeSpace()>=slot.size()+sizeof(pgoff_t)); }
+  // Overwrite a part of the slot in place. Its key should not change.
+  inline void WriteSlot(slotid_t slot,pgoff_t start,std::string_view data) {
+    assert(start+data.size()<=SlotSize(slot));
+    memcpy(SlotRawMut(slot)+start,data.data(),data.size());
+  }
+  // The same as Page::AtomicRead and Page::FetchAdd, but "start" is in the
+  // slot. The caller makes sure that it is aligned.
+  template <typename T>
+  inline T AtomicReadSlot(slotid_t slot,pgoff_t start) const { return AtomicRead<T>(Start(slot)+start); }
+  template <typename T>
+  inline T FetchAddSlot(slotid_t slot,pgoff_t start,T delta) { return FetchAdd<T>(Start(slot)+start,delta); }
+  // The same for the special space.
+  template <typename T>
+  inline T AtomicReadSpecial(pgoff_t start) const { return AtomicRead<T>(End(0)+start); }
+  template <typename T>
+  inline T FetchAddSpecial(pgoff_t start,T delta) { return FetchAdd<T>(End(0)+start,delta); }
+  inline bool IsInsertable(std::string_view slot) const { return (FreeSpace()>=slot.size()+SLOT_OVERHEAD); }
   inline bool IsReplacable(slotid_t slotid,std::string_view slot) const { return (FreeSpace()+SlotSize(slotid)>=slot.size()); }
+  // The first slot in [l, r) that is not less than "d".
   slotid_t gao1(slotid_t l, slotid_t r,std::string_view d) const {
+    slothead_t h=KeyHead(d);
+    l=HeadLowerBound(l,r,h);r=HeadUpperBound(l,r,h);
     while (l!=r)
     {
       slotid_t mid=(l+r)/2;
@@ -164,7 +342,10 @@ public:
     }
     return l;
   }
+  // The first slot in [l, r) that is greater than "d".
   slotid_t gao2(slotid_t l,slotid_t r,std::string_view d) const {
+    slothead_t h=KeyHead(d);
+    l=HeadLowerBound(l,r,h);r=HeadUpperBound(l,r,h);
     while (l!=r)
     {
       slotid_t mid=(l+r)/2;
@@ -193,10 +374,10 @@ public:
   }
   void AppendSlotUnchecked(std::string_view slot) {
     MarkDirty();
-    pgoff_t tail_offset=Ends()[SlotNum()];
-    pgoff_t start=tail_offset-slot.size();
+    slotid_t n=SlotNum();
+    pgoff_t start=End(n)-slot.size();
     memcpy(page_+start,slot.data(),slot.size());
-    StartsMut()[SlotNum()]=start;
+    SetEntry(n,start,SlotHead(slot));
     SlotNumMut()+=1;
   }
   inline bool InsertBeforeSlot(slotid_t slotid,std::string_view slot)
@@ -204,28 +385,25 @@ public:
     if (!IsInsertable(slot)) return false;
     MarkDirty();
     slotid_t n=SlotNum();
-    pgoff_t h1=Starts()[n-1],h2=Ends()[slotid];
+    pgoff_t h1=End(n),h2=End(slotid);
     memmove(page_+h1-slot.size(),page_+h1,h2-h1);
-    for (slotid_t j=1;j<=n-slotid;j++)
-    {
-      slotid_t i=n-j;
-      StartsMut()[i+1]=Starts()[i]-slot.size();
-    }
+    memmove(Entry(slotid+1),Entry(slotid),(n-slotid)*ENTRY_SIZE);
+    for (slotid_t i=slotid+1;i<=n;i++) SetStart(i,Start(i)-slot.size());
     h1=h2-slot.size();
     memcpy(page_+h1,slot.data(),h2-h1);
-    StartsMut()[slotid]=h1;SlotNumMut()+=1;
+    SetEntry(slotid,h1,SlotHead(slot));SlotNumMut()+=1;
     return true;
   }
   bool SplitInsert(SortedPage<SlotKeyCompare,SlotCompare>& right,slotid_t slotid,std::string_view slot) {
     MarkDirty();
     if (IsInsertable(slot)) return InsertBeforeSlot(slotid,slot);
     slotid_t n=SlotNum();
-    if (Ends()[slotid]-sizeof(slotid_t)-sizeof(pgoff_t)-sizeof(pgoff_t)*slotid>=sizeof(pgoff_t)+slot.size())
+    if (End(slotid)-HEADER_SIZE-SLOT_OVERHEAD*slotid>=SLOT_OVERHEAD+slot.size())
     {
       for (slotid_t i=slotid;i<n;i++) right.AppendSlotUnchecked(Slot(i));
       SlotNumMut()=slotid+1;
-      StartsMut()[slotid]=Ends()[slotid]-slot.size();
-      memcpy(page_+Starts()[slotid],slot.data(),slot.size());
+      SetEntry(slotid,End(slotid)-slot.size(),SlotHead(slot));
+      memcpy(page_+Start(slotid),slot.data(),slot.size());
     }
     else
     {
@@ -238,30 +416,32 @@ public:
   bool Replace(slotid_t slotid,std::string_view slot)
   {
     MarkDirty();
-    memcpy(page_+Starts()[slotid],slot.data(),slot.size());
+    memcpy(page_+Start(slotid),slot.data(),slot.size());
+    SetHead(slotid,SlotHead(slot));
     return true;
   }
   bool ReplaceSlot(slotid_t slotid,std::string_view slot)
   {
     MarkDirty();
     slotid_t n=SlotNum();
-    pgoff_t h1=Starts()[n-1],h2=Starts()[slotid];
-    signed_pgoff_t hh=(Ends()[slotid]-h2)-slot.size();
+    pgoff_t h1=End(n),h2=Start(slotid);
+    signed_pgoff_t hh=(End(slotid)-h2)-slot.size();
     memmove(page_+h1+hh,page_+h1,h2-h1);
-    for (slotid_t i=slotid;i<n;i++) StartsMut()[i]+=hh;
-    memcpy(page_+Starts()[slotid],slot.data(),slot.size());
+    for (slotid_t i=slotid;i<n;i++) SetStart(i,Start(i)+hh);
+    memcpy(page_+Start(slotid),slot.data(),slot.size());
+    SetHead(slotid,SlotHead(slot));
     return true;
   }
   bool SplitReplace(SortedPage<SlotKeyCompare,SlotCompare>& right,slotid_t slotid,std::string_view slot) {
     MarkDirty();
     if (IsReplacable(slotid,slot)) return ReplaceSlot(slotid,slot);
     slotid_t n=SlotNum();
-    if (Ends()[slotid]-sizeof(slotid_t)-sizeof(pgoff_t)-sizeof(pgoff_t)*slotid>=sizeof(pgoff_t)+slot.size())
+    if (End(slotid)-HEADER_SIZE-SLOT_OVERHEAD*slotid>=SLOT_OVERHEAD+slot.size())
     {
       for (slotid_t i=slotid+1;i<n;i++) right.AppendSlotUnchecked(Slot(i));
       SlotNumMut()=slotid+1;
-      StartsMut()[slotid]=Ends()[slotid]-slot.size();
-      memcpy(page_+Starts()[slotid],slot.data(),slot.size());
+      SetEntry(slotid,End(slotid)-slot.size(),SlotHead(slot));
+      memcpy(page_+Start(slotid),slot.data(),slot.size());
     }
     else
     {
@@ -274,73 +454,89 @@ public:
   void DeleteSlot(slotid_t slotid) {
     MarkDirty();
     slotid_t n=SlotNum();
-    pgoff_t h1=Starts()[n-1],h2=Starts()[slotid],hh=Ends()[slotid]-h2;
+    pgoff_t h1=End(n),h2=Start(slotid),hh=End(slotid)-h2;
     memmove(page_+h1+hh,page_+h1,h2-h1);
-    for (slotid_t i=slotid;i<n-1;i++) StartsMut()[i]=Starts()[i+1]+hh;
+    memmove(Entry(slotid),Entry(slotid+1),(n-1-slotid)*ENTRY_SIZE);
+    for (slotid_t i=slotid;i<n-1;i++) SetStart(i,Start(i)+hh);
     SlotNumMut()-=1;
   }
 
 private:
-  class ComparePageOffKey {
-  public:
-    std::weak_ordering operator()(const pgoff_t *start,std::string_view key) const {
-      size_t len=*(start-1)-*start;
-      std::string_view slot(page_+*start,len);
-      return slot_key_comp_(slot,key);
-    }
-  private:
-    ComparePageOffKey(const char *page,SlotKeyCompare slot_key_comp):page_(page),slot_key_comp_(slot_key_comp) {}
-    const char *page_;
-    SlotKeyCompare slot_key_comp_;
-    friend class SortedPage;
-  };
-  class ComparePageOffSlot {
-  public:
-    std::weak_ordering operator()(const pgoff_t *start,std::string_view slot) const {
-      size_t len=*(start-1)-*start;
-      std::string_view cur_slot(page_+*start,len);
-      return slot_comp_(cur_slot,slot);
-    }
-  private:
-    ComparePageOffSlot(const char *page, SlotCompare slot_comp)
-      :	page_(page), slot_comp_(slot_comp) {}
-    const char *page_;
-    SlotCompare slot_comp_;
-    friend class SortedPage;
-  };
-  inline const char *Special() const { return page_+Ends()[0]; }
-  inline char *SpecialMut() {
-    MarkDirty();
-    return page_ + EndsMut()[0];
+  // N and special.
+  static constexpr size_t HEADER_SIZE=sizeof(slotid_t)+sizeof(pgoff_t);
+  // start_i and head_i.
+  static constexpr size_t ENTRY_SIZE=SLOT_OVERHEAD;
+  // The entries are not aligned, so they are accessed with memcpy.
+  inline const char *Entry(slotid_t slot) const { return page_+HEADER_SIZE+ENTRY_SIZE*slot; }
+  inline char *Entry(slotid_t slot) { return page_+HEADER_SIZE+ENTRY_SIZE*slot; }
+  inline pgoff_t Start(slotid_t slot) const {
+    pgoff_t start;
+    memcpy(&start,Entry(slot),sizeof(start));
+    return start;
   }
-  inline const pgoff_t *Ends() const {
-    const pgoff_t *special=(const pgoff_t*)((const slotid_t *)page_+1);
-    return special;
+  inline slothead_t Head(slotid_t slot) const {
+    slothead_t head;
+    memcpy(&head,Entry(slot)+sizeof(pgoff_t),sizeof(head));
+    return head;
   }
-  inline pgoff_t *EndsMut() {
-    MarkDirty();
-    slotid_t *num = (slotid_t *)page_;
-    pgoff_t *special = (pgoff_t *)(num + 1);
-    return special;
+  // The end of slot "slot", i.e., the start of slot "slot - 1" or the special
+  // space.
+  inline pgoff_t End(slotid_t slot) const {
+    if (slot==0) return *(const pgoff_t *)(page_+sizeof(slotid_t));
+    return Start(slot-1);
   }
-  inline const pgoff_t *Starts() const { return Ends()+1; }
-  inline pgoff_t *StartsMut() {
-    MarkDirty();
-    return EndsMut()+1;
+  // The callers have marked the page dirty.
+  inline void SetStart(slotid_t slot,pgoff_t start) { memcpy(Entry(slot),&start,sizeof(start)); }
+  inline void SetHead(slotid_t slot,slothead_t head) { memcpy(Entry(slot)+sizeof(pgoff_t),&head,sizeof(head)); }
+  inline void SetEntry(slotid_t slot,pgoff_t start,slothead_t head) {
+    SetStart(slot,start);SetHead(slot,head);
+  }
+  slothead_t SlotHead(std::string_view slot) const {
+    if constexpr (requires { slot_key_comp_.SlotHead(slot); }) return slot_key_comp_.SlotHead(slot);
+    else return 0;
   }
-  inline pgoff_t SlotSize(slotid_t slot) const {
-    const pgoff_t *ends=Ends();
-    const pgoff_t *starts=ends+1;
-    return ends[slot]-starts[slot];
+  slothead_t KeyHead(std::string_view key) const {
+    if constexpr (requires { slot_key_comp_.KeyHead(key); }) return slot_key_comp_.KeyHead(key);
+    else return 0;
+  }
+  // The first slot in [l, r) whose head is not less than "h". The loop has no
+  // branch other than the loop condition.
+  slotid_t HeadLowerBound(slotid_t l,slotid_t r,slothead_t h) const {
+    slotid_t len=r-l;
+    if (len==0) return l;
+    while (len>1)
+    {
+      slotid_t half=len/2;
+      l+=(Head(l+half)<h)*half;
+      len-=half;
+    }
+    return l+(Head(l)<h);
+  }
+  // The first slot in [l, r) whose head is greater than "h".
+  slotid_t HeadUpperBound(slotid_t l,slotid_t r,slothead_t h) const {
+    slotid_t len=r-l;
+    if (len==0) return l;
+    while (len>1)
+    {
+      slotid_t half=len/2;
+      l+=(Head(l+half)<=h)*half;
+      len-=half;
+    }
+    return l+(Head(l)<=h);
   }
-  inline pgoff_t SlotSpace(slotid_t slot) const { return SlotSize(slot)+sizeof(pgoff_t); }
-  inline pgoff_t SlotsSize(slotid_t start,slotid_t end) const { return Ends()[start]-Ends()[end]; }
-  inline pgoff_t SlotsSpace(slotid_t start,slotid_t end) const { return SlotsSize(start,end)+(end-start)*sizeof(pgoff_t); }
+  inline const char *Special() const { return page_+End(0); }
+  inline char *SpecialMut() {
+    MarkDirty();
+    return page_+End(0);
+  }
+  inline pgoff_t SlotSize(slotid_t slot) const { return End(slot)-Start(slot); }
+  inline pgoff_t SlotSpace(slotid_t slot) const { return SlotSize(slot)+SLOT_OVERHEAD; }
+  inline pgoff_t SlotsSize(slotid_t start,slotid_t end) const { return End(start)-End(end); }
+  inline pgoff_t SlotsSpace(slotid_t start,slotid_t end) const { return SlotsSize(start,end)+(end-start)*SLOT_OVERHEAD; }
   // Return the size of free space in this page.
   inline pgoff_t FreeSpace() const {
     slotid_t num=SlotNum();
-    const pgoff_t *ends=Ends();
-    return ends[num]-sizeof(slotid_t)-sizeof(pgoff_t)-sizeof(pgoff_t)*num;
+    return End(num)-HEADER_SIZE-SLOT_OVERHEAD*num;
   }
 
   SlotKeyCompare slot_key_comp_;
@@ -348,43 +544,54 @@ private:
   friend class PageManager;
 };
 
-// Evict the page that has been unpinned for the longest time.
-class EvictionPolicy {
+enum class HugePageMode {
+  NONE,
+  // Advise the kernel to back the buffer pool with transparent huge pages.
+  TRANSPARENT,
+  // Map the buffer pool with explicit huge pages (hugetlbfs). Fall back to
+  // normal pages if no huge page is reserved in the system.
+  EXPLICIT,
+};
+
+struct PageManagerOptions {
+  // The eviction policy of each shard of the buffer pool.
+  EvictionPolicyKind eviction_policy = EvictionPolicyKind::LRU;
+  HugePageMode huge_pages = HugePageMode::NONE;
+  // Open the file with O_DIRECT, so that the buffer pool is the only cache of
+  // pages and the memory usage is predictable. Fall back to buffered I/O if
+  // the file system does not support it.
+  bool direct_io = false;
+  // Used for prefetching and for writing back the victim and reading the
+  // missing page in one submission.
+  IOEngineKind io_engine = IOEngineKind::SYNC;
+  // Write back dirty pages that are getting close to eviction in a background
+  // thread, so that eviction seldom has to write before it reads.
+  bool background_writer = false;
+  // How often the background writer looks for such pages.
+  std::chrono::milliseconds writer_interval{10};
+  // The background writer also writes back all dirty pages every
+  // "checkpoint_interval", so that fewer pages are left to write at shutdown.
+  // 0 disables checkpoints.
+  std::chrono::milliseconds checkpoint_interval{0};
+  // Limit the write rate of checkpoints. 0 means unlimited.
+  size_t checkpoint_pages_per_sec = 0;
+};
+
+/* The access strategy of a large sequential scan. Once the buffer pool is
+ * full, a page read by the scan takes the buffer of the page it read
+ * ScanRing::SIZE pages ago, instead of evicting other pages. So that a full
+ * table scan only occupies a small ring of buffers, and does not flush the hot
+ * pages (e.g., the inner pages of B+trees) out of the buffer pool.
+ */
+class ScanRing {
 public:
-  pgid_t Evict() {
-    if (evictable_.empty())
-      DB_ERR("Buffer size for PageManager is too small!");
-    pgid_t ret = evictable_.front();
-    evictable_.pop_front();
-    size_t erased = its_.erase(ret);
-    (void)erased;
-    assert(erased == 1);
-    return ret;
-  }
-  void Pin(pgid_t pgid) {
-    auto it = its_.find(pgid);
-    assert(it != its_.end());
-    evictable_.erase(it->second);
-    its_.erase(it);
-  }
-  void Unpin(pgid_t pgid) {
-    evictable_.push_back(pgid);
-    auto it = evictable_.end();
-    --it;
-    auto ret = its_.emplace(pgid, it);
-    (void)ret;
-    assert(ret.second);
-  }
-  void Remove(pgid_t pgid) {
-    auto it = its_.find(pgid);
-    if (it == its_.end())
-      return;
-    evictable_.erase(it->second);
-    its_.erase(it);
-  }
+  static constexpr size_t SIZE = 32;
+  ScanRing() : pages_{}, next_(0) {}
 private:
-  std::unordered_map<pgid_t, std::list<pgid_t>::iterator> its_;
-  std::list<pgid_t> evictable_;
+  // 0 means empty, since the meta page is never read through the ring.
+  pgid_t pages_[SIZE];
+  size_t next_;
+  friend class PageManager;
 };
 
 /* Page 0: The meta page of PageManager.
@@ -408,6 +615,18 @@ private:
  * evicted depends on the eviction policy. When a page is evicted from the
  * buffer pool, if it is marked dirty with Page::MarkDirty(), it will be flushed
  * to disk.
+ *
+ * The buffer pool is partitioned into shards by the hash of page ID. Each
+ * shard has its own latch, page table and eviction policy, so that pinning and
+ * unpinning pages of different shards do not contend with each other. All
+ * shards share the budget of "max_buf_pages" buffers. On a miss, a placeholder
+ * entry is inserted into the page table and the disk I/O is done without
+ * holding the shard latch. Other threads that want the same page wait on the
+ * condition variable of the shard until the I/O completes. If the buffer pool
+ * is full, the shard of the requested page evicts one of its own pages first,
+ * and steals from other shards only if all of its pages are pinned. The
+ * eviction policy of the shards is chosen with PageManagerOptions when the
+ * page manager is created or opened.
  */
 class PageManager {
 public:
@@ -417,18 +636,34 @@ public:
   PageManager& operator=(PageManager&&) = delete;
   ~PageManager();
   static auto Create(
-    std::filesystem::path path, size_t max_buf_pages
+    std::filesystem::path path, size_t max_buf_pages,
+    const PageManagerOptions& options = {}
   ) -> std::unique_ptr<PageManager>;
   static auto Open(
-    std::filesystem::path path, size_t max_buf_pages
+    std::filesystem::path path, size_t max_buf_pages,
+    const PageManagerOptions& options = {}
   ) -> Result<std::unique_ptr<PageManager>, io::Error>;
+  /* Open the file read-only and map it into memory. Page handles point into
+   * the mapping directly, so there is no buffer pool at all: no frame, no
+   * copy, no page table and no eviction. The file must not be modified by
+   * anyone while it is open. Pages can not be allocated, freed or modified.
+   *
+   * The mapping is advised as random access, since most accesses are
+   * B+tree lookups. Sequential scans read ahead with PrefetchPages, which
+   * advises the kernel to read the pages in the background.
+   */
+  static auto OpenReadOnlyMapped(std::filesystem::path path)
+    -> Result<std::unique_ptr<PageManager>, io::Error>;
+  bool IsReadOnlyMapped() const { return mapped_ != nullptr; }
   /* Allocate a page ID. You may use GetSortedPage or GetPlainPage later on
    * this page ID to get a handle for this page. Note that SortedPage should be
    * initialized with SortedPage::Init before using it for the first time.
    */
   pgid_t Allocate();
-  // Free the page ID. You have to make sure that there is no SortedPage or
-  // PlainPage handle that is still referencing this page.
+  /* Free the page ID. Handles that are still referencing this page, e.g., of
+   * optimistic readers that have not validated the page yet, can be dropped
+   * later. But the page should not be accessed through them anymore.
+   */
   void Free(pgid_t pgid);
   // Return the ID of the pre-allocated super page. This is intended to be used
   // by BPlusTreeStorage to store metadata.
@@ -436,7 +671,6 @@ public:
   // Regard the page as PlainPage and return a handle that references its
   // buffer.
   PlainPage GetPlainPage(pgid_t pgid) {
-    std::lock_guard l(latch_);
     return PlainPage(GetPage(pgid));
   }
   // Regard the page as SortedPage and return a handle that references its
@@ -445,10 +679,66 @@ public:
   auto GetSortedPage(pgid_t pgid, const SlotKeyCompare& slot_key_comp,
     const SlotCompare& slot_comp
   ) -> SortedPage<SlotKeyCompare, SlotCompare> {
-    std::lock_guard l(latch_);
     return SortedPage<SlotKeyCompare, SlotCompare>(
       GetPage(pgid), slot_key_comp, slot_comp);
   }
+  // Same as above, but return std::nullopt if the page is free. Used by
+  // optimistic readers, whose page ID may be stale.
+  template <typename SlotKeyCompare, typename SlotCompare>
+  auto TryGetSortedPage(pgid_t pgid, const SlotKeyCompare& slot_key_comp,
+    const SlotCompare& slot_comp
+  ) -> std::optional<SortedPage<SlotKeyCompare, SlotCompare>> {
+    auto page = TryGetPage(pgid);
+    if (!page.has_value())
+      return std::nullopt;
+    return SortedPage<SlotKeyCompare, SlotCompare>(
+      std::move(page.value()), slot_key_comp, slot_comp);
+  }
+  // Same as GetSortedPage, but a miss takes a buffer from the ring of the
+  // scan.
+  template <typename SlotKeyCompare, typename SlotCompare>
+  auto GetSortedPage(pgid_t pgid, const SlotKeyCompare& slot_key_comp,
+    const SlotCompare& slot_comp, ScanRing& ring
+  ) -> SortedPage<SlotKeyCompare, SlotCompare> {
+    return SortedPage<SlotKeyCompare, SlotCompare>(
+      GetPage(pgid, &ring), slot_key_comp, slot_comp);
+  }
+
+  // Start reading the pages into the buffer pool in the background, so that
+  // later GetPlainPage/GetSortedPage on them do not block on I/O for long.
+  // Pages already in the buffer pool, invalid or free pages are ignored. It
+  // does nothing if the I/O engine is IOEngineKind::SYNC, or if all pages in
+  // the buffer pool are pinned. If "ring" is not nullptr, the pages are read
+  // for the scan and take buffers from its ring.
+  void PrefetchPages(std::span<const pgid_t> pgids, ScanRing *ring = nullptr);
+  // Whether PrefetchPages does anything.
+  bool CanPrefetch() const {
+    return io_engine_ != nullptr || mapped_ != nullptr;
+  }
+  // The I/O engine actually used. PageManagerOptions::io_engine falls back
+  // to IOEngineKind::THREAD_POOL if io_uring is not available.
+  IOEngineKind GetIOEngineKind() const {
+    return io_engine_ == nullptr ? IOEngineKind::SYNC : io_engine_->Kind();
+  }
+  // Whether the file is opened with O_DIRECT. PageManagerOptions::direct_io
+  // falls back to buffered I/O if the file system does not support it.
+  bool IsDirectIO() const;
+  size_t MaxBufPages() const {
+    return max_buf_pages_.load(std::memory_order_relaxed);
+  }
+  /* Grow or shrink the buffer pool online. Shrinking evicts unpinned pages
+   * and returns their memory to the operating system. If too many pages are
+   * pinned, the buffer pool stays larger than "max_buf_pages" until enough
+   * pages are freed, since eviction does not take new frames.
+   *
+   * The buffer pool can not grow beyond the physical memory, or beyond the
+   * initial size if it is backed by explicit huge pages.
+   */
+  void SetMaxBufPages(size_t max_buf_pages);
+  // The counters of all buffer pool accesses and page I/O since the page
+  // manager was created or opened, including the writes of the background
+  // writer. Accesses to a read-only mapped file are not counted.
+  BufferPoolCounters GetStats() const;
 
   // Allocate a page ID, allocate a page buffer for it, and return a
   // PlainPage handle that references the buffer.
@@ -466,78 +756,337 @@ public:
     return page;
   }
 
+  /* Move page pages[i] to page ID i + 2, right after the meta page and the
+   * super page, and truncate the file. The other pages should be free. The
+   * content of the pages is moved as is, so the page IDs stored in them
+   * should have been updated by the caller beforehand. No handle should
+   * reference any page meanwhile, and the caller should make sure that no one
+   * else uses the page manager until it returns.
+   *
+   * It is used to compact the file, so that the pages of a B+tree that are
+   * adjacent in key order are also adjacent on disk.
+   */
+  void Relocate(std::span<const pgid_t> pages);
+
   // Made public for test
   inline pgid_t& PageNum() {
-    return *(pgid_t *)(buf_[0].addr_mut() + PAGE_NUM_OFF);
+    return *(pgid_t *)(meta_buf_ + PAGE_NUM_OFF);
   }
   // For test
   void ShrinkToFit();
 private:
+  // Index of a page buffer in the arena.
+  typedef uint32_t frame_t;
+  static constexpr frame_t NO_FRAME = UINT32_MAX;
   struct PageBufInfo {
-    const char *addr() const {
-      return reinterpret_cast<const char *>(buf.get());
-    }
-    char *addr_mut() { return reinterpret_cast<char *>(buf.get()); }
-    std::unique_ptr<char[]> buf;
+    frame_t frame;
     size_t refcount;
     bool dirty;
+    EvictionPolicy::slot_t slot;
+    // The page is being read from or written back to disk. Threads that want
+    // this page should wait on Shard::io_done until it is cleared.
+    bool io_in_progress;
+    // The background writer is writing the page. If the page is chosen for
+    // eviction meanwhile, io_in_progress is set and the background writer
+    // releases the frame after writing.
+    bool cleaning = false;
+    // Linked in Shard::dirty_head if the page is dirty and unpinned.
+    bool in_dirty_list = false;
+    PageBufInfo *dirty_prev = nullptr;
+    PageBufInfo *dirty_next = nullptr;
+    // Valid if in_dirty_list.
+    pgid_t pgid = 0;
+    uint64_t unpin_tick = 0;
+    // The page has been freed while pinned. It is removed from the buffer
+    // pool without being written back when unpinned, unless it is allocated
+    // again before that.
+    bool freed = false;
   };
-  PageManager(std::filesystem::path path, std::fstream&& file,
-      size_t max_buf_pages)
+  struct Shard {
+    std::mutex latch;
+    std::condition_variable io_done;
+    std::unordered_map<pgid_t, PageBufInfo> buf;
+    std::unique_ptr<EvictionPolicy> eviction_policy;
+    // Dirty and unpinned pages in the order they are unpinned, so the pages
+    // at the head are likely to be evicted soon.
+    PageBufInfo *dirty_head = nullptr;
+    PageBufInfo *dirty_tail = nullptr;
+    size_t dirty_num = 0;
+    // Incremented whenever a page is unpinned.
+    uint64_t unpin_ticks = 0;
+    // Counters of the pages of this shard. Sharded so that counting does not
+    // make all threads write the same cache line.
+    BufferPoolStats stats;
+  };
+  PageManager(std::filesystem::path path, int fd,
+      size_t max_buf_pages, const PageManagerOptions& options)
     : path_(path),
-      file_(std::move(file)),
+      fd_(fd),
       max_buf_pages_(max_buf_pages),
+      arena_pages_(0),
+      latches_(nullptr),
+      latches_map_size_(0),
+      buf_pages_(0),
+      used_frames_(0),
+      meta_buf_(nullptr),
       free_list_buf_(free_list_bufs_[0]),
       free_list_buf_used_(0),
       free_list_buf_standby_(free_list_bufs_[1]),
-      free_list_buf_standby_full_(false) {
+      free_list_buf_standby_full_(false),
+      file_pages_(0),
+      next_extent_pages_(MIN_EXTENT_PAGES),
+      mapped_(nullptr),
+      mapped_size_(0),
+      rejected_(false),
+      writer_interval_(options.writer_interval),
+      checkpoint_interval_(options.checkpoint_interval),
+      checkpoint_pages_per_sec_(options.checkpoint_pages_per_sec),
+      writer_stop_(false),
+      writer_wakeup_(false),
+      writer_cold_shift_(1) {
     // One buffer page is for pinned meta page.
     assert(max_buf_pages_ >= 2);
+    // Aim for a few shards per core, but keep every shard large enough for
+    // its eviction policy to be meaningful.
+    size_t shards = std::max<size_t>(std::thread::hardware_concurrency(), 1) * 4;
+    shards = std::min({shards, MAX_SHARDS, max_buf_pages_ / MIN_SHARD_PAGES});
+    shard_bits_ = shards <= 1 ? 0 : std::bit_width(shards - 1);
+    shards_ = std::make_unique<Shard[]>(size_t(1) << shard_bits_);
+    for (size_t i = 0; i < NumShards(); ++i)
+      shards_[i].eviction_policy = EvictionPolicy::New(options.eviction_policy);
+    AllocArena(options.huge_pages);
+    io_engine_ = IOEngine::New(options.io_engine, fd_);
+    if (options.background_writer)
+      writer_ = std::thread([this]() { WriterMain(); });
   }
   static constexpr pgoff_t PGID_PER_PAGE = Page::SIZE / sizeof(pgid_t) - 1;
   static constexpr pgoff_t FREE_LIST_HEAD_OFF = 0;
   static constexpr pgoff_t FREE_PAGES_IN_HEAD = FREE_LIST_HEAD_OFF + sizeof(pgid_t);
   static constexpr pgoff_t PAGE_NUM_OFF = FREE_PAGES_IN_HEAD + sizeof(pgid_t);
+  static constexpr pgoff_t FORMAT_VERSION_OFF = PAGE_NUM_OFF + sizeof(pgid_t);
+  // Bumped whenever the layout of the pages changes. Files of other versions
+  // are rejected on open. Version 0 is the layout before B+tree slots had
+  // heads and inner slots had subtree counts, and version 1 is the one before
+  // the counts were aligned.
+  static constexpr uint32_t FORMAT_VERSION = 2;
+  static constexpr size_t MAX_SHARDS = 64;
+  static constexpr size_t MIN_SHARD_PAGES = 64;
+  // Pages written by the background writer in one submission.
+  static constexpr size_t WRITER_BATCH = 64;
+  static constexpr size_t MAX_COLD_SHIFT = 4;
+  // The file grows by extents, starting from 1MiB and doubling up to 64MiB.
+  static constexpr size_t MIN_EXTENT_PAGES = (1 << 20) / Page::SIZE;
+  static constexpr size_t MAX_EXTENT_PAGES = (64 << 20) / Page::SIZE;
   inline pgid_t& FreeListHead() {
-    return *(pgid_t *)(buf_[0].addr_mut() + FREE_LIST_HEAD_OFF);
+    return *(pgid_t *)(meta_buf_ + FREE_LIST_HEAD_OFF);
   }
   inline pgid_t& FreePagesInHead() {
-    return *(pgid_t *)(buf_[0].addr_mut() + FREE_PAGES_IN_HEAD);
+    return *(pgid_t *)(meta_buf_ + FREE_PAGES_IN_HEAD);
+  }
+  inline uint32_t& FormatVersion() {
+    return *(uint32_t *)(meta_buf_ + FORMAT_VERSION_OFF);
+  }
+  std::optional<io::Error> CheckFormatVersion();
+  inline size_t NumShards() const { return size_t(1) << shard_bits_; }
+  inline size_t ShardIndex(pgid_t pgid) const {
+    if (shard_bits_ == 0)
+      return 0;
+    // Fibonacci hashing, so that consecutive page IDs spread over shards.
+    return (uint32_t)(pgid * 2654435769u) >> (32 - shard_bits_);
+  }
+
+  inline char *FrameAddr(frame_t frame) {
+    return arena_ + (size_t)frame * Page::SIZE;
   }
 
   pgid_t __Allocate();
+  // Make the file hold at least "pages" pages. The caller should hold latch_.
+  void ReserveFilePages(size_t pages);
 
+  void AllocArena(HugePageMode huge_pages);
   void AllocMeta();
   void Init();
   std::optional<io::Error> Load();
-  Page GetPage(pgid_t pgid);
+  Page GetPage(pgid_t pgid, ScanRing *ring = nullptr);
+  // Return std::nullopt if the page is free or beyond the end of the file.
+  std::optional<Page> TryGetPage(pgid_t pgid, ScanRing *ring = nullptr);
   void DropPage(pgid_t pgid, bool dirty);
+  PageLatch& FrameLatch(const char *buf) {
+    if (mapped_ != nullptr)
+      return mapped_latch_;
+    return latches_[(buf - arena_) / Page::SIZE].latch;
+  }
   void FlushFreeListStandby(pgid_t pgid);
+  // A frame taken for a missing page. If "victim" is not 0, the frame still
+  // holds the dirty page "victim", which should be written back and then
+  // released with FinishEviction before the frame is reused.
+  struct Frame {
+    frame_t id;
+    pgid_t victim;
+  };
+  // Get a frame for a missing page, evicting a page if the buffer pool is
+  // full. "home" is the shard of the missing page. The caller should not hold
+  // any shard latch.
+  Frame AllocFrame(size_t home);
+  // Same as AllocFrame, but return NO_FRAME if all pages are pinned.
+  Frame TryEvict(size_t home);
+  // Get a frame for a missing page read by a scan. Once the buffer pool is
+  // full, the page read through the ring SIZE pages ago is evicted.
+  Frame AllocFrameForScan(size_t home, ScanRing& ring, pgid_t pgid);
+  // Same as AllocFrameForScan, but return NO_FRAME if all pages are pinned.
+  Frame TryEvictForScan(size_t home, ScanRing& ring, pgid_t pgid);
+  // Return a recycled or never used frame if the buffer pool is not full.
+  // Otherwise return NO_FRAME.
+  frame_t TryAllocFrame();
+  // Return a frame that no longer holds a page.
+  void ReleaseFrame(frame_t frame);
+  // Remove the page from the buffer pool without writing it back. The page
+  // should not be pinned.
+  void DiscardPage(pgid_t pgid);
+  // Evict an unpinned page of the shard. Return NO_FRAME if all pages in the
+  // shard are pinned.
+  Frame EvictFrom(Shard& shard);
+  // Evict the page if it is in the buffer pool and unpinned. Otherwise return
+  // NO_FRAME.
+  Frame EvictPage(pgid_t pgid);
+  // Take the frame of the page, which has been removed from the eviction
+  // policy. If it is dirty, it stays in the page table with io_in_progress set
+  // until FinishEviction. The caller should hold the shard latch.
+  Frame TakeFrame(Shard& shard, pgid_t pgid);
+  // The dirty victim has been written back.
+  void FinishEviction(pgid_t victim);
+  // The caller should hold the shard latch.
+  void LinkDirty(Shard& shard, pgid_t pgid, PageBufInfo& info);
+  void UnlinkDirty(Shard& shard, PageBufInfo& info);
+
+  // The background writer.
+  void WriterMain();
+  // Write back the cold dirty pages, i.e., after which at least
+  // (the number of pages in its shard >> writer_cold_shift_) pages have been
+  // unpinned.
+  void CleanColdPages();
+  void Checkpoint();
+  // Take at most "max" pages from the head of the dirty list of the shard,
+  // and mark them clean and cleaning. If "cold_only", stop at the first page
+  // that is not cold.
+  void TakeDirtyPages(Shard& shard, size_t max, bool cold_only,
+    std::vector<std::pair<pgid_t, frame_t>>& pages);
+  // Write the pages in one submission if possible.
+  void WritePages(std::span<const std::pair<pgid_t, frame_t>> pages);
+  // Release the frame if the page has been evicted during cleaning.
+  void FinishCleaning(pgid_t pgid);
+  // Wake up the background writer because eviction found a dirty page.
+  void WakeUpWriter();
+  // Count in the shard of the page and in the stats scopes of this thread.
+  void Count(pgid_t pgid, BufferPoolStats::Counter counter,
+      uint64_t n = 1) {
+    shards_[ShardIndex(pgid)].stats.Add(counter, n);
+    BufferPoolStatsScope::Add(counter, n);
+  }
+  // "buf" should be 4KiB-aligned if direct I/O is enabled.
+  void ReadPage(pgid_t pgid, char *buf);
+  void WritePage(pgid_t pgid, const char *buf);
+  static int OpenFile(const std::filesystem::path& path, int flags,
+    bool direct_io);
 
   std::filesystem::path path_;
-  std::fstream file_;
-  size_t max_buf_pages_;
+  // Pages are read and written with pread/pwrite, so concurrent I/O does not
+  // need any latch.
+  int fd_;
+  // nullptr if IOEngineKind::SYNC.
+  std::unique_ptr<IOEngine> io_engine_;
+  std::atomic<size_t> max_buf_pages_;
+  // All page buffers are frames in this arena, which is mapped at once and is
+  // 4KiB-aligned. Physical memory is not allocated until a frame is used for
+  // the first time, so the arena is as large as the physical memory, which
+  // leaves room for SetMaxBufPages to grow the buffer pool.
+  char *arena_;
+  // The mapping may be larger than the arena for alignment.
+  void *arena_map_;
+  size_t arena_map_size_;
+  size_t arena_pages_;
+  // The latches of the frames in the arena. Mapped like the arena, and each
+  // latch takes a cache line, so that latching a page does not slow down the
+  // readers of other pages.
+  struct alignas(64) FrameLatchSlot {
+    PageLatch latch;
+  };
+  FrameLatchSlot *latches_;
+  size_t latches_map_size_;
+  // Frames below it have been used, including the meta page.
+  std::atomic<size_t> buf_pages_;
+  // Frames holding pages, including the meta page. At most max_buf_pages_,
+  // unless the buffer pool has just been shrunk.
+  std::atomic<size_t> used_frames_;
+  // Frames of freed pages, reused before evicting anything.
+  std::vector<frame_t> free_frames_;
+  std::mutex free_frames_latch_;
+  // The meta page takes frame 0. It is always in memory.
+  char *meta_buf_;
+  size_t shard_bits_;
+  std::unique_ptr<Shard[]> shards_;
+
+  // Protects the page allocation state below.
+  std::mutex latch_;
   pgid_t *free_list_buf_;
   size_t free_list_buf_used_;
   // The standby buffer is either full or empty.
   pgid_t *free_list_buf_standby_;
   bool free_list_buf_standby_full_;
-  std::unordered_map<pgid_t, PageBufInfo> buf_;
-  EvictionPolicy eviction_policy_;
-  pgid_t free_list_bufs_[2][PGID_PER_PAGE];
+  // The physical size of the file in pages, which may be larger than
+  // PageNum(). The file is truncated to PageNum() pages on close.
+  size_t file_pages_;
+  size_t next_extent_pages_;
+  // The last entry is for the next page in the free list, so that a free list
+  // page is read and written as a whole. Aligned for O_DIRECT.
+  alignas(Page::SIZE) pgid_t free_list_bufs_[2][PGID_PER_PAGE + 1];
 
   // For debugging
   std::vector<bool> is_free_;
-  
-  std::mutex latch_;
+
+  // The whole file if opened with OpenReadOnlyMapped. Otherwise nullptr.
+  char *mapped_;
+  size_t mapped_size_;
+  // Pages of the read-only mapped file are never modified.
+  PageLatch mapped_latch_;
+  // Set if Load rejects the file, which is then closed untouched.
+  bool rejected_;
+
+  std::chrono::milliseconds writer_interval_;
+  std::chrono::milliseconds checkpoint_interval_;
+  size_t checkpoint_pages_per_sec_;
+  // Protects writer_stop_ and writer_wakeup_. Acquired after shard latches.
+  std::mutex writer_latch_;
+  std::condition_variable writer_cv_;
+  bool writer_stop_;
+  bool writer_wakeup_;
+  // Only used by the background writer.
+  size_t writer_cold_shift_;
+  std::thread writer_;
 
   friend class Page;
+  friend class PageWriteSet;
 };
 
 inline Page::~Page() {
   __Drop();
 }
 
+inline PageLatch& Page::Latch() const {
+  return pgm_.get().FrameLatch(page_);
+}
+
+inline void PageWriteSet::Add(const Page& page) {
+  if (page.ID() == 0)
+    return;
+  for (const auto& p : pages_) {
+    if (p.ID() == page.ID())
+      return;
+  }
+  page.Latch().Lock();
+  pages_.push_back(page.pgm_.get().GetPage(page.ID()));
+}
+
 inline void Page::__Drop() {
   if (id_ == 0)
     return;
@@ -2,6 +2,8 @@
 #define SAKURA_STORAGE_H__
 
 #include <memory>
+#include <string_view>
+#include <utility>
 #include <vector>
 
 namespace wing {
@@ -18,6 +20,17 @@ class Iterator {
   virtual ~Iterator() = default;
   virtual void Init() = 0;
   virtual TupleType Next() = 0;
+  /**
+   * Skip the next n rows, as if Next() were invoked n times. Return the number
+   * of rows skipped, which is less than n only if the set runs out. Sets that
+   * know the positions of their rows may skip them without reading them.
+   */
+  virtual size_t Skip(size_t n) {
+    size_t i = 0;
+    while (i < n && Next())
+      i++;
+    return i;
+  }
 };
 
 /**
@@ -32,6 +45,28 @@ class ModifyHandle {
   virtual bool Delete(std::string_view key) = 0;
   virtual bool Insert(std::string_view key, std::string_view value) = 0;
   virtual bool Update(std::string_view key, std::string_view new_value) = 0;
+  /**
+   * Load (key, value) pairs into the set if it is empty, which is much faster
+   * than inserting them one by one. "kvs" may be reordered. Return false
+   * without inserting anything if the set is not empty, the keys are not
+   * distinct, or it is not supported. Then the caller should use Insert.
+   */
+  virtual bool BulkLoad(
+      std::vector<std::pair<std::string_view, std::string_view>>& kvs) {
+    return false;
+  }
+  /**
+   * Insert (key, value) pairs. "kvs" may be reordered. Return false if some
+   * key already exists, and then only some of the pairs may be inserted.
+   */
+  virtual bool InsertBatch(
+      std::vector<std::pair<std::string_view, std::string_view>>& kvs) {
+    for (const auto& [key, value] : kvs) {
+      if (!Insert(key, value))
+        return false;
+    }
+    return true;
+  }
 };
 
 /**
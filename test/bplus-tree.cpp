@@ -2,11 +2,21 @@
 
 #include <gtest/gtest.h>
 
+#include <algorithm>
 #include <cstdlib>
+#include <latch>
 #include <optional>
 #include <random>
+#include <set>
+#include <thread>
 
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "common/allocator.hpp"
+#include "common/memory_budget.hpp"
 #include "storage/blob.hpp"
+#include "storage/bplus-tree-storage.hpp"
 
 namespace fs = std::filesystem;
 
@@ -1307,3 +1317,1393 @@ TEST(BPlusTreeTest, RandInsertDestroy1e5) {
 TEST(BPlusTreeTest, RandInsertDestroy1e6) {
   rand_insert_destroy(test_name(), 6);
 }
+
+TEST(BPlusTreeTest, ConcurrentPlainPageSmallBuffer) {
+  std::string path = test_name();
+  constexpr size_t THREADS = 8;
+  constexpr size_t PAGES_PER_THREAD = 512;
+  std::vector<wing::pgid_t> pages;
+  {
+    // Much smaller than the number of pages, so that pages are evicted from
+    // and stolen by other shards concurrently.
+    auto pgm = wing::PageManager::Create(path, 256);
+    for (size_t i = 0; i < THREADS * PAGES_PER_THREAD; ++i)
+      pages.push_back(pgm->Allocate());
+    auto work = [&](size_t tid) {
+      std::minstd_rand e(tid);
+      for (size_t round = 0; round < 4; ++round) {
+        for (size_t i = tid; i < pages.size(); i += THREADS) {
+          uint64_t v = pages[i] * 4 + round;
+          if (round > 0) {
+            uint64_t old;
+            // Touch a random page to shuffle the eviction order.
+            pgm->GetPlainPage(pages[e() % pages.size()]);
+            pgm->GetPlainPage(pages[i]).Read(&old, 0, sizeof(old));
+            ASSERT_EQ(old, v - 1);
+          }
+          pgm->GetPlainPage(pages[i]).Write(0, std::string_view(
+              reinterpret_cast<const char*>(&v), sizeof(v)));
+        }
+      }
+    };
+    std::vector<std::thread> threads;
+    for (size_t tid = 0; tid < THREADS; ++tid)
+      threads.emplace_back(work, tid);
+    for (auto& t : threads)
+      t.join();
+  }
+  {
+    std::unique_ptr<wing::PageManager> pgm;
+    ASSERT_NO_FATAL_FAILURE(match(
+        wing::PageManager::Open(path, 256),
+        [&pgm](std::unique_ptr<wing::PageManager>& pgm_ret) {
+          pgm = std::move(pgm_ret);
+        },
+        [](wing::io::Error& err) { FAIL() << err; }));
+    for (auto pgid : pages) {
+      uint64_t v;
+      pgm->GetPlainPage(pgid).Read(&v, 0, sizeof(v));
+      ASSERT_EQ(v, pgid * 4 + 3);
+    }
+  }
+  ASSERT_TRUE(fs::remove(path));
+}
+
+static void rand_insert_scan_with_options(
+    const wing::PageManagerOptions& options) {
+  std::string path = test_name();
+  std::minstd_rand e(233);
+  std::map<std::string, std::string> m;
+  wing::pgid_t meta;
+  {
+    // Small enough to evict pages frequently.
+    auto pgm = wing::PageManager::Create(path, 256, options);
+    // The requested engine is used unless it is not available.
+    if (wing::IOEngine::IsAvailable(options.io_engine)) {
+      ASSERT_EQ(pgm->GetIOEngineKind(), options.io_engine);
+    }
+    auto tree = tree_t::Create(*pgm);
+    for (size_t i = 0; i < 100000; ++i) {
+      std::string key = std::to_string(e());
+      std::string value = std::to_string(e());
+      tree.Insert(key, value);
+      m.emplace(key, value);
+    }
+    for (const auto& [key, value] : m)
+      ASSERT_EQ(tree.Get(key), value);
+    // Full scans read through the scan ring.
+    for (size_t round = 0; round < 2; ++round) {
+      auto it = tree.Begin();
+      it.UseScanRing();
+      for (const auto& [key, value] : m) {
+        auto kv = it.Cur();
+        ASSERT_TRUE(kv.has_value());
+        ASSERT_EQ(kv.value().first, key);
+        ASSERT_EQ(kv.value().second, value);
+        it.Next();
+      }
+      ASSERT_FALSE(it.Cur().has_value());
+    }
+    // Free some pages to exercise the free list.
+    for (size_t i = 0; i < 50000; ++i) {
+      auto it = m.begin();
+      ASSERT_TRUE(tree.Delete(it->first));
+      m.erase(it);
+    }
+    meta = tree.MetaPageID();
+  }
+  {
+    std::unique_ptr<wing::PageManager> pgm;
+    ASSERT_NO_FATAL_FAILURE(match(
+        wing::PageManager::Open(path, 256, options),
+        [&pgm](std::unique_ptr<wing::PageManager>& pgm_ret) {
+          pgm = std::move(pgm_ret);
+        },
+        [](wing::io::Error& err) { FAIL() << err; }));
+    // Only a hint. Prefetching more pages than the buffer pool holds should be
+    // fine.
+    std::vector<wing::pgid_t> pages;
+    for (wing::pgid_t pgid = 2; pgid < pgm->PageNum(); ++pgid)
+      pages.push_back(pgid);
+    pgm->PrefetchPages(pages);
+    auto tree = tree_t::Open(*pgm, meta);
+    for (const auto& [key, value] : m)
+      ASSERT_EQ(tree.Get(key), value);
+    tree.Destroy();
+    pgm->ShrinkToFit();
+    ASSERT_EQ(pgm->PageNum(), pgm->SuperPageID() + 1);
+  }
+  ASSERT_TRUE(fs::remove(path));
+}
+TEST(BPlusTreeTest, EvictionPolicyLRU) {
+  rand_insert_scan_with_options(
+      {.eviction_policy = wing::EvictionPolicyKind::LRU});
+}
+TEST(BPlusTreeTest, EvictionPolicyCLOCK) {
+  rand_insert_scan_with_options(
+      {.eviction_policy = wing::EvictionPolicyKind::CLOCK});
+}
+TEST(BPlusTreeTest, EvictionPolicyLRUK) {
+  rand_insert_scan_with_options(
+      {.eviction_policy = wing::EvictionPolicyKind::LRU_K});
+}
+TEST(BPlusTreeTest, EvictionPolicyTwoQ) {
+  rand_insert_scan_with_options(
+      {.eviction_policy = wing::EvictionPolicyKind::TWO_Q});
+}
+TEST(BPlusTreeTest, TransparentHugePages) {
+  rand_insert_scan_with_options(
+      {.huge_pages = wing::HugePageMode::TRANSPARENT});
+}
+TEST(BPlusTreeTest, ExplicitHugePages) {
+  // Falls back to normal pages if no huge page is reserved.
+  rand_insert_scan_with_options({.huge_pages = wing::HugePageMode::EXPLICIT});
+}
+TEST(BPlusTreeTest, DirectIO) {
+  std::string path = test_name();
+  {
+    auto pgm = wing::PageManager::Create(path, 256, {.direct_io = true});
+    // Buffered I/O is only used if the file system rejects O_DIRECT.
+    int fd = open(path.c_str(), O_RDWR | O_DIRECT);
+    if (fd >= 0 || errno != EINVAL) {
+      ASSERT_GE(fd, 0);
+      close(fd);
+      ASSERT_TRUE(pgm->IsDirectIO());
+    }
+  }
+  {
+    std::unique_ptr<wing::PageManager> pgm;
+    ASSERT_NO_FATAL_FAILURE(match(
+        wing::PageManager::Open(path, 256),
+        [&pgm](std::unique_ptr<wing::PageManager>& pgm_ret) {
+          pgm = std::move(pgm_ret);
+        },
+        [](wing::io::Error& err) { FAIL() << err; }));
+    ASSERT_FALSE(pgm->IsDirectIO());
+  }
+  ASSERT_TRUE(fs::remove(path));
+  rand_insert_scan_with_options({.direct_io = true});
+}
+TEST(BPlusTreeTest, IOUring) {
+  rand_insert_scan_with_options({.io_engine = wing::IOEngineKind::IO_URING});
+}
+TEST(BPlusTreeTest, IOThreadPool) {
+  rand_insert_scan_with_options(
+      {.io_engine = wing::IOEngineKind::THREAD_POOL});
+}
+TEST(BPlusTreeTest, IOUringDirectIO) {
+  rand_insert_scan_with_options(
+      {.direct_io = true, .io_engine = wing::IOEngineKind::IO_URING});
+}
+TEST(BPlusTreeTest, IOChainPastEOF) {
+  std::string path = test_name();
+  int fd = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+  ASSERT_GE(fd, 0);
+  for (auto kind : {wing::IOEngineKind::IO_URING,
+      wing::IOEngineKind::THREAD_POOL}) {
+    if (!wing::IOEngine::IsAvailable(kind))
+      continue;
+    ASSERT_EQ(ftruncate(fd, 0), 0);
+    auto engine = wing::IOEngine::New(kind, fd);
+    ASSERT_EQ(engine->Kind(), kind);
+    constexpr size_t SIZE = wing::Page::SIZE;
+    std::string page(SIZE, 'a');
+    std::string whole(SIZE * 2, 'x');
+    std::string again(SIZE, 'x');
+    // The second read is cut short by the end of file, which breaks the link
+    // in io_uring, so the last read is finished after it.
+    std::latch done(1);
+    wing::IOChain chain{{
+      {true, 0, page.data(), SIZE},
+      {false, 0, whole.data(), SIZE * 2},
+      {false, 0, again.data(), SIZE},
+    }, [&done]() { done.count_down(); }};
+    engine->Submit(std::span(&chain, 1));
+    done.wait();
+    ASSERT_EQ(whole, page + std::string(SIZE, '\0'));
+    ASSERT_EQ(again, page);
+  }
+  close(fd);
+  ASSERT_TRUE(fs::remove(path));
+}
+TEST(BPlusTreeTest, ResizeBufferPool) {
+  std::string path = test_name();
+  {
+    auto pgm = wing::PageManager::Create(path, 256);
+    for (size_t i = 0; i < 1000; ++i) {
+      auto page = pgm->AllocPlainPage();
+      page.Write(0, std::string_view((char *)&i, sizeof(i)));
+    }
+    auto read_all = [&pgm]() {
+      for (size_t i = 0; i < 1000; ++i) {
+        size_t val;
+        pgm->GetPlainPage(i + 2).Read(&val, 0, sizeof(val));
+        ASSERT_EQ(val, i);
+      }
+    };
+    // Shrink with dirty pages in the buffer pool.
+    auto evictions = pgm->GetStats().evictions;
+    pgm->SetMaxBufPages(64);
+    ASSERT_EQ(pgm->MaxBufPages(), 64);
+    ASSERT_GE(pgm->GetStats().evictions, evictions + 256 - 64 - 1);
+    ASSERT_NO_FATAL_FAILURE(read_all());
+    // All pages fit after growing.
+    pgm->SetMaxBufPages(2048);
+    ASSERT_EQ(pgm->MaxBufPages(), 2048);
+    ASSERT_NO_FATAL_FAILURE(read_all());
+    auto misses = pgm->GetStats().misses;
+    ASSERT_NO_FATAL_FAILURE(read_all());
+    ASSERT_EQ(pgm->GetStats().misses, misses);
+    // Shrink with pinned pages.
+    std::vector<wing::PlainPage> pinned;
+    for (size_t i = 0; i < 100; ++i)
+      pinned.push_back(pgm->GetPlainPage(i + 2));
+    pgm->SetMaxBufPages(16);
+    pinned.clear();
+    ASSERT_NO_FATAL_FAILURE(read_all());
+  }
+  ASSERT_TRUE(fs::remove(path));
+}
+TEST(BPlusTreeTest, MemoryBudget) {
+  auto& budget = wing::MemoryBudget::Global();
+  constexpr size_t MiB = 1 << 20;
+  size_t size1 = 0, size2 = 0;
+  size_t id1 = budget.AddBufferPool(512 * MiB, [&](size_t s) { size1 = s; });
+  // Unlimited.
+  ASSERT_EQ(size1, 512 * MiB);
+  budget.SetLimit(1024 * MiB);
+  ASSERT_EQ(size1, 512 * MiB);
+  size_t id2 = budget.AddBufferPool(1024 * MiB, [&](size_t s) { size2 = s; });
+  ASSERT_EQ(size1, 512 * MiB);
+  ASSERT_EQ(size2, 512 * MiB);
+  {
+    // Executors take memory from the buffer pools.
+    wing::BlockAllocator<8192> allocator;
+    for (size_t i = 0; i < 64; ++i)
+      allocator.Allocate(4 * MiB);
+    ASSERT_EQ(budget.GetCharged(), 256 * MiB);
+    // Resized every 1/64 of the limit.
+    ASSERT_GE(size1, 384 * MiB);
+    ASSERT_LE(size1, 392 * MiB);
+    ASSERT_EQ(size2, size1);
+    wing::BlockAllocator<8192> moved(std::move(allocator));
+    ASSERT_EQ(budget.GetCharged(), 256 * MiB);
+  }
+  ASSERT_EQ(budget.GetCharged(), 0);
+  ASSERT_EQ(size1, 512 * MiB);
+  ASSERT_EQ(size2, 512 * MiB);
+  budget.SetBufferPoolWanted(id2, 128 * MiB);
+  ASSERT_EQ(size2, 128 * MiB);
+  budget.RemoveBufferPool(id2);
+  budget.RemoveBufferPool(id1);
+  budget.SetLimit(0);
+}
+TEST(BPlusTreeTest, BufferPoolStats) {
+  std::string path = test_name();
+  {
+    auto pgm = wing::PageManager::Create(path, 256);
+    for (size_t i = 0; i < 1000; ++i) {
+      auto page = pgm->AllocPlainPage();
+      page.Write(0, std::string_view((char *)&i, sizeof(i)));
+    }
+    auto stats = pgm->GetStats();
+    ASSERT_EQ(stats.misses, 1000);
+    // Every page but the ones still in the buffer pool has been written back.
+    ASSERT_GE(stats.evictions, 1000 - 256);
+    ASSERT_EQ(stats.write_backs, stats.evictions);
+    ASSERT_GE(stats.bytes_written, stats.write_backs * wing::Page::SIZE);
+
+    wing::BufferPoolStats table, query;
+    wing::BufferPoolStatsScope query_scope(
+      wing::BufferPoolStatsScope::QUERY, &query);
+    {
+      wing::BufferPoolStatsScope table_scope(
+        wing::BufferPoolStatsScope::TABLE, &table);
+      for (size_t i = 0; i < 1000; ++i) {
+        size_t val;
+        pgm->GetPlainPage(i + 2).Read(&val, 0, sizeof(val));
+        ASSERT_EQ(val, i);
+      }
+      // Hit.
+      pgm->GetPlainPage(1001);
+    }
+    // Only counted in the query.
+    pgm->GetPlainPage(1001);
+    auto table_stats = table.Load();
+    auto query_stats = query.Load();
+    ASSERT_EQ(table_stats.hits + table_stats.misses, 1001);
+    ASSERT_GE(table_stats.hits, 1);
+    ASSERT_EQ(table_stats.bytes_read, table_stats.misses * wing::Page::SIZE);
+    ASSERT_EQ(query_stats.hits, table_stats.hits + 1);
+    ASSERT_EQ(query_stats.misses, table_stats.misses);
+    stats = pgm->GetStats();
+    ASSERT_EQ(stats.hits + stats.misses, 2002);
+  }
+  ASSERT_TRUE(fs::remove(path));
+}
+TEST(BPlusTreeTest, FileExtents) {
+  std::string path = test_name();
+  {
+    auto pgm = wing::PageManager::Create(path, 256);
+    for (size_t i = 0; i < 1000; ++i) {
+      auto page = pgm->AllocPlainPage();
+      page.Write(0, std::string_view((char *)&i, sizeof(i)));
+    }
+    // The file grows by extents.
+    ASSERT_GT(fs::file_size(path), pgm->PageNum() * wing::Page::SIZE);
+  }
+  // The unused space is returned on close.
+  ASSERT_EQ(fs::file_size(path), 1002 * wing::Page::SIZE);
+  {
+    std::unique_ptr<wing::PageManager> pgm;
+    ASSERT_NO_FATAL_FAILURE(match(
+        wing::PageManager::Open(path, 256),
+        [&pgm](std::unique_ptr<wing::PageManager>& pgm_ret) {
+          pgm = std::move(pgm_ret);
+        },
+        [](wing::io::Error& err) { FAIL() << err; }));
+    ASSERT_EQ(pgm->PageNum(), 1002);
+    for (size_t i = 0; i < 1000; ++i) {
+      size_t val;
+      pgm->GetPlainPage(i + 2).Read(&val, 0, sizeof(val));
+      ASSERT_EQ(val, i);
+    }
+    pgm->AllocPlainPage();
+    ASSERT_GT(fs::file_size(path), pgm->PageNum() * wing::Page::SIZE);
+  }
+  ASSERT_EQ(fs::file_size(path), 1003 * wing::Page::SIZE);
+  ASSERT_TRUE(fs::remove(path));
+}
+TEST(BPlusTreeTest, ReadOnlyMapped) {
+  std::string path = test_name();
+  std::minstd_rand e(233);
+  std::map<std::string, std::string> m;
+  wing::pgid_t meta;
+  {
+    auto pgm = wing::PageManager::Create(path, 256);
+    auto tree = tree_t::Create(*pgm);
+    for (size_t i = 0; i < 100000; ++i) {
+      std::string key = std::to_string(e());
+      std::string value = std::to_string(e());
+      tree.Insert(key, value);
+      m.emplace(key, value);
+    }
+    meta = tree.MetaPageID();
+  }
+  {
+    std::unique_ptr<wing::PageManager> pgm;
+    ASSERT_NO_FATAL_FAILURE(match(
+        wing::PageManager::OpenReadOnlyMapped(path),
+        [&pgm](std::unique_ptr<wing::PageManager>& pgm_ret) {
+          pgm = std::move(pgm_ret);
+        },
+        [](wing::io::Error& err) { FAIL() << err; }));
+    ASSERT_TRUE(pgm->IsReadOnlyMapped());
+    auto tree = tree_t::Open(*pgm, meta);
+    ASSERT_EQ(tree.TupleNum(), m.size());
+    for (const auto& [key, value] : m)
+      ASSERT_EQ(tree.Get(key), value);
+    auto it = tree.Begin();
+    it.UseScanRing();
+    for (const auto& [key, value] : m) {
+      auto kv = it.Cur();
+      ASSERT_TRUE(kv.has_value());
+      ASSERT_EQ(kv.value().first, key);
+      ASSERT_EQ(kv.value().second, value);
+      it.Next();
+    }
+    ASSERT_FALSE(it.Cur().has_value());
+  }
+  ASSERT_TRUE(fs::remove(path));
+}
+TEST(BPlusTreeTest, FormatVersion) {
+  auto path = test_name();
+  wing::pgid_t meta;
+  {
+    auto pgm = wing::PageManager::Create(path, 256);
+    auto tree = tree_t::Create(*pgm);
+    tree.Insert("a", "b");
+    meta = tree.MetaPageID();
+  }
+  // The format version follows the page number on page 0. Files written
+  // before it was added have zero there.
+  const off_t version_off = 3 * sizeof(wing::pgid_t);
+  uint32_t version;
+  int fd = open(path.c_str(), O_RDWR);
+  ASSERT_GE(fd, 0);
+  ASSERT_EQ(pread(fd, &version, sizeof(version), version_off),
+    (ssize_t)sizeof(version));
+  uint32_t old_version = 0;
+  ASSERT_EQ(pwrite(fd, &old_version, sizeof(old_version), version_off),
+    (ssize_t)sizeof(old_version));
+  close(fd);
+  auto size = fs::file_size(path);
+  ASSERT_NO_FATAL_FAILURE(match(
+      wing::PageManager::Open(path, 256),
+      [](std::unique_ptr<wing::PageManager>&) { FAIL(); },
+      [](wing::io::Error&) {}));
+  ASSERT_NO_FATAL_FAILURE(match(
+      wing::PageManager::OpenReadOnlyMapped(path),
+      [](std::unique_ptr<wing::PageManager>&) { FAIL(); },
+      [](wing::io::Error&) {}));
+  // The rejected file is left untouched.
+  ASSERT_EQ(fs::file_size(path), size);
+  fd = open(path.c_str(), O_RDWR);
+  ASSERT_GE(fd, 0);
+  ASSERT_EQ(pread(fd, &old_version, sizeof(old_version), version_off),
+    (ssize_t)sizeof(old_version));
+  ASSERT_EQ(old_version, 0);
+  ASSERT_EQ(pwrite(fd, &version, sizeof(version), version_off),
+    (ssize_t)sizeof(version));
+  close(fd);
+  {
+    std::unique_ptr<wing::PageManager> pgm;
+    ASSERT_NO_FATAL_FAILURE(match(
+        wing::PageManager::Open(path, 256),
+        [&pgm](std::unique_ptr<wing::PageManager>& pgm_ret) {
+          pgm = std::move(pgm_ret);
+        },
+        [](wing::io::Error& err) { FAIL() << err; }));
+    auto tree = tree_t::Open(*pgm, meta);
+    ASSERT_EQ(tree.Get("a"), "b");
+  }
+  ASSERT_TRUE(fs::remove(path));
+}
+TEST(BPlusTreeTest, BackgroundWriter) {
+  rand_insert_scan_with_options({.background_writer = true});
+}
+TEST(BPlusTreeTest, BackgroundWriterIOUring) {
+  rand_insert_scan_with_options({
+    .io_engine = wing::IOEngineKind::IO_URING,
+    .background_writer = true,
+    .writer_interval = std::chrono::milliseconds(1),
+  });
+}
+TEST(BPlusTreeTest, Checkpoint) {
+  rand_insert_scan_with_options({
+    .io_engine = wing::IOEngineKind::THREAD_POOL,
+    .background_writer = true,
+    .checkpoint_interval = std::chrono::milliseconds(1),
+    .checkpoint_pages_per_sec = 100000,
+  });
+}
+TEST(BPlusTreeTest, BulkLoad) {
+  std::string path = test_name();
+  std::minstd_rand e(233);
+  {
+    auto pgm = wing::PageManager::Create(path, 256);
+    for (size_t key_len : {0, 1000}) {
+      std::map<std::string, std::string> m;
+      // Long keys make the inner pages have few children.
+      for (size_t i = 0; i < (key_len ? 3000 : 100000); ++i)
+        m.emplace(std::string(key_len, 'a') + std::to_string(e()),
+            std::to_string(e()));
+      auto tree = tree_t::Create(*pgm);
+      tree.BulkLoad(m.begin(), m.end(), 0.9);
+      ASSERT_EQ(tree.TupleNum(), m.size());
+      auto check = [&]() {
+        auto it = tree.Begin();
+        for (const auto& [key, value] : m) {
+          auto kv = it.Cur();
+          ASSERT_TRUE(kv.has_value());
+          ASSERT_EQ(kv.value().first, key);
+          ASSERT_EQ(kv.value().second, value);
+          it.Next();
+        }
+        ASSERT_FALSE(it.Cur().has_value());
+        for (const auto& [key, value] : m)
+          ASSERT_EQ(tree.Get(key).value(), value);
+      };
+      ASSERT_NO_FATAL_FAILURE(check());
+      // The tree can be modified as usual.
+      for (size_t i = 0; i < m.size() / 2; ++i) {
+        std::string key = std::string(key_len, 'a') + std::to_string(e());
+        std::string value = std::to_string(e());
+        ASSERT_EQ(tree.Insert(key, value), m.emplace(key, value).second);
+        auto it = m.lower_bound(std::string(key_len, 'a') +
+                                std::to_string(e()));
+        if (it != m.end()) {
+          ASSERT_TRUE(tree.Delete(it->first));
+          m.erase(it);
+        }
+      }
+      ASSERT_NO_FATAL_FAILURE(check());
+      tree.Destroy();
+    }
+  }
+  ASSERT_TRUE(fs::remove(path));
+}
+
+TEST(BPlusTreeTest, InsertSorted) {
+  std::string path = test_name();
+  std::minstd_rand e(233);
+  {
+    auto pgm = wing::PageManager::Create(path, 256);
+    for (size_t key_len : {0, 1000}) {
+      std::map<std::string, std::string> m;
+      auto tree = tree_t::Create(*pgm);
+      for (size_t round = 0; round < 20; ++round) {
+        std::map<std::string, std::string> batch;
+        for (size_t i = 0; i < (key_len ? 200 : 5000); ++i) {
+          std::string key = std::string(key_len, 'a') + std::to_string(e());
+          if (!m.count(key))
+            batch.emplace(key, std::to_string(e()));
+        }
+        std::vector<std::pair<std::string, std::string>> kvs(
+            batch.begin(), batch.end());
+        ASSERT_EQ(tree.InsertSorted(kvs.begin(), kvs.end()), kvs.size());
+        m.insert(batch.begin(), batch.end());
+        ASSERT_EQ(tree.TupleNum(), m.size());
+      }
+      // Stop at the first existing key.
+      std::string exist = std::next(m.begin(), m.size() / 2)->first;
+      std::map<std::string, std::string> batch{{exist, "x"}};
+      for (size_t i = 0; i < 100; ++i) {
+        std::string key = std::string(key_len, 'a') + std::to_string(e());
+        if (!m.count(key))
+          batch.emplace(key, std::to_string(e()));
+      }
+      std::vector<std::pair<std::string, std::string>> kvs(
+          batch.begin(), batch.end());
+      size_t num = std::distance(batch.begin(), batch.find(exist));
+      ASSERT_EQ(tree.InsertSorted(kvs.begin(), kvs.end()), num);
+      m.insert(kvs.begin(), kvs.begin() + num);
+      ASSERT_EQ(tree.TupleNum(), m.size());
+      auto it = tree.Begin();
+      for (const auto& [key, value] : m) {
+        auto kv = it.Cur();
+        ASSERT_TRUE(kv.has_value());
+        ASSERT_EQ(kv.value().first, key);
+        ASSERT_EQ(kv.value().second, value);
+        it.Next();
+      }
+      ASSERT_FALSE(it.Cur().has_value());
+      for (const auto& [key, value] : m)
+        ASSERT_EQ(tree.Get(key).value(), value);
+      tree.Destroy();
+    }
+  }
+  ASSERT_TRUE(fs::remove(path));
+}
+
+TEST(BPlusTreeTest, GetReuseBuffer) {
+  std::string path = test_name();
+  std::minstd_rand e(233);
+  {
+    auto pgm = wing::PageManager::Create(path, 256);
+    auto tree = tree_t::Create(*pgm);
+    std::map<std::string, std::string> m;
+    for (size_t i = 0; i < 10000; ++i) {
+      std::string key = std::to_string(e());
+      std::string value(e() % 100, 'a' + i % 26);
+      ASSERT_EQ(tree.Insert(key, value), m.emplace(key, value).second);
+    }
+    std::string buf;
+    for (const auto& [key, value] : m) {
+      ASSERT_TRUE(tree.Get(key, buf));
+      ASSERT_EQ(buf, value);
+    }
+    ASSERT_FALSE(tree.Get("x", buf));
+    // Once the buffer is large enough, it is not reallocated.
+    buf.reserve(100);
+    const char* data = buf.data();
+    for (const auto& [key, value] : m) {
+      ASSERT_TRUE(tree.Get(key, buf));
+      ASSERT_EQ(buf.data(), data);
+    }
+    tree.Destroy();
+  }
+  ASSERT_TRUE(fs::remove(path));
+}
+
+TEST(BPlusTreeTest, SuffixTruncation) {
+  std::string path = test_name();
+  std::minstd_rand e(233);
+  {
+    auto pgm = wing::PageManager::Create(path, 256);
+    auto tree = tree_t::Create(*pgm);
+    // The keys differ in the first few bytes but are long.
+    std::map<std::string, std::string> m;
+    for (size_t i = 0; i < 3000; ++i) {
+      std::string key = std::to_string(e()) + std::string(1000, 'a');
+      ASSERT_EQ(tree.Insert(key, "v"), m.emplace(key, "v").second);
+    }
+    for (const auto& [key, value] : m)
+      ASSERT_EQ(tree.Get(key).value(), value);
+    size_t leaves = 0;
+    wing::pgid_t last = 0;
+    for (auto it = tree.Begin(); it.Cur().has_value(); it.Next()) {
+      if (it.pg.ID() != last) {
+        ++leaves;
+        last = it.pg.ID();
+      }
+    }
+    std::vector<wing::pgid_t> pages;
+    tree.CollectPages(pages);
+    // The separators are a few bytes, so the inner pages have many children.
+    size_t inners = pages.size() - 1 - leaves;
+    ASSERT_LE(inners * 50, leaves);
+    tree.Destroy();
+  }
+  ASSERT_TRUE(fs::remove(path));
+}
+
+TEST(BPlusTreeTest, MergeOnDelete) {
+  std::string path = test_name();
+  std::minstd_rand e(233);
+  {
+    auto pgm = wing::PageManager::Create(path, 256);
+    for (size_t key_len : {0, 300}) {
+      auto tree = tree_t::Create(*pgm);
+      std::map<std::string, std::string> m;
+      for (size_t i = 0; i < (key_len ? 20000 : 100000); ++i) {
+        std::string key = std::string(key_len, 'a') + std::to_string(e());
+        std::string value = std::to_string(e());
+        ASSERT_EQ(tree.Insert(key, value), m.emplace(key, value).second);
+      }
+      std::vector<wing::pgid_t> pages;
+      tree.CollectPages(pages);
+      size_t full_pages = pages.size();
+      // Keep 1/20 of the tuples. Deleting and taking both merge pages.
+      std::vector<std::string> keys;
+      for (const auto& [key, value] : m)
+        keys.push_back(key);
+      std::shuffle(keys.begin(), keys.end(), e);
+      for (size_t i = 0; i < keys.size() / 20 * 19; ++i) {
+        if (i % 2) {
+          ASSERT_TRUE(tree.Delete(keys[i]));
+        } else {
+          ASSERT_EQ(tree.Take(keys[i]).value(), m[keys[i]]);
+        }
+        m.erase(keys[i]);
+      }
+      ASSERT_EQ(tree.TupleNum(), m.size());
+      auto it = tree.Begin();
+      for (const auto& [key, value] : m) {
+        auto kv = it.Cur();
+        ASSERT_TRUE(kv.has_value());
+        ASSERT_EQ(kv.value().first, key);
+        ASSERT_EQ(kv.value().second, value);
+        it.Next();
+      }
+      ASSERT_FALSE(it.Cur().has_value());
+      for (const auto& [key, value] : m)
+        ASSERT_EQ(tree.Get(key).value(), value);
+      // The pages shrink with the data.
+      pages.clear();
+      tree.CollectPages(pages);
+      ASSERT_LE(pages.size() * 5, full_pages);
+      // Deleting everything collapses the tree.
+      for (const auto& [key, value] : m)
+        ASSERT_TRUE(tree.Delete(key));
+      ASSERT_EQ(tree.TupleNum(), 0);
+      tree.Destroy();
+    }
+  }
+  ASSERT_TRUE(fs::remove(path));
+}
+
+TEST(BPlusTreeTest, SharedKeyHeads) {
+  std::string path = test_name();
+  std::minstd_rand e(233);
+  {
+    auto pgm = wing::PageManager::Create(path, 256);
+    auto tree = tree_t::Create(*pgm);
+    std::map<std::string, std::string> m;
+    // Short keys, keys padded with zero bytes and keys sharing their first
+    // 4 bytes all have equal heads and must be told apart by the full key.
+    for (size_t i = 0; i < 50000; ++i) {
+      std::string key;
+      switch (e() % 3) {
+        case 0: key = std::string(e() % 6, '\0'); break;
+        case 1: key = std::string("abcd") + std::to_string(e() % 100000); break;
+        default: key = std::string(1, 'a' + e() % 3) + std::string(e() % 4, '\0');
+      }
+      std::string value = std::to_string(e());
+      ASSERT_EQ(tree.Insert(key, value), m.emplace(key, value).second);
+    }
+    for (const auto& [key, value] : m)
+      ASSERT_EQ(tree.Get(key).value(), value);
+    for (auto it = m.begin(); it != m.end(); ++it) {
+      auto kv = tree.LowerBound(it->first).Cur();
+      ASSERT_TRUE(kv.has_value());
+      ASSERT_EQ(kv.value().first, it->first);
+    }
+    auto it = tree.Begin();
+    for (const auto& [key, value] : m) {
+      auto kv = it.Cur();
+      ASSERT_TRUE(kv.has_value());
+      ASSERT_EQ(kv.value().first, key);
+      it.Next();
+    }
+    ASSERT_FALSE(it.Cur().has_value());
+    tree.Destroy();
+  }
+  ASSERT_TRUE(fs::remove(path));
+}
+
+TEST(BPlusTreeTest, ReverseIterate) {
+  std::string path = test_name();
+  std::minstd_rand e(233);
+  {
+    auto pgm = wing::PageManager::Create(path, 256);
+    auto tree = tree_t::Create(*pgm);
+    ASSERT_FALSE(tree.RBegin().Cur().has_value());
+    ASSERT_FALSE(tree.ReverseLowerBound("a").Cur().has_value());
+    std::map<std::string, std::string> m;
+    for (size_t i = 0; i < 100000; ++i) {
+      std::string key = std::to_string(e() % 1000000);
+      std::string value = std::to_string(e());
+      ASSERT_EQ(tree.Insert(key, value), m.emplace(key, value).second);
+    }
+    // Leave holes and underfull leaves behind.
+    for (auto it = m.begin(); it != m.end();) {
+      if (e() % 3 == 0) {
+        ASSERT_TRUE(tree.Delete(it->first));
+        it = m.erase(it);
+      } else {
+        ++it;
+      }
+    }
+    auto it = tree.RBegin();
+    for (auto mit = m.rbegin(); mit != m.rend(); ++mit) {
+      auto kv = it.Cur();
+      ASSERT_TRUE(kv.has_value());
+      ASSERT_EQ(kv.value().first, mit->first);
+      ASSERT_EQ(kv.value().second, mit->second);
+      it.Prev();
+    }
+    ASSERT_FALSE(it.Cur().has_value());
+    for (size_t i = 0; i < 10000; ++i) {
+      std::string key = std::to_string(e() % 1000000);
+      auto check = [&](tree_t::Iter iter, auto mit) {
+        if (mit == m.begin()) {
+          ASSERT_FALSE(iter.Cur().has_value());
+          return;
+        }
+        --mit;
+        for (size_t j = 0; j < 3; ++j) {
+          auto kv = iter.Cur();
+          ASSERT_TRUE(kv.has_value());
+          ASSERT_EQ(kv.value().first, mit->first);
+          if (mit == m.begin())
+            break;
+          --mit;
+          iter.Prev();
+        }
+      };
+      check(tree.ReverseLowerBound(key), m.upper_bound(key));
+      check(tree.ReverseUpperBound(key), m.lower_bound(key));
+      // Prev undoes Next.
+      auto iter = tree.UpperBound(key);
+      auto mit = m.upper_bound(key);
+      if (mit != m.end() && mit != m.begin()) {
+        ASSERT_EQ(iter.Cur().value().first, mit->first);
+        iter.Prev();
+        ASSERT_EQ(iter.Cur().value().first, std::prev(mit)->first);
+        iter.Next();
+        ASSERT_EQ(iter.Cur().value().first, mit->first);
+      }
+    }
+    tree.Destroy();
+  }
+  ASSERT_TRUE(fs::remove(path));
+}
+
+TEST(BPlusTreeTest, SplitKeys) {
+  std::string path = test_name();
+  std::minstd_rand e(233);
+  {
+    auto pgm = wing::PageManager::Create(path, 256);
+    auto tree = tree_t::Create(*pgm);
+    std::set<std::string> keys;
+    for (size_t i = 0; i < 200000; ++i) {
+      std::string key = std::to_string(e());
+      ASSERT_EQ(tree.Insert(key, "v"), keys.insert(key).second);
+    }
+    auto check = [&](size_t n, std::optional<std::string_view> lo,
+                     std::optional<std::string_view> hi) {
+      auto split = tree.SplitKeys(n, lo, hi);
+      ASSERT_LT(split.size(), n);
+      ASSERT_TRUE(std::is_sorted(split.begin(), split.end()));
+      auto first = lo ? keys.lower_bound(std::string(*lo)) : keys.begin();
+      auto last = hi ? keys.lower_bound(std::string(*hi)) : keys.end();
+      size_t total = std::distance(first, last);
+      // The ranges between the keys are roughly equal.
+      auto prev = first;
+      split.push_back(hi ? std::string(*hi) : std::string(1, 127));
+      for (const auto& key : split) {
+        auto it = keys.lower_bound(key);
+        if (lo) {
+          ASSERT_GE(key, *lo);
+        }
+        size_t num = std::distance(prev, it);
+        ASSERT_GE(num * n * 2, total) << key;
+        ASSERT_LE(num * n, total * 2) << key;
+        prev = it;
+      }
+    };
+    check(4, std::nullopt, std::nullopt);
+    check(16, std::nullopt, std::nullopt);
+    check(16, "3", "6");
+    check(8, "5", std::nullopt);
+    ASSERT_TRUE(tree.SplitKeys(1).empty());
+    tree.Destroy();
+  }
+  ASSERT_TRUE(fs::remove(path));
+}
+
+TEST(BPlusTreeTest, RankNth) {
+  std::string path = test_name();
+  std::minstd_rand e(233);
+  {
+    auto pgm = wing::PageManager::Create(path, 256);
+    for (size_t key_len : {0, 500}) {
+      std::map<std::string, std::string> m;
+      size_t num = key_len ? 3000 : 100000;
+      for (size_t i = 0; i < num / 2; ++i)
+        m.emplace(std::string(key_len, 'a') + std::to_string(e()), "v");
+      auto tree = tree_t::Create(*pgm);
+      tree.BulkLoad(m.begin(), m.end(), 0.9);
+      auto check = [&]() {
+        ASSERT_EQ(tree.TupleNum(), m.size());
+        std::vector<std::string> keys;
+        for (const auto& [key, value] : m)
+          keys.push_back(key);
+        size_t step = std::max<size_t>(keys.size() / 500, 1);
+        for (size_t i = 0; i < keys.size(); i += step) {
+          ASSERT_EQ(tree.Rank(keys[i]), i);
+          ASSERT_EQ(tree.Rank(keys[i], true), i + 1);
+          ASSERT_EQ(tree.Nth(i).Cur().value().first, keys[i]);
+          // A key between keys[i - 1] and keys[i].
+          std::string key = keys[i];
+          key.pop_back();
+          size_t rank = std::lower_bound(keys.begin(), keys.end(), key) -
+                        keys.begin();
+          ASSERT_EQ(tree.Rank(key), rank);
+          ASSERT_EQ(tree.Rank(key, true), rank);
+        }
+        ASSERT_EQ(tree.Rank(std::string(1, 127)), keys.size());
+        ASSERT_FALSE(tree.Nth(keys.size()).Cur().has_value());
+      };
+      check();
+      // Split pages.
+      for (size_t i = 0; i < num; ++i) {
+        std::string key = std::string(key_len, 'a') + std::to_string(e());
+        ASSERT_EQ(tree.Insert(key, "v"), m.emplace(key, "v").second);
+      }
+      check();
+      std::vector<std::pair<std::string, std::string>> kvs;
+      for (size_t i = 0; i < num / 4; ++i) {
+        std::string key = std::string(key_len, 'b') + std::to_string(e());
+        if (!m.count(key))
+          kvs.emplace_back(key, "v");
+      }
+      std::sort(kvs.begin(), kvs.end());
+      kvs.erase(std::unique(kvs.begin(), kvs.end()), kvs.end());
+      ASSERT_EQ(tree.InsertSorted(kvs.begin(), kvs.end()), kvs.size());
+      m.insert(kvs.begin(), kvs.end());
+      check();
+      // Merge and redistribute pages.
+      for (auto it = m.begin(); it != m.end();) {
+        if (e() % 8) {
+          ASSERT_TRUE(e() % 2 ? tree.Delete(it->first)
+                              : tree.Take(it->first).has_value());
+          it = m.erase(it);
+        } else {
+          ++it;
+        }
+      }
+      check();
+      tree.Destroy();
+    }
+  }
+  ASSERT_TRUE(fs::remove(path));
+}
+
+TEST(BPlusTreeTest, FixedSizeKeys) {
+  std::string path = test_name();
+  std::mt19937_64 e(233);
+  auto key_of = [](int64_t k) {
+    return std::string(reinterpret_cast<const char*>(&k), sizeof(k));
+  };
+  {
+    auto pgm = wing::PageManager::Create(path, 256);
+    auto tree = wing::BPlusTree<wing::Int64KeyCompare>::Create(*pgm);
+    std::map<int64_t, std::string> m;
+    for (size_t i = 0; i < 100000; ++i) {
+      // Both small keys, which are told apart by heads, and large ones.
+      int64_t k = i % 2 ? (int64_t)e() : (int64_t)(e() % 1000000) - 500000;
+      std::string value(e() % 20, 'a' + e() % 26);
+      ASSERT_EQ(tree.Insert(key_of(k), value), m.emplace(k, value).second);
+    }
+    for (auto it = m.begin(); it != m.end();) {
+      if (e() % 2) {
+        ASSERT_TRUE(tree.Delete(key_of(it->first)));
+        it = m.erase(it);
+      } else {
+        ++it;
+      }
+    }
+    ASSERT_EQ(tree.TupleNum(), m.size());
+    auto it = tree.Begin();
+    size_t rank = 0;
+    for (const auto& [k, value] : m) {
+      auto kv = it.Cur();
+      ASSERT_TRUE(kv.has_value());
+      ASSERT_EQ(kv.value().first, key_of(k));
+      ASSERT_EQ(kv.value().second, value);
+      ASSERT_EQ(tree.Get(key_of(k)).value(), value);
+      if (rank % 100 == 0) {
+        ASSERT_EQ(tree.Rank(key_of(k)), rank);
+        ASSERT_EQ(tree.LowerBound(key_of(k - 1)).Cur().value().first,
+            key_of(m.lower_bound(k - 1)->first));
+      }
+      it.Next();
+      rank++;
+    }
+    ASSERT_FALSE(it.Cur().has_value());
+    tree.Destroy();
+  }
+  ASSERT_TRUE(fs::remove(path));
+}
+
+TEST(BPlusTreeTest, AppendIncreasing) {
+  constexpr size_t THREADS = 8;
+  constexpr size_t N = 100000;
+  std::string path = test_name();
+  auto key_of = [](size_t i) {
+    std::string key = std::to_string(i);
+    return std::string(10 - key.size(), '0') + key;
+  };
+  {
+    auto pgm = wing::PageManager::Create(path, 256);
+    auto tree = tree_t::Create(*pgm);
+    for (size_t i = 0; i < N; ++i)
+      ASSERT_TRUE(tree.Insert(key_of(i), "v"));
+    ASSERT_FALSE(tree.Insert(key_of(N - 1), "v"));
+    // All leaves but the last one are full, since appending never leaves
+    // half-empty pages behind.
+    std::vector<size_t> sizes;
+    wing::pgid_t last = 0;
+    for (auto it = tree.Begin(); it.Cur().has_value(); it.Next()) {
+      if (it.pg.ID() != last) {
+        sizes.push_back(0);
+        last = it.pg.ID();
+      }
+      sizes.back() += 1;
+    }
+    ASSERT_GT(sizes.size(), 2);
+    for (size_t i = 0; i + 1 < sizes.size(); ++i)
+      ASSERT_EQ(sizes[i], sizes[0]);
+    for (size_t i = 0; i < N; i += 997)
+      ASSERT_EQ(tree.Rank(key_of(i)), i);
+    // Other keys are told apart by the cached largest key without reading
+    // the right-most path, so inserting reads the pages Get reads.
+    std::string key = key_of(N / 2);
+    ASSERT_TRUE(tree.Delete(key));
+    wing::BufferPoolStats get_stats, insert_stats;
+    {
+      wing::BufferPoolStatsScope scope(
+        wing::BufferPoolStatsScope::TABLE, &get_stats);
+      ASSERT_FALSE(tree.Get(key).has_value());
+    }
+    {
+      wing::BufferPoolStatsScope scope(
+        wing::BufferPoolStatsScope::TABLE, &insert_stats);
+      ASSERT_TRUE(tree.Insert(key, "v"));
+    }
+    auto get_loaded = get_stats.Load();
+    auto insert_loaded = insert_stats.Load();
+    ASSERT_EQ(insert_loaded.hits + insert_loaded.misses,
+        get_loaded.hits + get_loaded.misses);
+    tree.Destroy();
+  }
+  {
+    auto pgm = wing::PageManager::Create(path, 256);
+    auto tree = tree_t::Create(*pgm);
+    // Roughly increasing keys from several threads.
+    std::atomic<size_t> next{0};
+    auto work = [&]() {
+      for (;;) {
+        size_t i = next.fetch_add(1);
+        if (i >= N) break;
+        ASSERT_TRUE(tree.Insert(key_of(i), key_of(i)));
+      }
+    };
+    std::vector<std::thread> threads;
+    for (size_t tid = 0; tid < THREADS; ++tid)
+      threads.emplace_back(work);
+    for (auto& t : threads)
+      t.join();
+    ASSERT_EQ(tree.TupleNum(), N);
+    auto it = tree.Begin();
+    for (size_t i = 0; i < N; ++i) {
+      auto kv = it.Cur();
+      ASSERT_TRUE(kv.has_value());
+      ASSERT_EQ(kv.value().first, key_of(i));
+      ASSERT_EQ(kv.value().second, key_of(i));
+      if (i % 997 == 0) {
+        ASSERT_EQ(tree.Rank(key_of(i)), i);
+      }
+      it.Next();
+    }
+    ASSERT_FALSE(it.Cur().has_value());
+    tree.Destroy();
+  }
+  ASSERT_TRUE(fs::remove(path));
+}
+
+TEST(BPlusTreeTest, CachedMeta) {
+  std::string path = test_name();
+  wing::pgid_t meta;
+  {
+    auto pgm = wing::PageManager::Create(path, 256);
+    auto tree = tree_t::Create(*pgm);
+    for (size_t i = 0; i < 10; ++i)
+      ASSERT_TRUE(tree.Insert(std::to_string(i), "v"));
+    // Only the root leaf is read, not the meta page.
+    wing::BufferPoolStats stats;
+    {
+      wing::BufferPoolStatsScope scope(
+        wing::BufferPoolStatsScope::TABLE, &stats);
+      ASSERT_EQ(tree.Get("5"), "v");
+      ASSERT_FALSE(tree.Get("a").has_value());
+    }
+    auto loaded = stats.Load();
+    ASSERT_EQ(loaded.hits + loaded.misses, 2);
+    // Neither is the meta page written by writes in place.
+    {
+      wing::BufferPoolStatsScope scope(
+        wing::BufferPoolStatsScope::TABLE, &stats);
+      ASSERT_TRUE(tree.Insert("a", "v"));
+      ASSERT_TRUE(tree.Delete("a"));
+    }
+    loaded = stats.Load();
+    ASSERT_EQ(loaded.hits + loaded.misses, 4);
+    // The tree grows and shrinks.
+    for (size_t i = 10; i < 100000; ++i)
+      ASSERT_TRUE(tree.Insert(std::to_string(i), "v"));
+    for (size_t i = 0; i < 100000; i += 2)
+      ASSERT_TRUE(tree.Delete(std::to_string(i)));
+    ASSERT_EQ(tree.TupleNum(), 50000);
+    meta = tree.MetaPageID();
+  }
+  std::unique_ptr<wing::PageManager> pgm;
+  ASSERT_NO_FATAL_FAILURE(match(
+      wing::PageManager::Open(path, 256),
+      [&pgm](std::unique_ptr<wing::PageManager>& pgm_ret) {
+        pgm = std::move(pgm_ret);
+      },
+      [](wing::io::Error& err) { FAIL() << err; }));
+  {
+    auto tree = tree_t::Open(*pgm, meta);
+    ASSERT_EQ(tree.TupleNum(), 50000);
+    for (size_t i = 0; i < 100000; ++i)
+      ASSERT_EQ(tree.Get(std::to_string(i)).has_value(), i % 2 == 1) << i;
+    tree.Destroy();
+  }
+  pgm.reset();
+  ASSERT_TRUE(fs::remove(path));
+}
+
+TEST(BPlusTreeTest, Compact) {
+  std::string path = test_name();
+  std::minstd_rand e(233);
+  std::map<std::string, std::string> m[2];
+  std::string blob_value(23333, 'a');
+  wing::pgid_t meta[2], blob_meta;
+  auto check = [&](wing::PageManager& pgm, bool sequential) {
+    for (size_t t = 0; t < 2; ++t) {
+      auto tree = tree_t::Open(pgm, meta[t]);
+      auto it = tree.Begin();
+      wing::pgid_t last = 0;
+      for (const auto& [key, value] : m[t]) {
+        auto kv = it.Cur();
+        ASSERT_TRUE(kv.has_value());
+        ASSERT_EQ(kv.value().first, key);
+        ASSERT_EQ(kv.value().second, value);
+        if (sequential && it.pg.ID() != last) {
+          // The leaves are contiguous and in key order.
+          if (last != 0) {
+            ASSERT_EQ(it.pg.ID(), last + 1);
+          }
+          last = it.pg.ID();
+        }
+        it.Next();
+      }
+      ASSERT_FALSE(it.Cur().has_value());
+      for (const auto& [key, value] : m[t])
+        ASSERT_EQ(tree.Get(key).value(), value);
+    }
+    ASSERT_EQ(wing::Blob::Open(pgm, blob_meta).Read(), blob_value);
+  };
+  // Lay out the trees and the blob at the front of the file.
+  auto compact = [&](wing::PageManager& pgm, tree_t (&trees)[2],
+      wing::Blob& blob) {
+    std::vector<wing::pgid_t> pages;
+    trees[0].CollectPages(pages);
+    blob.CollectPages(pages);
+    trees[1].CollectPages(pages);
+    std::vector<wing::pgid_t> new_id(pgm.PageNum(), 0);
+    for (size_t i = 0; i < pages.size(); ++i)
+      new_id[pages[i]] = i + 2;
+    auto remap = [&new_id](wing::pgid_t pgid) { return new_id[pgid]; };
+    for (size_t t = 0; t < 2; ++t)
+      trees[t].RemapPages(remap);
+    blob.RemapPages(remap);
+    size_t old_num = pgm.PageNum();
+    pgm.Relocate(pages);
+    ASSERT_EQ(pgm.PageNum(), pages.size() + 2);
+    ASSERT_LT(pgm.PageNum(), old_num);
+    ASSERT_EQ(fs::file_size(path), pgm.PageNum() * wing::Page::SIZE);
+    for (size_t t = 0; t < 2; ++t)
+      meta[t] = trees[t].MetaPageID();
+    blob_meta = blob.MetaPageID();
+  };
+  auto reopen = [&path](std::unique_ptr<wing::PageManager>& pgm) {
+    pgm.reset();
+    ASSERT_NO_FATAL_FAILURE(match(
+        wing::PageManager::Open(path, 256),
+        [&pgm](std::unique_ptr<wing::PageManager>& pgm_ret) {
+          pgm = std::move(pgm_ret);
+        },
+        [](wing::io::Error& err) { FAIL() << err; }));
+  };
+  {
+    auto pgm = wing::PageManager::Create(path, 256);
+    tree_t trees[2] = {tree_t::Create(*pgm), tree_t::Create(*pgm)};
+    auto blob = wing::Blob::Create(*pgm);
+    blob.Rewrite(blob_value);
+    // Interleave the trees so that their leaves are scattered.
+    for (size_t i = 0; i < 100000; ++i) {
+      std::string key = std::to_string(e());
+      std::string value = std::to_string(e());
+      trees[i % 2].Insert(key, value);
+      m[i % 2].emplace(key, value);
+    }
+    for (size_t t = 0; t < 2; ++t) {
+      for (auto it = m[t].begin(); it != m[t].end();) {
+        if (e() % 2) {
+          ASSERT_TRUE(trees[t].Delete(it->first));
+          it = m[t].erase(it);
+        } else {
+          ++it;
+        }
+      }
+    }
+    ASSERT_NO_FATAL_FAILURE(compact(*pgm, trees, blob));
+    ASSERT_NO_FATAL_FAILURE(check(*pgm, true));
+    // Pages can still be allocated and freed.
+    for (size_t i = 0; i < 10000; ++i) {
+      std::string key = std::to_string(e());
+      std::string value = std::to_string(e());
+      if (m[0].emplace(key, value).second) {
+        ASSERT_TRUE(trees[0].Insert(key, value));
+      }
+    }
+    ASSERT_NO_FATAL_FAILURE(check(*pgm, false));
+  }
+  std::unique_ptr<wing::PageManager> pgm;
+  ASSERT_NO_FATAL_FAILURE(reopen(pgm));
+  ASSERT_NO_FATAL_FAILURE(check(*pgm, false));
+  // Free enough pages for the free list to take several pages on disk, and
+  // compact after loading it.
+  std::vector<wing::pgid_t> plain;
+  for (size_t i = 0; i < 5000; ++i)
+    plain.push_back(pgm->AllocPlainPage().ID());
+  for (auto pgid : plain)
+    pgm->Free(pgid);
+  ASSERT_NO_FATAL_FAILURE(reopen(pgm));
+  {
+    tree_t trees[2] = {
+      tree_t::Open(*pgm, meta[0]), tree_t::Open(*pgm, meta[1])};
+    auto blob = wing::Blob::Open(*pgm, blob_meta);
+    ASSERT_NO_FATAL_FAILURE(compact(*pgm, trees, blob));
+  }
+  ASSERT_NO_FATAL_FAILURE(check(*pgm, true));
+  ASSERT_NO_FATAL_FAILURE(reopen(pgm));
+  ASSERT_NO_FATAL_FAILURE(check(*pgm, true));
+  pgm.reset();
+  ASSERT_TRUE(fs::remove(path));
+}
+TEST(BPlusTreeTest, ReadAheadRangeScan) {
+  std::string path = test_name();
+  wing::PageManagerOptions options{.io_engine = wing::IOEngineKind::IO_URING};
+  std::minstd_rand e(233);
+  std::map<std::string, std::string> m;
+  wing::pgid_t meta;
+  {
+    auto pgm = wing::PageManager::Create(path, 256, options);
+    auto tree = tree_t::Create(*pgm);
+    for (size_t i = 0; i < 100000; ++i) {
+      std::string key = std::to_string(e());
+      std::string value = std::to_string(e());
+      tree.Insert(key, value);
+      m.emplace(key, value);
+    }
+    meta = tree.MetaPageID();
+  }
+  std::unique_ptr<wing::PageManager> pgm;
+  ASSERT_NO_FATAL_FAILURE(match(
+      wing::PageManager::Open(path, 256, options),
+      [&pgm](std::unique_ptr<wing::PageManager>& pgm_ret) {
+        pgm = std::move(pgm_ret);
+      },
+      [](wing::io::Error& err) { FAIL() << err; }));
+  auto tree = tree_t::Open(*pgm, meta);
+  {
+    // Cold full scan.
+    auto it = tree.Begin();
+    for (const auto& [key, value] : m) {
+      auto kv = it.Cur();
+      ASSERT_TRUE(kv.has_value());
+      ASSERT_EQ(kv.value().first, key);
+      ASSERT_EQ(kv.value().second, value);
+      it.Next();
+    }
+    ASSERT_FALSE(it.Cur().has_value());
+  }
+  // The read-ahead stops at the end key, but the iterator itself does not.
+  for (size_t round = 0; round < 100; ++round) {
+    std::string start = std::to_string(e());
+    std::string end = std::to_string(e());
+    if (end < start)
+      std::swap(start, end);
+    bool inclusive = round % 2;
+    auto it = tree.LowerBound(start);
+    it.SetReadAheadEnd(end, inclusive);
+    auto end_it = inclusive ? m.upper_bound(end) : m.lower_bound(end);
+    for (auto mit = m.lower_bound(start); mit != end_it; ++mit) {
+      auto kv = it.Cur();
+      ASSERT_TRUE(kv.has_value());
+      ASSERT_EQ(kv.value().first, mit->first);
+      ASSERT_EQ(kv.value().second, mit->second);
+      it.Next();
+    }
+    if (end_it == m.end())
+      ASSERT_FALSE(it.Cur().has_value());
+    else
+      ASSERT_EQ(it.Cur().value().first, end_it->first);
+  }
+  tree.Destroy();
+  pgm->ShrinkToFit();
+  ASSERT_EQ(pgm->PageNum(), pgm->SuperPageID() + 1);
+  pgm.reset();
+  ASSERT_TRUE(fs::remove(path));
+}
+
+TEST(BPlusTreeTest, ConcurrentInsertGet) {
+  constexpr size_t THREADS = 8;
+  constexpr size_t N = 20000;
+  std::string path = test_name();
+  {
+    // Small enough to evict pages frequently.
+    auto pgm = wing::PageManager::Create(path, 256);
+    auto tree = tree_t::Create(*pgm);
+    auto key_of = [](size_t tid, size_t i) {
+      return std::to_string(i * THREADS + tid);
+    };
+    auto work = [&](size_t tid) {
+      std::minstd_rand e(tid);
+      for (size_t i = 0; i < N; ++i) {
+        std::string key = key_of(tid, i);
+        ASSERT_TRUE(tree.Insert(key, key + "a"));
+        if (i % 3 == 0) {
+          ASSERT_TRUE(tree.Update(key, key + "b"));
+        }
+        if (i % 5 == 0) {
+          ASSERT_TRUE(tree.Delete(key_of(tid, i / 2)));
+        }
+        // Keys of other threads are being modified.
+        std::string other = key_of(e() % THREADS, e() % N);
+        auto value = tree.Get(other);
+        if (value.has_value()) {
+          ASSERT_TRUE(value.value() == other + "a" ||
+              value.value() == other + "b");
+        }
+      }
+    };
+    std::vector<std::thread> threads;
+    for (size_t tid = 0; tid < THREADS; ++tid)
+      threads.emplace_back(work, tid);
+    for (auto& t : threads)
+      t.join();
+    size_t num = 0;
+    for (size_t tid = 0; tid < THREADS; ++tid) {
+      std::set<size_t> deleted;
+      for (size_t i = 0; i < N; i += 5)
+        deleted.insert(i / 2);
+      for (size_t i = 0; i < N; ++i) {
+        std::string key = key_of(tid, i);
+        auto value = tree.Get(key);
+        if (deleted.count(i)) {
+          ASSERT_FALSE(value.has_value());
+          continue;
+        }
+        ASSERT_EQ(value.value(), key + (i % 3 == 0 ? "b" : "a"));
+        num += 1;
+      }
+    }
+    ASSERT_EQ(tree.TupleNum(), num);
+  }
+  ASSERT_TRUE(fs::remove(path));
+}
+
+TEST(BPlusTreeTest, ConcurrentInsertDeleteRankNth) {
+  constexpr size_t THREADS = 8;
+  constexpr size_t N = 20000;
+  std::string path = test_name();
+  {
+    auto pgm = wing::PageManager::Create(path, 256);
+    auto tree = tree_t::Create(*pgm);
+    // Thread "tid" owns the keys "i * THREADS + tid". Half of them are loaded
+    // first, and with spare space in the pages most writes do not split or
+    // merge pages, so they only update the counts on their paths.
+    auto key_of = [](size_t tid, size_t i) {
+      std::string key = std::to_string(i * THREADS + tid);
+      return std::string(8 - key.size(), '0') + key;
+    };
+    std::map<std::string, std::string> m;
+    for (size_t tid = 0; tid < THREADS; ++tid)
+      for (size_t i = 0; i < N; i += 2)
+        m.emplace(key_of(tid, i), "v");
+    tree.BulkLoad(m.begin(), m.end(), 0.7);
+    auto work = [&](size_t tid) {
+      std::minstd_rand e(tid);
+      for (size_t i = 0; i < N; ++i) {
+        std::string key = key_of(tid, i);
+        if (i % 2 == 1) {
+          ASSERT_TRUE(tree.Insert(key, "v"));
+        } else if (i % 4 == 0) {
+          ASSERT_TRUE(tree.Delete(key));
+        }
+        // The counts are being updated by other threads.
+        if (i % 16 == 0) {
+          auto it = tree.Nth(e() % m.size());
+          if (it.Cur().has_value())
+            ASSERT_LE(tree.Rank(it.Cur().value().first), m.size() * 2);
+        }
+      }
+    };
+    std::vector<std::thread> threads;
+    for (size_t tid = 0; tid < THREADS; ++tid)
+      threads.emplace_back(work, tid);
+    for (auto& t : threads)
+      t.join();
+    std::vector<std::string> keys;
+    for (size_t i = 0; i < N; ++i)
+      for (size_t tid = 0; tid < THREADS; ++tid)
+        if (i % 4 != 0)
+          keys.push_back(key_of(tid, i));
+    std::sort(keys.begin(), keys.end());
+    ASSERT_EQ(tree.TupleNum(), keys.size());
+    for (size_t i = 0; i < keys.size(); i += 7) {
+      ASSERT_EQ(tree.Rank(keys[i]), i);
+      ASSERT_EQ(tree.Nth(i).Cur().value().first, keys[i]);
+    }
+    ASSERT_EQ(tree.Rank("a"), keys.size());
+    ASSERT_FALSE(tree.Nth(keys.size()).Cur().has_value());
+  }
+  ASSERT_TRUE(fs::remove(path));
+}
@@ -532,6 +532,223 @@ TEST(BasicTest, Save) {
   std::filesystem::remove("__tmp2");
 }
 
+TEST(BasicTest, CreateTableAsSelect) {
+  using namespace wing;
+  std::filesystem::remove("__tmp_ctas");
+  {
+    auto db = std::make_unique<wing::Instance>("__tmp_ctas", 0);
+    EXPECT_TRUE(
+        db->Execute("create table A(a int64 primary key, b varchar(20));")
+            .Valid());
+    std::string stmt = "insert into A values ";
+    for (int i = 0; i < 1000; i++) {
+      if (i > 0)
+        stmt += ", ";
+      stmt += fmt::format("({}, '{}')", 999 - i, fmt::format("v{}", i));
+    }
+    // Bulk loaded into the empty table.
+    {
+      auto result = db->Execute(stmt + ";");
+      EXPECT_TRUE(result.Valid());
+      EXPECT_EQ(result.Next().ReadInt(0), 1000);
+    }
+    EXPECT_FALSE(db->Execute("create table A as select * from A;").Valid());
+    {
+      auto result =
+          db->Execute("create table B as select a * 2 as c, b from A where a "
+                      "< 500;");
+      EXPECT_TRUE(result.Valid());
+    }
+    EXPECT_TRUE(db->Execute("insert into B values (-1, 'x');").Valid());
+  }
+  {
+    auto db = std::make_unique<wing::Instance>("__tmp_ctas", 0);
+    auto result = db->Execute("select c, b from B;");
+    EXPECT_TRUE(result.Valid());
+    for (int i = 0; i < 500; i++) {
+      auto tuple = result.Next();
+      ASSERT_TRUE(bool(tuple));
+      EXPECT_EQ(tuple.ReadInt(0), i * 2);
+      EXPECT_EQ(tuple.ReadString(1), fmt::format("v{}", 999 - i));
+    }
+    auto tuple = result.Next();
+    ASSERT_TRUE(bool(tuple));
+    EXPECT_EQ(tuple.ReadInt(0), -1);
+    EXPECT_FALSE(bool(result.Next()));
+  }
+  std::filesystem::remove("__tmp_ctas");
+}
+
+TEST(BasicTest, OrderByPrimaryKey) {
+  using namespace wing;
+  std::filesystem::remove("__tmp_order");
+  {
+    auto db = std::make_unique<wing::Instance>("__tmp_order", 0);
+    EXPECT_TRUE(
+        db->Execute("create table A(a int64 primary key, b varchar(20));")
+            .Valid());
+    std::string stmt = "insert into A values ";
+    for (int i = 0; i < 1000; i++) {
+      if (i > 0)
+        stmt += ", ";
+      stmt += fmt::format("({}, '{}')", i * 7 % 1000, fmt::format("v{}", i));
+    }
+    EXPECT_TRUE(db->Execute(stmt + ";").Valid());
+    auto check = [&](std::string_view stmt, std::vector<int64_t> expect) {
+      auto result = db->Execute(stmt);
+      ASSERT_TRUE(result.Valid());
+      for (auto a : expect) {
+        auto tuple = result.Next();
+        ASSERT_TRUE(bool(tuple));
+        EXPECT_EQ(tuple.ReadInt(0), a);
+      }
+      EXPECT_FALSE(bool(result.Next()));
+    };
+    check("select a from A order by a desc limit 3;", {999, 998, 997});
+    check("select a from A order by a asc limit 3;", {0, 1, 2});
+    check("select a from A order by a desc, b asc limit 2 offset 1;",
+        {998, 997});
+    check("select a from A where a < 500 and a >= 497 order by a desc;",
+        {499, 498, 497});
+    check("select a from A where a > 995 and b <> 'v0' order by a desc;",
+        {999, 998, 997, 996});
+    check("select a from A where a <= 2 order by a desc;", {2, 1, 0});
+    check("select a from A where a > 999 order by a desc;", {});
+  }
+  std::filesystem::remove("__tmp_order");
+}
+
+TEST(BasicTest, ParallelScan) {
+  using namespace wing;
+  std::filesystem::remove("__tmp_pscan");
+  {
+    auto db = std::make_unique<wing::Instance>("__tmp_pscan", 0);
+    db->SetScanThreads(4);
+    EXPECT_TRUE(
+        db->Execute("create table A(a int64 primary key, b varchar(20), c "
+                    "float64);")
+            .Valid());
+    const int N = 100000;
+    for (int i = 0; i < N; i += 10000) {
+      std::string stmt = "insert into A values ";
+      for (int j = i; j < i + 10000; j++) {
+        if (j > i)
+          stmt += ", ";
+        stmt += fmt::format("({}, 'v{}', {:.1f})", j, j % 7, j * 0.5);
+      }
+      EXPECT_TRUE(db->Execute(stmt + ";").Valid());
+    }
+    // The order is the same as a sequential scan.
+    {
+      auto result = db->Execute("select a, b from A where a % 3 = 1;");
+      ASSERT_TRUE(result.Valid());
+      for (int i = 1; i < N; i += 3) {
+        auto tuple = result.Next();
+        ASSERT_TRUE(bool(tuple));
+        ASSERT_EQ(tuple.ReadInt(0), i);
+        ASSERT_EQ(tuple.ReadString(1), fmt::format("v{}", i % 7));
+      }
+      EXPECT_FALSE(bool(result.Next()));
+      // The pages read by the scanning threads are counted in the statement.
+      auto stats = result.GetBufferPoolStats();
+      EXPECT_GE(stats.hits + stats.misses, 100);
+    }
+    {
+      auto result = db->Execute(
+          "select count(*), sum(c) from A where a >= 1000 and a < 90000;");
+      ASSERT_TRUE(result.Valid());
+      auto tuple = result.Next();
+      EXPECT_EQ(tuple.ReadInt(0), 89000);
+      EXPECT_EQ(tuple.ReadFloat(1), (1000 + 89999) * 89000ll / 2 * 0.5);
+    }
+    {
+      auto result = db->Execute("select a from A limit 2 offset 5;");
+      ASSERT_TRUE(result.Valid());
+      EXPECT_EQ(result.Next().ReadInt(0), 5);
+      EXPECT_EQ(result.Next().ReadInt(0), 6);
+      EXPECT_FALSE(bool(result.Next()));
+    }
+    // Scans under writes are not split.
+    {
+      auto result = db->Execute("delete from A where b = 'v3';");
+      ASSERT_TRUE(result.Valid());
+      EXPECT_EQ(result.Next().ReadInt(0), (N - 3 + 6) / 7);
+    }
+    {
+      auto result = db->Execute("select count(*) from A where b <> 'v3';");
+      ASSERT_TRUE(result.Valid());
+      EXPECT_EQ(result.Next().ReadInt(0), N - (N - 3 + 6) / 7);
+    }
+  }
+  std::filesystem::remove("__tmp_pscan");
+}
+
+TEST(BasicTest, CountAndOffset) {
+  using namespace wing;
+  std::filesystem::remove("__tmp_count");
+  {
+    auto db = std::make_unique<wing::Instance>("__tmp_count", 0);
+    EXPECT_TRUE(
+        db->Execute("create table A(a int64 primary key, b varchar(20));")
+            .Valid());
+    const int N = 20000;
+    for (int i = 0; i < N; i += 5000) {
+      std::string stmt = "insert into A values ";
+      for (int j = i; j < i + 5000; j++) {
+        if (j > i)
+          stmt += ", ";
+        stmt += fmt::format("({}, 'v{}')", j, j % 7);
+      }
+      EXPECT_TRUE(db->Execute(stmt + ";").Valid());
+    }
+    auto count = [&](std::string_view stmt) -> int64_t {
+      auto result = db->Execute(stmt);
+      EXPECT_TRUE(result.Valid());
+      auto tuple = result.Next();
+      return tuple ? tuple.ReadInt(0) : 0;
+    };
+    EXPECT_EQ(count("select count(*) from A;"), N);
+    EXPECT_EQ(count("select count(*) from A where a >= 1000 and a < 9000;"),
+        8000);
+    EXPECT_EQ(count("select count(*) from A where a > 1000 and a <= 9000;"),
+        8000);
+    EXPECT_EQ(count("select count(*) from A where a > 100000;"), 0);
+    {
+      auto result = db->Execute("select a from A limit 3 offset 15000;");
+      ASSERT_TRUE(result.Valid());
+      for (int i = 15000; i < 15003; i++)
+        EXPECT_EQ(result.Next().ReadInt(0), i);
+      EXPECT_FALSE(bool(result.Next()));
+    }
+    {
+      auto result = db->Execute(
+          "select a, b from A where a >= 100 and a < 1000 limit 5 offset 898;");
+      ASSERT_TRUE(result.Valid());
+      EXPECT_EQ(result.Next().ReadInt(0), 998);
+      auto tuple = result.Next();
+      EXPECT_EQ(tuple.ReadInt(0), 999);
+      EXPECT_EQ(tuple.ReadString(1), fmt::format("v{}", 999 % 7));
+      EXPECT_FALSE(bool(result.Next()));
+    }
+    {
+      auto result = db->Execute("select a from A limit 1 offset 20000;");
+      ASSERT_TRUE(result.Valid());
+      EXPECT_FALSE(bool(result.Next()));
+    }
+    EXPECT_EQ(count("delete from A where a % 2 = 0;"), N / 2);
+    EXPECT_EQ(count("select count(*) from A;"), N / 2);
+    EXPECT_EQ(count("select count(*) from A where a < 5000;"), 2500);
+    {
+      auto result = db->Execute("select a from A limit 2 offset 1000;");
+      ASSERT_TRUE(result.Valid());
+      EXPECT_EQ(result.Next().ReadInt(0), 2001);
+      EXPECT_EQ(result.Next().ReadInt(0), 2003);
+      EXPECT_FALSE(bool(result.Next()));
+    }
+  }
+  std::filesystem::remove("__tmp_count");
+}
+
 TEST(BasicTest, ForeignKey) {
   using namespace wing;
   std::filesystem::remove("__tmp3");